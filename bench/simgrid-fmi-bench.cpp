@@ -0,0 +1,480 @@
+#include "simgrid/s4u.hpp"
+#include "simgrid-fmi.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+XBT_LOG_NEW_DEFAULT_CATEGORY(bench, "Messages specific for the simgrid-fmi micro-benchmarks");
+
+/*
+ * Micro-benchmarks of the co-simulation master algorithm.
+ *
+ * The FMUs are synthetic in-process models (no dlopen, no XML) so that the time
+ * measured is the one spent in the master: update_actions_state, solveCouplings,
+ * manageEventNotification, logOutput and the get/set accessors used by actors.
+ *
+ * usage: simgrid-fmi-bench [--topology chain|star|all-to-all|lorenz|all] [--fmus N]
+ *                          [--steps S] [--step-size dt] [--log file] [--output file.json]
+ *                          [--actors] [--statistics] [--check-allocations]
+ *
+ * Without --fmus, every topology is run for 1, 10, 100, 1000 and 10000 FMUs.
+ * Results are written as JSON (stdout by default). With --statistics, the runtime
+ * statistics of the master are also collected and printed after each run.
+ * With --check-allocations, the exit status is 1 if the master allocated memory
+ * during the measured steps of a kernel run (i.e. after the warm-up).
+ * FMU names and callback parameters are longer than the small string buffer of
+ * std::string, so that copies of them show up as allocations.
+ */
+
+// ALLOCATION COUNTING
+
+static std::atomic<unsigned long long> nb_allocations(0);
+static std::atomic<bool> count_allocations(false);
+
+void* operator new(std::size_t size){
+	if(count_allocations.load(std::memory_order_relaxed))
+		nb_allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = std::malloc(size == 0 ? 1 : size);
+	if(p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size){
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept{
+	std::free(p);
+}
+
+
+// SYNTHETIC FMU
+
+/**
+ * In-process co-simulation model with real variables only.
+ * The dynamic is a first order lag y' = -y + ext + sum(u), or one of the Lorenz equations.
+ */
+class SyntheticFMU : public simgrid::fmi::NativeModel{
+
+public:
+	enum Dynamic { LAG, LORENZ_X, LORENZ_Y, LORENZ_Z };
+
+	SyntheticFMU(Dynamic dynamic, unsigned int nb_inputs) : dynamic(dynamic), values(dynamic == LAG ? 2 + nb_inputs : 4, 0.){
+		values[0] = 1.;
+		addRealPort(dynamic == LORENZ_X ? "x" : dynamic == LORENZ_Y ? "y" : dynamic == LORENZ_Z ? "z" : "y", &values[0]);
+		addRealPort("ext", &values[1]);
+		if(dynamic == LAG){
+			for(unsigned int i = 0; i < nb_inputs; i++)
+				addRealPort("u" + std::to_string(i), &values[2 + i]);
+		}else{
+			// the two other Lorenz coordinates
+			values[2] = values[3] = 1.;
+			addRealPort(dynamic == LORENZ_X ? "y" : "x", &values[2]);
+			addRealPort(dynamic == LORENZ_Z ? "y" : "z", &values[3]);
+		}
+	}
+
+	void step(double current_time, double step_size) override{
+		double* v = values.data();
+		switch(dynamic){
+			case LAG:
+			{
+				double sum = v[1];
+				for(std::size_t i = 2; i < values.size(); i++)
+					sum += v[i];
+				v[0] += step_size * (sum - v[0]);
+				break;
+			}
+			case LORENZ_X:
+				v[0] += step_size * (10. * (v[2] - v[0]) + v[1]);
+				break;
+			case LORENZ_Y:
+				v[0] += step_size * (v[2] * (28. - v[3]) - v[0] + v[1]);
+				break;
+			case LORENZ_Z:
+				v[0] += step_size * (v[2] * v[3] - (8. / 3.) * v[0] + v[1]);
+				break;
+		}
+	}
+
+	bool canSaveState() const override{
+		return true;
+	}
+
+private:
+	Dynamic dynamic;
+	std::vector<double> values;
+};
+
+
+// TOPOLOGIES
+
+struct Topology{
+	std::string name;
+	std::vector<std::pair<std::string,SyntheticFMU*>> fmus;
+	std::vector<std::pair<port,port>> connections; // (out,in)
+};
+
+static std::string nodeName(int i){
+	return "synthetic_model_" + std::to_string(i);
+}
+
+static Topology buildTopology(std::string name, int nb_fmus){
+
+	Topology topo;
+	topo.name = name;
+
+	if(name == "chain"){
+		for(int i = 0; i < nb_fmus; i++)
+			topo.fmus.push_back({nodeName(i), new SyntheticFMU(SyntheticFMU::LAG, i > 0 ? 1 : 0)});
+		for(int i = 1; i < nb_fmus; i++)
+			topo.connections.push_back({{nodeName(i-1),"y"},{nodeName(i),"u0"}});
+
+	}else if(name == "star"){
+		topo.fmus.push_back({nodeName(0), new SyntheticFMU(SyntheticFMU::LAG, nb_fmus - 1)});
+		for(int i = 1; i < nb_fmus; i++){
+			topo.fmus.push_back({nodeName(i), new SyntheticFMU(SyntheticFMU::LAG, 1)});
+			topo.connections.push_back({{nodeName(0),"y"},{nodeName(i),"u0"}});
+			topo.connections.push_back({{nodeName(i),"y"},{nodeName(0),"u" + std::to_string(i-1)}});
+		}
+
+	}else if(name == "all-to-all"){
+		for(int i = 0; i < nb_fmus; i++)
+			topo.fmus.push_back({nodeName(i), new SyntheticFMU(SyntheticFMU::LAG, nb_fmus - 1)});
+		for(int i = 0; i < nb_fmus; i++){
+			int k = 0;
+			for(int j = 0; j < nb_fmus; j++){
+				if(i != j)
+					topo.connections.push_back({{nodeName(j),"y"},{nodeName(i),"u" + std::to_string(k++)}});
+			}
+		}
+
+	}else if(name == "lorenz"){
+		// nb_fmus is rounded to the number of complete Lorenz systems (3 FMUs each)
+		for(int i = 0; i < std::max(1, nb_fmus / 3); i++){
+			std::string x = "lorenz_x_of_system_" + std::to_string(i);
+			std::string y = "lorenz_y_of_system_" + std::to_string(i);
+			std::string z = "lorenz_z_of_system_" + std::to_string(i);
+			topo.fmus.push_back({x, new SyntheticFMU(SyntheticFMU::LORENZ_X, 0)});
+			topo.fmus.push_back({y, new SyntheticFMU(SyntheticFMU::LORENZ_Y, 0)});
+			topo.fmus.push_back({z, new SyntheticFMU(SyntheticFMU::LORENZ_Z, 0)});
+			topo.connections.push_back({{x,"x"},{y,"x"}});
+			topo.connections.push_back({{x,"x"},{z,"x"}});
+			topo.connections.push_back({{y,"y"},{x,"y"}});
+			topo.connections.push_back({{y,"y"},{z,"y"}});
+			topo.connections.push_back({{z,"z"},{y,"z"}});
+		}
+
+	}else{
+		xbt_die("unknown topology %s (expected chain, star, all-to-all or lorenz)",name.c_str());
+	}
+
+	return topo;
+}
+
+static void deleteTopology(Topology& topo){
+	for(auto& fmu : topo.fmus)
+		delete fmu.second;
+	topo.fmus.clear();
+}
+
+static std::string outputName(Topology& topo, int i){
+	std::string fmu = topo.fmus[i].first;
+	return fmu.compare(0, 7, "lorenz_") == 0 ? fmu.substr(7, 1) : "y";
+}
+
+
+// EVENTS AND SIMGRID INPUTS
+
+static bool neverTrue(const std::vector<std::string>& args){
+	return false;
+}
+
+static void neverCalled(const std::vector<std::string>& args){
+}
+
+static double noExternalLoad(const std::vector<std::string>& args){
+	return 0.;
+}
+
+
+// RESULTS
+
+struct Result{
+	std::string mode;
+	std::string topology;
+	int fmus;
+	std::size_t couplings;
+	long steps;
+	double seconds;
+	unsigned long long allocations;
+};
+
+static void printResults(FILE* out, std::vector<Result>& results){
+	std::fprintf(out, "{\n  \"benchmark\": \"simgrid-fmi-bench\",\n  \"results\": [");
+	for(std::size_t i = 0; i < results.size(); i++){
+		Result& r = results[i];
+		double ns_per_coupling = r.couplings == 0 ? 0 : r.seconds * 1e9 / ((double)r.steps * r.couplings);
+		std::fprintf(out, "%s\n    {\"mode\": \"%s\", \"topology\": \"%s\", \"fmus\": %d, \"couplings\": %zu, "
+				"\"steps\": %ld, \"seconds\": %.9f, \"steps_per_s\": %.3f, \"ns_per_coupling\": %.3f, "
+				"\"allocs_per_step\": %.3f}",
+				i == 0 ? "" : ",", r.mode.c_str(), r.topology.c_str(), r.fmus, r.couplings,
+				r.steps, r.seconds, r.steps / r.seconds, ns_per_coupling, (double)r.allocations / r.steps);
+	}
+	std::fprintf(out, "\n  ]\n}\n");
+}
+
+
+// KERNEL MODE: the master is driven directly, without SimGrid actors
+
+static Result runKernel(std::string topology, int nb_fmus, long steps, double step_size, std::string log_file, bool statistics){
+
+	Topology topo = buildTopology(topology, nb_fmus);
+	simgrid::fmi::MasterFMI* master = new simgrid::fmi::MasterFMI(step_size);
+
+	for(auto& fmu : topo.fmus)
+		master->addFMUCS(fmu.second, fmu.first, false);
+	for(auto& c : topo.connections)
+		master->connectFMU(c.first.fmu, c.first.name, c.second.fmu, c.second.name);
+
+	std::vector<port> monitored;
+	for(int i = 0; i < std::min<int>(16, topo.fmus.size()); i++)
+		monitored.push_back({topo.fmus[i].first, outputName(topo, i)});
+	master->configureOutputLog(log_file, monitored);
+
+	master->connectRealFMUToSimgrid(noExternalLoad, {"parameter of the external load"}, topo.fmus[0].first, "ext");
+
+	master->enableStatistics(statistics);
+	master->initCouplings();
+	master->registerEvent(neverTrue, neverCalled, {"parameter of the event condition"});
+
+	// warm-up
+	double now = 0;
+	for(int i = 0; i < 10; i++){
+		now += step_size;
+		master->update_actions_state(now, step_size);
+	}
+
+	nb_allocations = 0;
+	count_allocations = true;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(long i = 0; i < steps; i++){
+		now += step_size;
+		master->update_actions_state(now, step_size);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	count_allocations = false;
+
+	if(statistics)
+		master->printStatistics();
+
+	Result r;
+	r.mode = "kernel";
+	r.topology = topology;
+	r.fmus = topo.fmus.size();
+	r.couplings = topo.connections.size();
+	r.steps = steps;
+	r.seconds = std::chrono::duration<double>(end - start).count();
+	r.allocations = nb_allocations;
+
+	delete master;
+	deleteTopology(topo);
+	return r;
+}
+
+
+// ACTOR MODE: full SimGrid run where sampler actors read and write ports every step
+
+static const char* platform =
+		"<?xml version='1.0'?>\n"
+		"<!DOCTYPE platform SYSTEM \"https://simgrid.org/simgrid.dtd\">\n"
+		"<platform version=\"4.1\">\n"
+		"  <zone id=\"bench\" routing=\"Full\">\n"
+		"    <host id=\"bench_host\" speed=\"1Gf\"/>\n"
+		"  </zone>\n"
+		"</platform>\n";
+
+static Topology actor_topology;
+static long actor_steps;
+static double actor_step_size;
+
+static void sampler(std::vector<std::string> args){
+	int first = std::stoi(args[0]);
+	int nb_fmus = actor_topology.fmus.size();
+	std::vector<simgrid::fmi::PortHandle<double>> outputs;
+	for(int k = 0; k < 3; k++){
+		int j = (first + k) % nb_fmus;
+		outputs.push_back(simgrid::fmi::FMIPlugin::getPort<double>(actor_topology.fmus[j].first, outputName(actor_topology, j)));
+	}
+	simgrid::fmi::PortHandle<double> input = simgrid::fmi::FMIPlugin::getPort<double>(actor_topology.fmus[first].first, "ext");
+
+	for(long i = 0; i < actor_steps; i++){
+		simgrid::s4u::this_actor::sleep_for(actor_step_size);
+		double sum = 0;
+		for(const simgrid::fmi::PortHandle<double>& output : outputs)
+			sum += simgrid::fmi::FMIPlugin::get(output);
+		simgrid::fmi::FMIPlugin::set(input, sum / 3. * 1e-3);
+	}
+}
+
+static Result runActors(int* argc, char** argv, std::string topology, int nb_fmus, long steps, double step_size, std::string log_file, bool statistics){
+
+	simgrid::s4u::Engine e(argc, argv);
+	simgrid::fmi::FMIPlugin::initFMIPlugin(step_size);
+
+	std::string platform_file = "simgrid-fmi-bench-platform.xml";
+	FILE* f = std::fopen(platform_file.c_str(), "w");
+	if(f == nullptr)
+		xbt_die("cannot write the benchmark platform in %s",platform_file.c_str());
+	std::fputs(platform, f);
+	std::fclose(f);
+	e.load_platform(platform_file);
+
+	actor_topology = buildTopology(topology, nb_fmus);
+	actor_steps = steps;
+	actor_step_size = step_size;
+
+	for(auto& fmu : actor_topology.fmus)
+		simgrid::fmi::FMIPlugin::addFMUCS(fmu.second, fmu.first, false);
+	for(auto& c : actor_topology.connections)
+		simgrid::fmi::FMIPlugin::connectFMU(c.first.fmu, c.first.name, c.second.fmu, c.second.name);
+
+	std::vector<port> monitored;
+	for(int i = 0; i < std::min<int>(16, actor_topology.fmus.size()); i++)
+		monitored.push_back({actor_topology.fmus[i].first, outputName(actor_topology, i)});
+	simgrid::fmi::FMIPlugin::configureOutputLog(log_file, monitored);
+	simgrid::fmi::FMIPlugin::enableStatistics(statistics, statistics);
+	simgrid::fmi::FMIPlugin::readyForSimulation();
+
+	// one sampler actor per group of 3 FMUs, at most 64
+	int nb_samplers = std::min<int>(64, std::max<int>(1, actor_topology.fmus.size() / 3));
+	for(int i = 0; i < nb_samplers; i++){
+		std::vector<std::string> args = {std::to_string(i * 3 % actor_topology.fmus.size())};
+		simgrid::s4u::Actor::create("sampler_" + std::to_string(i), simgrid::s4u::Host::by_name("bench_host"), sampler, args);
+	}
+
+	nb_allocations = 0;
+	count_allocations = true;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	e.run();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	count_allocations = false;
+
+	std::remove(platform_file.c_str());
+
+	Result r;
+	r.mode = "actors";
+	r.topology = topology;
+	r.fmus = actor_topology.fmus.size();
+	r.couplings = actor_topology.connections.size();
+	r.steps = steps;
+	r.seconds = std::chrono::duration<double>(end - start).count();
+	r.allocations = nb_allocations;
+	return r;
+}
+
+
+// MAIN
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> topologies = {"chain", "star", "all-to-all", "lorenz"};
+	std::vector<int> sizes = {1, 10, 100, 1000, 10000};
+	long steps = 1000;
+	double step_size = 0.01;
+	std::string log_file = "/dev/null";
+	std::string output_file;
+	bool actors = false;
+	bool statistics = false;
+	bool check_allocations = false;
+
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if(arg == "--topology" && has_value){
+			std::string t = argv[++i];
+			if(t != "all")
+				topologies = {t};
+		}else if(arg == "--fmus" && has_value){
+			sizes = {std::atoi(argv[++i])};
+			if(sizes[0] < 1){
+				std::fprintf(stderr, "%s: --fmus expects a positive number of FMUs (got %s)\n", argv[0], argv[i]);
+				return 1;
+			}
+		}else if(arg == "--steps" && has_value){
+			steps = std::atol(argv[++i]);
+		}else if(arg == "--step-size" && has_value){
+			step_size = std::atof(argv[++i]);
+		}else if(arg == "--log" && has_value){
+			log_file = argv[++i];
+		}else if(arg == "--output" && has_value){
+			output_file = argv[++i];
+		}else if(arg == "--actors"){
+			actors = true;
+		}else if(arg == "--statistics"){
+			statistics = true;
+		}else if(arg == "--check-allocations"){
+			check_allocations = true;
+		}else if(arg.compare(0, 2, "--") == 0 && arg.find('=') == std::string::npos){
+			std::fprintf(stderr, "usage: %s [--topology chain|star|all-to-all|lorenz|all] [--fmus N] [--steps S] "
+					"[--step-size dt] [--log file] [--output file.json] [--actors] [--statistics] [--check-allocations] [SimGrid options]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<Result> results;
+
+	if(actors){
+		// the SimGrid engine can only be created once per process
+		results.push_back(runActors(&argc, argv, topologies[0], sizes[0], steps, step_size, log_file, statistics));
+	}else{
+		for(std::string topology : topologies){
+			for(int size : sizes){
+				// the number of couplings of all-to-all is quadratic
+				if(topology == "all-to-all" && size > 100 && sizes.size() > 1)
+					continue;
+				// bound the total work of each run to about 10^7 FMU steps
+				long nb_steps = std::max<long>(10, std::min<long>(steps, 10000000L / size));
+				results.push_back(runKernel(topology, size, nb_steps, step_size, log_file, statistics));
+			}
+		}
+	}
+
+	FILE* out = stdout;
+	if(!output_file.empty()){
+		out = std::fopen(output_file.c_str(), "w");
+		if(out == nullptr)
+			xbt_die("cannot open the output file %s",output_file.c_str());
+	}
+	printResults(out, results);
+	if(out != stdout)
+		std::fclose(out);
+
+	// the actor mode goes through SimGrid simcalls, which allocate
+	int status = 0;
+	for(Result& r : results){
+		if(check_allocations && r.mode == "kernel" && r.allocations > 0){
+			std::fprintf(stderr, "%s with %d FMUs: %llu allocations in %ld steps\n", r.topology.c_str(), r.fmus, r.allocations, r.steps);
+			status = 1;
+		}
+	}
+	return status;
+}
@@ -30,43 +30,52 @@ class Utility{
 
 public:
 
-	static double getDCPowerConsumption(std::vector<std::string> args){
-		double total_power = 0;
-		std::string dc_name = args[0];
+	static std::vector<simgrid::s4u::Host*> getDCHosts(std::string dc_name){
+		std::vector<simgrid::s4u::Host*> hosts;
 		for(int i=0;i<nb_hosts_per_cluster;i++){
 			std::string host_name = "c-" + std::to_string(i) + "."+ dc_name;
-			simgrid::s4u::Host* host = simgrid::s4u::Host::by_name(host_name);
-			total_power += sg_host_get_current_consumption(host);
+			hosts.push_back(simgrid::s4u::Host::by_name(host_name));
 		}
-		return total_power;
+		return hosts;
 	}
 };
 
-// EVENT DETECTORS
-
-static bool reactOnZeroValue(std::vector<std::string> args){
-	return simgrid::fmi::FMIPlugin::getIntegerOutput(args[0],args[1]) == 0;
-}
+// NATIVE MODELS
 
-// EVENT CALLBACKS
+/**
+ * C++ version of the chiller_failure FMU (see chiller_failure/chiller_failure.mo),
+ * used instead of the FMU when the example is run with --native-chiller.
+ */
+class ChillerFailure : public simgrid::fmi::NativeModel{
 
-static void wakeUpActor(std::vector<std::string> args){
+public:
+	ChillerFailure() : chiller_load(0), chiller_status(1), critic_load(23000){
+		addRealPort("chiller_load", &chiller_load);
+		addIntegerPort("chiller_status", &chiller_status);
+		addRealPort("critic_load", &critic_load);
+	}
 
-	unsigned long pid_on = std::stoul(args[2],0,10);
-	simgrid::s4u::Actor::by_pid(pid_on)->resume();
-}
+	void step(double current_time, double step_size) override{
+		if(chiller_load >= critic_load)
+			chiller_status = 0;
+	}
 
+	bool canSaveState() const override{
+		return true;
+	}
 
+private:
+	double chiller_load;
+	int chiller_status;
+	double critic_load;
+};
 
 // BEHAVIORS
 
 static void shutDownRennesHosts(std::vector<std::string> args){
 
 
-	unsigned long pid = simgrid::s4u::Actor::self()->get_pid();
-	std::vector<std::string> args_shutdown = {"thermal_system","power_supply_status",std::to_string(pid)};
-	simgrid::fmi::FMIPlugin::registerEvent(reactOnZeroValue,wakeUpActor,args_shutdown);
-	simgrid::s4u::Actor::self()->suspend();
+	simgrid::fmi::FMIPlugin::waitFor("thermal_system","power_supply_status",simgrid::fmi::port_comparison::EQUAL,0);
 
 	double T_R_out = simgrid::fmi::FMIPlugin::getRealOutput("thermal_system","T_R_out");
 	XBT_INFO("shutting-down rennes DC because the room temperature is too high ( %f °C )",T_R_out);
@@ -131,12 +140,7 @@ static int master_nominal_behavior(std::vector<std::string> args){
 
 static int failureNotifier(std::vector<std::string> args){
 
-	unsigned long pid = simgrid::s4u::Actor::self()->get_pid();
-
-	std::vector<std::string> params = {"chiller_failure","chiller_status",std::to_string(pid)};
-
-	simgrid::fmi::FMIPlugin::registerEvent(reactOnZeroValue,wakeUpActor,params);
-	simgrid::s4u::Actor::self()->suspend();
+	simgrid::fmi::FMIPlugin::waitFor("chiller_failure","chiller_status",simgrid::fmi::port_comparison::EQUAL,0);
 
 	XBT_INFO("failure of the chiller detected!!! send a message to notify the failure manager ");
 	double* payload = new double();
@@ -199,6 +203,19 @@ static int failureManager(std::vector<std::string> args){
 
 // MAIN
 
+static void createActors(){
+
+  std::vector<std::string> args;
+
+  simgrid::s4u::ActorPtr master_nominal = simgrid::s4u::Actor::create("master_nominal", simgrid::s4u::Host::by_name("c-0.sophia"), master_nominal_behavior, args);
+  simgrid::s4u::Actor::create("failure_notifier", simgrid::s4u::Host::by_name("c-0.rennes"), failureNotifier, args);
+  std::vector<std::string> args_failure_manager = {std::to_string(master_nominal.get()->get_pid())};
+  simgrid::s4u::ActorPtr failure_manager = simgrid::s4u::Actor::create("failure_manager", simgrid::s4u::Host::by_name("c-0.sophia"), failureManager, args_failure_manager);
+
+  std::vector<std::string> args_shutdown = {std::to_string(failure_manager.get()->get_pid())};
+  simgrid::s4u::Actor::create("shutdown_process", simgrid::s4u::Host::by_name("c-0.sophia"), shutDownRennesHosts, args_shutdown);
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -215,14 +232,27 @@ int main(int argc, char *argv[])
 
   e.load_platform("clusters_rennes.xml");
 
-  std::vector<std::string> args;
+  // OPTIONS (--native-chiller, --ensemble N)
+
+  bool native_chiller = false;
+  int nb_variants = 0;
+  for(int i = 1; i < argc; i++){
+	  if(std::string(argv[i]) == "--native-chiller")
+		  native_chiller = true;
+	  else if(std::string(argv[i]) == "--ensemble" && i + 1 < argc)
+		  nb_variants = std::stoi(argv[++i]);
+  }
+
 
   // ADDING FMUs
 
   std::string fmu_uri = "file://./chiller_failure";
   std::string fmu_name = "chiller_failure";
 
-  simgrid::fmi::FMIPlugin::addFMUCS(fmu_uri, fmu_name);
+  if(native_chiller)
+	  simgrid::fmi::FMIPlugin::addFMUCS(new ChillerFailure(), fmu_name);
+  else
+	  simgrid::fmi::FMIPlugin::addFMUCS(fmu_uri, fmu_name);
 
   std::string fmu_uri_2 = "file://./thermal_system";
   std::string fmu_name_2 = "thermal_system";
@@ -233,8 +263,7 @@ int main(int argc, char *argv[])
   simgrid::fmi::FMIPlugin::connectFMU("thermal_system","Q_cooling","chiller_failure","chiller_load");
   simgrid::fmi::FMIPlugin::connectFMU("chiller_failure","chiller_status","thermal_system","chiller_status");
 
-  std::vector<std::string> args_dc_pow = {"rennes"};
-  simgrid::fmi::FMIPlugin::connectRealFMUToSimgrid(Utility::getDCPowerConsumption,args_dc_pow,"thermal_system","P_load_DC");
+  simgrid::fmi::FMIPlugin::connectHostGroupPowerToFMU(Utility::getDCHosts("rennes"),"thermal_system","P_load_DC");
 
   // LOG OUTPUT
   std::vector<port> ports_to_monitor = {
@@ -254,15 +283,22 @@ int main(int argc, char *argv[])
 
 	simgrid::fmi::FMIPlugin::readyForSimulation();
 
-  // CREATING SIMGRID ACTORS
+  // ENSEMBLE OF CHILLER CAPACITIES (--ensemble N)
 
-  simgrid::s4u::ActorPtr master_nominal = simgrid::s4u::Actor::create("master_nominal", simgrid::s4u::Host::by_name("c-0.sophia"), master_nominal_behavior, args);
-  simgrid::s4u::Actor::create("failure_notifier", simgrid::s4u::Host::by_name("c-0.rennes"), failureNotifier, args);
-  std::vector<std::string> args_failure_manager = {std::to_string(master_nominal.get()->get_pid())};
-  simgrid::s4u::ActorPtr failure_manager = simgrid::s4u::Actor::create("failure_manager", simgrid::s4u::Host::by_name("c-0.sophia"), failureManager, args_failure_manager);
+  if(nb_variants > 0){
+	  simgrid::fmi::FMIPlugin::runEnsemble(nb_variants, [](int variant) {
+		  // critic_load is a parameter of the FMU: it is applied by a reset, before the FMUs are initialized again
+		  simgrid::fmi::fmu_parameters parameters;
+		  parameters.reals[{"chiller_failure", "critic_load"}] = 20000 + 1000 * variant;
+		  simgrid::fmi::FMIPlugin::resetSimulation(parameters, "output-" + std::to_string(variant) + ".csv");
+		  createActors();
+	  }, "ensemble.csv");
+	  return 0;
+  }
 
-  std::vector<std::string> args_shutdown = {std::to_string(failure_manager.get()->get_pid())};
-  simgrid::s4u::Actor::create("shutdown_process", simgrid::s4u::Host::by_name("c-0.sophia"), shutDownRennesHosts, args_shutdown);
+  // CREATING SIMGRID ACTORS
+
+  createActors();
 
   e.run();
 
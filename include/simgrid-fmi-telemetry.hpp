@@ -0,0 +1,171 @@
+#ifndef INCLUDE_SIMGRID_FMI_TELEMETRY_HPP_
+#define INCLUDE_SIMGRID_FMI_TELEMETRY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Layout of the telemetry file published by FMIPlugin::enableTelemetry, and reader of this file.
+ * The reader only needs this header (no SimGrid nor FMI++): tools running on the same machine map
+ * the file and sample the live values of the ports, while the simulation does no file I/O.
+ *
+ * The file starts with a telemetry_header, followed by the names of the ports ("fmu.port", each
+ * ending with a null character) and by a ring of capacity rows. Row n (counted from 0) is stored in
+ * slot n % capacity: a telemetry_row (sequence number and simulated time) followed by the values of
+ * the ports. The simulation is the only writer: it sets the sequence of the slot to 2n+1 before
+ * writing row n and to 2n+2 after it (seqlock), so that readers detect a row being overwritten.
+ */
+
+#define TELEMETRY_MAGIC "SGFMITLM"
+#define TELEMETRY_FORMAT 1
+
+namespace simgrid{
+namespace fmi{
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the telemetry needs lock-free 64 bits atomics (shared between processes)");
+
+struct telemetry_header{
+	char magic[8]; // written last by the simulation
+	uint32_t format;
+	uint32_t nb_ports;
+	uint64_t capacity;
+	uint64_t names_offset;
+	uint64_t rows_offset;
+	uint64_t row_size;
+	std::atomic<uint64_t> rows; // number of rows written
+	std::atomic<uint64_t> finished; // 1 once the simulation stopped publishing
+};
+
+struct telemetry_row{
+	std::atomic<uint64_t> sequence;
+	double time;
+};
+
+/**
+ * read-only mapping of a telemetry file
+ */
+class TelemetryReader{
+
+public:
+	TelemetryReader() {}
+	TelemetryReader(const TelemetryReader&) = delete;
+	TelemetryReader& operator=(const TelemetryReader&) = delete;
+	~TelemetryReader(){
+		close();
+	}
+
+	/**
+	 * map the telemetry file at path (false if it does not exist or is not a complete telemetry file yet)
+	 */
+	bool open(const std::string& path){
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || (std::size_t) st.st_size < sizeof(telemetry_header)){
+			::close(fd);
+			return false;
+		}
+		void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(map == MAP_FAILED)
+			return false;
+		data = static_cast<const char*>(map);
+		size = st.st_size;
+		header = reinterpret_cast<const telemetry_header*>(data);
+
+		bool complete = std::memcmp(header->magic, TELEMETRY_MAGIC, sizeof(header->magic)) == 0;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(!complete || header->format != TELEMETRY_FORMAT || header->capacity == 0
+				|| header->rows_offset + header->capacity * header->row_size > size){
+			close();
+			return false;
+		}
+		const char* name = data + header->names_offset;
+		for(uint32_t i = 0; i < header->nb_ports; i++){
+			names.push_back(name);
+			name += names.back().size() + 1;
+		}
+		return true;
+	}
+
+	void close(){
+		if(data != nullptr)
+			munmap(const_cast<char*>(data), size);
+		data = nullptr;
+		header = nullptr;
+		names.clear();
+	}
+
+	/**
+	 * names of the ports ("fmu.port"), in the order of the values of the rows
+	 */
+	const std::vector<std::string>& getPortNames() const{
+		return names;
+	}
+
+	uint64_t getCapacity() const{
+		return header->capacity;
+	}
+
+	/**
+	 * number of rows written so far (only the last getCapacity() ones can still be read)
+	 */
+	uint64_t getRows() const{
+		return header->rows.load(std::memory_order_acquire);
+	}
+
+	bool isFinished() const{
+		return header->finished.load(std::memory_order_acquire) != 0;
+	}
+
+	/**
+	 * copy the time and the values (one per port) of row n: false if the row is not written yet,
+	 * or was overwritten before or while being copied
+	 */
+	bool readRow(uint64_t n, double* time, double* values) const{
+		const char* slot = data + header->rows_offset + (n % header->capacity) * header->row_size;
+		const telemetry_row* row = reinterpret_cast<const telemetry_row*>(slot);
+		const uint64_t written = 2 * n + 2;
+		if(row->sequence.load(std::memory_order_acquire) != written)
+			return false;
+		*time = row->time;
+		std::memcpy(values, slot + sizeof(telemetry_row), names.size() * sizeof(double));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return row->sequence.load(std::memory_order_relaxed) == written;
+	}
+
+	/**
+	 * copy the last row written (false if there is none yet), and its number in n
+	 */
+	bool readLast(uint64_t* n, double* time, double* values) const{
+		for(;;){
+			uint64_t rows = getRows();
+			if(rows == 0)
+				return false;
+			if(readRow(rows - 1, time, values)){
+				*n = rows - 1;
+				return true;
+			}
+		}
+	}
+
+private:
+	const char* data = nullptr;
+	std::size_t size = 0;
+	const telemetry_header* header = nullptr;
+	std::vector<std::string> names;
+};
+
+}
+}
+
+#endif /* INCLUDE_SIMGRID_FMI_TELEMETRY_HPP_ */
@@ -4,7 +4,14 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <algorithm>
 #include <simgrid/kernel/resource/Model.hpp>
+#include <simgrid/forward.h>
 #include "FMUCoSimulation_v1.h"
 #include "FMUCoSimulation_v2.h"
 #include "ModelManager.h"
@@ -17,7 +24,7 @@ struct port{
 	std::string name;
 };
 
-bool operator== (port a, port b){
+inline bool operator== (const port& a, const port& b){
 	return (a.fmu == b.fmu) && (a.name == b.name);
 }
 
@@ -40,32 +47,473 @@ namespace fmi{
 
 struct real_simgrid_fmu_connection{
 	port in;
-	double (*generateInput)(std::vector<std::string>);
+	std::function<double(const std::vector<std::string>&)> generateInput;
 	std::vector<std::string> params;
 };
 
 struct integer_simgrid_fmu_connection{
 	port in;
-	int (*generateInput)(std::vector<std::string>);
+	std::function<int(const std::vector<std::string>&)> generateInput;
 	std::vector<std::string> params;
 };
 
 struct boolean_simgrid_fmu_connection{
 	port in;
-	bool (*generateInput)(std::vector<std::string>);
+	std::function<bool(const std::vector<std::string>&)> generateInput;
 	std::vector<std::string> params;
 };
 
 struct string_simgrid_fmu_connection{
 	port in;
-	std::string (*generateInput)(std::vector<std::string>);
+	std::function<std::string(const std::vector<std::string>&)> generateInput;
 	std::vector<std::string> params;
 };
 
+/**
+ * hosts whose total power consumption feeds a real input. The power of each host is kept with
+ * the load it was computed for, and only computed again when the host is marked dirty by the
+ * SimGrid signals (an execution starts or completes on it, its pstate or its state changes).
+ * All the loads are still checked from time to time, for the changes that are not signaled.
+ */
+struct host_group_power{
+	port in;
+	std::vector<simgrid::s4u::Host*> hosts;
+	std::vector<double> loads;
+	std::vector<double> powers;
+	std::vector<bool> dirty;
+	std::vector<std::size_t> dirty_hosts; // indexes of the hosts marked dirty since the last update
+	double total = 0;
+	unsigned long updates = 0; // since the total was last summed from scratch
+	unsigned long visits = 0; // since all the loads were last checked
+	bool sent = false;
+};
+
+/**
+ * A port resolved once by FMIPlugin::getPort: the FMU is designated by its index in the master
+ * and the variable by its value reference (the name is kept for the FMI 3.0 array elements,
+ * which have no value reference of their own, and for error messages).
+ */
+struct port_handle{
+	std::size_t fmu = 0;
+	fmiValueReference valref = fmiValueReference(-1);
+	FMIVariableType type = FMIVariableType::fmiTypeUnknown;
+	bool coupled = false;
+	std::size_t snapshot_slot = std::size_t(-1); // index of the port in the output snapshot, if published
+	port p;
+};
+
+/**
+ * typed port handle (T is double, int, bool or std::string)
+ */
+template<typename T> struct PortHandle : public port_handle{
+};
+
+enum class resource_binding_type { HOST_PSTATE, HOST_SPEED_SCALE, HOST_ON_OFF, LINK_BANDWIDTH };
+
+/**
+ * an FMU output driving a SimGrid resource (see FMIPlugin::bindFMUOutputToHostPstate). The
+ * mapping (identity if empty) is only applied when the output differs from last_output.
+ */
+struct resource_binding{
+	port_handle out;
+	resource_binding_type type;
+	simgrid::s4u::Host* host = nullptr;
+	simgrid::s4u::Link* link = nullptr;
+	std::function<double(double)> mapping;
+	double last_output = 0;
+	bool applied = false;
+};
+
+/**
+ * transform applied by a coupling to the value sent to its input:
+ * min(max(gain * function(value) + offset, min), max), function being the identity if empty
+ */
+struct coupling_transform{
+	double gain;
+	double offset;
+	double min;
+	double max;
+	std::function<double(double)> function;
+
+	explicit coupling_transform(double gain=1, double offset=0, double min=-std::numeric_limits<double>::infinity(),
+			double max=std::numeric_limits<double>::infinity())
+	: gain(gain), offset(offset), min(min), max(max) {}
+	explicit coupling_transform(std::function<double(double)> function)
+	: gain(1), offset(0), min(-std::numeric_limits<double>::infinity()), max(std::numeric_limits<double>::infinity()), function(function) {}
+
+	double apply(double value) const{
+		if(function)
+			value = function(value);
+		return std::min(std::max(gain * value + offset, min), max);
+	}
+};
+
+enum class fan_in_operation { SUM, MEAN, MAX, MIN };
+
+/**
+ * coupling of the outputs (reals or integers) sources[first..first+count-1] of the master to a real
+ * input, through an aggregation (fan-in) and a transform
+ */
+struct transformed_coupling{
+	port_handle in;
+	std::size_t first;
+	std::size_t count;
+	fan_in_operation operation;
+	coupling_transform transform;
+};
+
+template<typename T> struct port_type;
+template<> struct port_type<double>{ static const FMIVariableType type = FMIVariableType::fmiTypeReal; };
+template<> struct port_type<int>{ static const FMIVariableType type = FMIVariableType::fmiTypeInteger; };
+template<> struct port_type<bool>{ static const FMIVariableType type = FMIVariableType::fmiTypeBoolean; };
+template<> struct port_type<std::string>{ static const FMIVariableType type = FMIVariableType::fmiTypeString; };
+
+struct native_state;
+
+/**
+ * A port of a native model, bound to a member variable of the model.
+ */
+struct native_port{
+	std::string name;
+	FMIVariableType type;
+	void* value;
+};
+
+/**
+ * Interface of the models able to save and restore their internal state (like fmi2GetFMUstate,
+ * fmi2SetFMUstate and fmi2FreeFMUstate), needed to step them speculatively.
+ * saveState allocates a new state when *state is nullptr and overwrites it otherwise.
+ * allowStateRestores tells the model whether a state saved before its current point may be restored
+ * (speculation, step retries or tabulation), so that it keeps what it needs for such a rollback.
+ * serializeState and deserializeState copy a saved state to and from bytes (like fmi3SerializeFMUState
+ * and fmi3DeserializeFMUState), which lets the worker of a remote FMU restart from its last step; models
+ * that can not do it return fmiError.
+ */
+class StatefulModel{
+
+public:
+	virtual ~StatefulModel() {}
+	virtual bool canSaveState() const = 0;
+	virtual fmiStatus saveState(void** state) = 0;
+	virtual fmiStatus restoreState(void* state) = 0;
+	virtual void freeState(void* state) = 0;
+	virtual void allowStateRestores(bool allow) {}
+	virtual fmiStatus serializeState(void* state, std::vector<char>& data) { return fmiError; }
+	virtual fmiStatus deserializeState(const char* data, std::size_t size, void** state) { return fmiError; }
+};
+
+/**
+ * Base class of the models written directly in C++ instead of being exported as FMUs.
+ *
+ * A native model is added with FMIPlugin::addFMUCS(model, name) and then behaves exactly like
+ * an FMU for the couplings, events and logging. Subclasses bind their ports to member variables
+ * with addRealPort, addIntegerPort, addBooleanPort and addStringPort (usually in their constructor)
+ * and implement step(), which reads and writes these members directly.
+ * The value reference of a port is its declaration rank. A native model can not save its state by
+ * default. The state methods save the time and the value of the ports: models whose whole state is
+ * held in their ports opt in by overriding canSaveState() to return true, and models with other
+ * internal variables must override all the state methods.
+ */
+class NativeModel : public FMUCoSimulationBase, public StatefulModel{
+
+public:
+	NativeModel();
+	virtual ~NativeModel();
+
+	/**
+	 * advance the model from current_time to current_time + step_size (step_size can be 0)
+	 */
+	virtual void step(double current_time, double step_size) = 0;
+
+	/**
+	 * called when the model is added to the co-simulation, and again at each reset of the simulation
+	 * once the ports got back their values of the first initialization (see reset())
+	 */
+	virtual void start(double start_time) {}
+
+	/**
+	 * give back to the ports the values they had when the model was first initialized
+	 * (models with other internal variables override it to reset them too)
+	 */
+	virtual void reset();
+
+	fmiStatus instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive) override;
+	fmiStatus initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime) override;
+	fmiReal getTime() const override;
+	fmiStatus doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep) override;
+
+	fmiStatus setValue(fmiValueReference valref, const fmiReal& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiInteger& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiBoolean& val) override;
+	fmiStatus setValue(fmiValueReference valref, const std::string& val) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const std::string* val, std::size_t ival) override;
+	fmiStatus setValue(const std::string& name, const fmiReal& val) override;
+	fmiStatus setValue(const std::string& name, const fmiInteger& val) override;
+	fmiStatus setValue(const std::string& name, const fmiBoolean& val) override;
+	fmiStatus setValue(const std::string& name, const std::string& val) override;
+
+	fmiStatus getValue(fmiValueReference valref, fmiReal& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiInteger& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiBoolean& val) override;
+	fmiStatus getValue(fmiValueReference valref, std::string& val) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, std::string* val, std::size_t ival) override;
+	fmiStatus getValue(const std::string& name, fmiReal& val) override;
+	fmiStatus getValue(const std::string& name, fmiInteger& val) override;
+	fmiStatus getValue(const std::string& name, fmiBoolean& val) override;
+	fmiStatus getValue(const std::string& name, std::string& val) override;
+
+	fmiValueReference getValueRef(const std::string& name) const override;
+	FMIVariableType getType(const std::string& variableName) const override;
+	fmiStatus getLastStatus() const override;
+	std::size_t nStates() const override;
+	std::size_t nEventInds() const override;
+	std::size_t nValueRefs() const override;
+	const ModelDescription* getModelDescription() const override;
+	void sendDebugMessage(const std::string& msg) const override;
+	void logger(fmiStatus status, const std::string& category, const std::string& msg) const override;
+
+	bool canSaveState() const override;
+	fmiStatus saveState(void** state) override;
+	fmiStatus restoreState(void* state) override;
+	void freeState(void* state) override;
+	fmiStatus serializeState(void* state, std::vector<char>& data) override;
+	fmiStatus deserializeState(const char* data, std::size_t size, void** state) override;
+
+protected:
+	void addRealPort(std::string name, double* value);
+	void addIntegerPort(std::string name, int* value);
+	void addBooleanPort(std::string name, bool* value);
+	void addStringPort(std::string name, std::string* value);
+
+private:
+	std::vector<native_port> ports;
+	std::unordered_map<std::string,fmiValueReference> port_refs;
+	double time;
+	fmiStatus last_status;
+	native_state* start_values;
+
+	void addPort(std::string name, FMIVariableType type, void* value);
+	void savePorts(native_state* saved) const;
+	void restorePorts(const native_state* saved);
+	native_port* getPort(fmiValueReference valref, fmiStatus* status);
+};
+
+/**
+ * a real input of a tabulated surrogate model, sampled at points regularly spaced from min to max
+ */
+struct surrogate_axis{
+	std::string name;
+	double min;
+	double max;
+	int points;
+};
+
+/**
+ * Cheap replacement of an FMU driven within a narrow input envelope, with the names of the real
+ * ports of this FMU (see FMIPlugin::replaceFMU):
+ * - tabulate() samples the FMU on a grid of its inputs (design of experiments): from the current
+ *   state of the FMU, each point is stepped for settle_time and its outputs are read. The surrogate
+ *   gives its outputs by multilinear interpolation of this table (quasi-static model).
+ * - fit() fits a first-order state-space model dy/dt = A.y + B.u + c by least squares on recorded
+ *   runs, i.e. output logs of the master in which the ports of the FMU were monitored.
+ * The error bound of each output is estimated when the surrogate is built: against the FMU at the
+ * center of each cell of the table, or as the largest one-step prediction error on the samples.
+ * Inputs are clamped to the envelope they were sampled on, and the steps outside of it are counted.
+ */
+class SurrogateModel : public NativeModel{
+
+public:
+	static SurrogateModel* tabulate(FMUCoSimulationBase* model, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs, double settle_time, double step_size);
+	static SurrogateModel* fit(std::vector<std::string> log_files, std::vector<port> monitored_ports, std::string fmu_name,
+			std::vector<std::string> inputs, std::vector<std::string> outputs);
+
+	double getErrorBound(std::string output) const;
+	unsigned long long getOutOfEnvelopeSteps() const;
+
+	void start(double start_time) override;
+	void step(double current_time, double step_size) override;
+	bool canSaveState() const override;
+
+private:
+	SurrogateModel(const std::vector<std::string>& inputs, const std::vector<std::string>& outputs);
+
+	bool tabulated;
+	std::vector<std::string> output_names;
+	std::vector<double> inputs;
+	std::vector<double> outputs;
+	std::vector<double> errors;
+	std::vector<double> input_min;
+	std::vector<double> input_max;
+	std::vector<double> clamped;
+	unsigned long long out_of_envelope;
+
+	/**
+	 * table: outputs of each point of the grid, point after point (the first input varies the slowest)
+	 */
+	std::vector<surrogate_axis> axes;
+	std::vector<std::size_t> strides;
+	std::vector<double> table;
+	std::vector<double> fractions;
+
+	/**
+	 * fit: A (outputs x outputs), B (outputs x inputs), c, and the values at the start of the first run
+	 */
+	std::vector<double> a;
+	std::vector<double> b;
+	std::vector<double> c;
+	std::vector<double> start_inputs;
+	std::vector<double> start_outputs;
+	double fit_step;
+	std::vector<double> derivatives;
+
+	void clampInputs();
+	void interpolate(const double* point, double* values);
+	void derive(const double* y, const double* u, double* dy) const;
+};
+
+/**
+ * time and counters of one FMU (times in seconds)
+ */
+struct fmu_statistics{
+	unsigned long long steps = 0;
+	unsigned long long zero_steps = 0;
+	unsigned long long retried_steps = 0; // discarded steps resumed or split
+	unsigned long long warnings = 0;
+	double doStep_time = 0;
+	// FMUs running in a worker process only
+	unsigned long long round_trips = 0;
+	double round_trip_time = 0;
+	unsigned long long restarts = 0;
+};
+
+/**
+ * runtime statistics of the co-simulation, collected only when enabled (times in seconds)
+ */
+struct fmi_statistics{
+	unsigned long long steps = 0;
+	std::unordered_map<std::string,fmu_statistics> fmus;
+	unsigned long long coupling_solves = 0;
+	unsigned long long coupling_sweeps = 0;
+	double coupling_time = 0;
+	unsigned long long external_coupling_solves = 0;
+	double external_coupling_time = 0;
+	unsigned long long event_conditions_evaluated = 0;
+	unsigned long long events_fired = 0;
+	double event_time = 0;
+	unsigned long long bytes_logged = 0;
+	double log_time = 0;
+	unsigned long long speculation_hits = 0;
+	unsigned long long speculation_misses = 0;
+	unsigned long long deferred_inputs = 0;
+};
+/**
+ * values of an output at the last communication points (oldest first, at most order+1 samples),
+ * used to interpolate it between them
+ */
+struct port_history{
+	int order = 1;
+	fmiValueReference valref = fmiValueReference(-1);
+	std::vector<double> times;
+	std::vector<double> values;
+};
+
+/**
+ * online statistics of an output (see FMIPlugin::accumulateOutput), updated at the end of each step.
+ * The integral (trapezoidal rule) and the time above the threshold consider the output as linear
+ * between two steps. The mean and the variance (Welford) weight each value by the length of its step.
+ */
+struct port_accumulator{
+	unsigned long long samples = 0;
+	double start_time = 0;
+	double last_time = 0;
+	double last_value = 0;
+	double integral = 0;
+	double min = 0;
+	double min_time = 0;
+	double max = 0;
+	double max_time = 0;
+	double mean = 0;
+	double m2 = 0; // sum of the squared deviations from the mean, weighted by the step lengths
+	double threshold = std::numeric_limits<double>::infinity();
+	double time_above = 0;
+	double histogram_min = 0;
+	double histogram_max = 0;
+	std::vector<unsigned long long> histogram;
+
+	void add(double time, double value);
+	void clear();
+	double variance() const{
+		return last_time > start_time ? m2 / (last_time - start_time) : 0;
+	}
+};
+
+enum class port_comparison { LESS, LESS_OR_EQUAL, GREATER, GREATER_OR_EQUAL, EQUAL, NOT_EQUAL };
+
+/**
+ * actors blocked by FMIPlugin::waitUntil or waitFor on the same condition: the condition is evaluated
+ * once per update for all of them, and the master wakes them through cv once it holds
+ */
+struct fmu_wait{
+	std::function<bool()> condition; // waitUntil only
+	port_comparison comparison = port_comparison::EQUAL;
+	double value = 0;
+	simgrid::s4u::MutexPtr mutex;
+	simgrid::s4u::ConditionVariablePtr cv;
+	std::size_t waiters = 0;
+	bool satisfied = false;
+	bool cancelled = false; // by the reset of the simulation
+};
+
+/**
+ * waits on the same output (see FMIPlugin::waitFor): the output is read once per update for all of them
+ */
+struct output_wait{
+	port_handle out;
+	std::vector<std::shared_ptr<fmu_wait>> waits;
+};
+
+/**
+ * values of FMU parameters, applied before the initialization of the FMUs (see FMIPlugin::resetSimulation)
+ */
+struct fmu_parameters{
+	std::unordered_map<port,double> reals;
+	std::unordered_map<port,int> integers;
+	std::unordered_map<port,bool> booleans;
+	std::unordered_map<port,std::string> strings;
+};
+
+/**
+ * summary of one variant of an ensemble (see FMIPlugin::runEnsemble)
+ */
+struct ensemble_result{
+	int variant = 0;
+	bool done = false;
+	int exit_status = -1;
+	double simulated_time = 0;
+	double wall_time = 0;
+	unsigned long long steps = 0;
+	unsigned long long doSteps = 0;
+	unsigned long long coupling_solves = 0;
+	unsigned long long coupling_sweeps = 0;
+	unsigned long long events_fired = 0;
+};
+
+class RemoteFMU;
+class FMUGroup;
+class TelemetryWriter;
+class InputTransaction;
 
 class MasterFMI : public simgrid::kernel::resource::Model{
 
 private:
+	friend class FMUGroup;
+
 	/*
 	 * The set of FMUs to simulate
 	 */
@@ -74,6 +522,25 @@ private:
 	 * Indicate if an FMU require an iteration (i.e. doStep(O)) to update its outputs when setting input
 	 */
 	std::unordered_map<std::string,bool> iterate_input;
+	/*
+	 * The same FMUs indexed by their rank of addition (used by the port handles)
+	 */
+	std::vector<FMUCoSimulationBase*> fmu_table;
+	std::vector<std::string> fmu_table_names;
+	std::vector<bool> fmu_table_iterate_input;
+	std::unordered_map<std::string,std::size_t> fmu_indexes;
+	/*
+	 * The FMUs running in a worker process (also in fmus), stepped in parallel
+	 */
+	std::unordered_map<std::string,RemoteFMU*> remote_fmus;
+	/*
+	 * The groups of FMUs co-simulated by their own master (also in fmus), owned by this master
+	 */
+	std::unordered_map<std::string,FMUGroup*> fmu_groups;
+	/*
+	 * The URI of the FMUs loaded by the plugin (used to reload them on reset)
+	 */
+	std::unordered_map<std::string,std::string> fmu_uris;
 
 	/**
 	 * coupling between FMUs (nb: key=input value=output !)
@@ -81,6 +548,21 @@ private:
 	std::unordered_map<port,port> couplings;
 	std::vector<port> in_coupled_input;
 
+	/**
+	 * coupling between array variables of FMI 3.0 FMUs, solved as whole blocks (nb: key=input value=output !)
+	 */
+	std::unordered_map<port,port> array_couplings;
+	std::vector<port> in_array_coupled_input;
+
+	/**
+	 * couplings with a transform or a fan-in, solved with the others: the sources of all of them are
+	 * stored contiguously in transformed_sources, and their values read in transformed_values
+	 */
+	std::vector<transformed_coupling> transformed_couplings;
+	std::vector<port_handle> transformed_sources;
+	std::vector<double> transformed_values;
+	std::vector<double> last_transformed_inputs;
+
 	/**
 	 * coupling between SimGrid models and FMUs
 	 */
@@ -88,6 +570,19 @@ private:
 	std::vector<integer_simgrid_fmu_connection> integer_ext_couplings;
 	std::vector<boolean_simgrid_fmu_connection> boolean_ext_couplings;
 	std::vector<string_simgrid_fmu_connection> string_ext_couplings;
+	std::vector<host_group_power> host_groups;
+	std::unordered_map<simgrid::s4u::Host*,std::vector<std::pair<std::size_t,std::size_t>>> host_group_members;
+	std::vector<resource_binding> resource_bindings;
+
+	/**
+	 * output snapshot: the published ports are copied in snapshot_values[snapshot_epoch & 1] at the
+	 * end of each update, while readers use the other buffer (reals, integers and booleans are all
+	 * stored as doubles)
+	 */
+	std::unordered_map<port,std::size_t> snapshot_slots;
+	std::vector<port_handle> snapshot_ports;
+	std::vector<double> snapshot_values[2];
+	std::atomic<unsigned long> snapshot_epoch;
 
 	std::vector<port> ext_coupled_input;
 	std::ofstream output;
@@ -96,6 +591,12 @@ private:
 
 	bool ready_for_simulation;
 
+	/**
+	 * the FMUs were stepped or got inputs from the actors since their (re)initialization: otherwise
+	 * resetSimulation only resets those that get parameters (as in the children of an ensemble)
+	 */
+	bool fmus_started;
+
 	/**
 	 * last output values send to the input
 	 */
@@ -103,6 +604,84 @@ private:
 	std::unordered_map<port,int> last_int_outputs;
 	std::unordered_map<port,bool> last_bool_outputs;
 	std::unordered_map<port,std::string> last_string_outputs;
+	std::unordered_map<port,std::vector<double>> last_array_outputs;
+
+	/**
+	 * last values of the SimGrid models sent to the FMUs (in the order of the *_ext_couplings)
+	 */
+	std::vector<double> last_real_ext_inputs;
+	std::vector<int> last_int_ext_inputs;
+	std::vector<bool> last_bool_ext_inputs;
+	std::vector<std::string> last_string_ext_inputs;
+
+	/**
+	 * buffers reused to read the string and array outputs (so that the updates do not allocate)
+	 */
+	std::string string_buffer;
+	std::vector<double> array_buffer;
+	std::vector<std::size_t> batch_order; // order of the inputs of a transaction, by FMU (see setBatch)
+
+	/**
+	 * lazy mode: the FMUs are only advanced up to lazy_target (the SimGrid clock) when observed,
+	 * with steps of at most lazy_step, and up to the horizons (multiples of lazy_step) when the events,
+	 * waits, output log, telemetry, bindings or groups sample them
+	 */
+	bool lazy;
+	double lazy_step;
+	double lazy_target;
+
+	/**
+	 * interpolated outputs (when not empty, the FMUs are stepped on the communication grid)
+	 */
+	std::unordered_map<port,port_history> histories;
+	bool check_input_time; // false for the master of a group, whose inputs come from its parent at its own time
+
+	/**
+	 * online statistics of outputs (accumulator_indexes gives the rank of a port in accumulated_ports
+	 * and accumulators)
+	 */
+	std::unordered_map<port,std::size_t> accumulator_indexes;
+	std::vector<port_handle> accumulated_ports;
+	std::vector<port_accumulator> accumulators;
+
+	/**
+	 * speculative stepping: the next communication step is computed by a background thread
+	 * between two updates, from the states saved in spec_states (one per FMU of fmu_table)
+	 */
+	bool speculative;
+	bool speculating;
+	std::thread speculation;
+	double spec_time;
+	std::vector<void*> spec_states;
+	std::vector<fmiStatus> spec_status;
+
+	/**
+	 * number of times a discarded step can be split in two (0 to stop on the first discard), and
+	 * the states saved before the steps (one per FMU of fmu_table, reused from one step to the next)
+	 */
+	int step_retry_depth;
+	std::vector<void*> step_states;
+
+	/**
+	 * record of everything that changes the FMUs (inputs, steps, coupling solves), replayed by replay().
+	 * The recording is paused while the couplings are solved, as they are solved again by the replay.
+	 */
+	std::ofstream trace;
+	std::string trace_path;
+	bool trace_paused;
+
+	/**
+	 * live telemetry: the ports are published after each coupling solve in a memory-mapped ring of rows
+	 * (see simgrid-fmi-telemetry.hpp)
+	 */
+	TelemetryWriter* telemetry;
+	std::vector<port_handle> telemetry_ports;
+
+	/**
+	 * actors blocked until a condition holds (see FMIPlugin::waitUntil and waitFor), checked after the events
+	 */
+	std::vector<output_wait> output_waits;
+	std::vector<std::shared_ptr<fmu_wait>> condition_waits;
 
 	double nextEvent;
 	double commStep;
@@ -110,76 +689,429 @@ private:
 
 	bool firstEvent;
 
-	std::vector<void (*)(std::vector<std::string>)> event_handlers;
-	std::vector<bool (*)(std::vector<std::string>)> event_conditions;
+	std::vector<std::function<void(const std::vector<std::string>&)>> event_handlers;
+	std::vector<std::function<bool(const std::vector<std::string>&)>> event_conditions;
 	std::vector<std::vector<std::string>> event_params;
 
+	/**
+	 * runtime statistics (collected only when collect_statistics is true)
+	 */
+	bool collect_statistics;
+	fmi_statistics statistics;
+
 	void manageEventNotification();
+	void notifyWaits();
+	void cancelWaits();
+	bool hasEvents();
+	void iterateInput(std::string fmi_name);
+	void iterateInput(std::size_t fmu);
+	void inputChanged(const port_handle& handle);
+	template<typename T> void setBatch(const std::vector<std::pair<port_handle,T>>& inputs, FMIVariableType type, std::vector<bool>& touched);
+	FMUCoSimulationBase* checkHandle(const port_handle& handle, FMIVariableType type, bool input);
 	void solveCouplings(bool firstIteration);
-	bool solveCoupling(port in, port out, bool checkChange);
+	bool solveCoupling(const port& in, const port& out, bool checkChange);
+	bool solveArrayCoupling(const port& in, const port& out, bool checkChange);
+	bool solveTransformedCoupling(std::size_t coupling, bool checkChange);
+	void readStringOutput(const std::string& fmi_name, const std::string& output_name, std::string& out);
+	void readRealArrayOutput(const std::string& fmi_name, const std::string& output_name, std::vector<double>& out);
+	std::size_t getArraySize(const std::string& fmi_name, const std::string& port_name);
 	void solveExternalCoupling();
-	void checkPortValidity(std::string fmu_name, std::string port_name, FMIVariableType type, bool check_already_coupled);
+	bool lazyExternalCoupling(double now);
+	bool hasObservers();
+	double lazyHorizon(double time);
+	bool catchUpToHorizon(double now);
+	void markHostPower(simgrid::s4u::Host* host);
+	bool updateHostGroupPower(host_group_power& group);
+	void applyResourceBindings();
+	void publishOutputs();
+	void advance(double now, double step);
+	void stepFMUs(double dt);
+	double gridTime(double time);
+	void recordHistory(const port& p, port_history& history);
+	bool interpolate(const port& p, double time, double* value);
+	double readNumericOutput(const port_handle& handle);
+	void accumulateOutputs();
+	void publishTelemetry();
+	void startSpeculation();
+	bool commitSpeculation(double now);
+	void settle();
+	bool saveStepState(FMUCoSimulationBase* model, void** state);
+	void freeStepStates();
+	fmiStatus subStep(const std::string& fmu_name, FMUCoSimulationBase* model, double time, double dt, int depth);
+	fmiStatus retryStep(const std::string& fmu_name, FMUCoSimulationBase* model, void* state, double time, double dt, fmiStatus status, int depth);
+	void checkPortValidity(const std::string& fmu_name, const std::string& port_name, FMIVariableType type, bool check_already_coupled);
+	bool isAhead();
+	void checkInputTime(const std::string& fmi_name, const std::string& input_name);
+	void checkInputTime();
+	void updateStateRestores();
+	void checkStepRetry(std::size_t fmu);
 	bool isInputCoupled(std::string fmu, std::string input_name);
 	void logOutput();
 	void checkNotReadyForSimulation();
+	void resetFMU(std::string fmu_name, double start_time, const fmu_parameters &parameters, bool keep_unchanged);
+	void recordReady();
+	void recordStep(double dt);
+	void recordCoupling(bool firstIteration);
+	void recordIterate(std::size_t fmu);
+	void recordInput(const std::string& fmi_name, const std::string& input_name, double value);
+	void recordInput(const std::string& fmi_name, const std::string& input_name, int value);
+	void recordInput(const std::string& fmi_name, const std::string& input_name, const std::string& value);
+	void recordInput(const std::string& fmi_name, const std::string& input_name, const std::vector<double>& values);
 
 
 public:
 	MasterFMI(const double stepSize);
 	~MasterFMI();
 	void addFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput);
+	void addFMUCS(FMUCoSimulationBase* model, std::string fmu_name, bool iterateAfterInput);
+	void addRemoteFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput);
+	void addRemoteFMUCS(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name, bool iterateAfterInput);
+	MasterFMI* addFMUGroup(std::string group_name, double communication_step, bool parallel);
 	void update_actions_state(double now, double delta) override;
-	double getRealOutput(std::string fmi_name, std::string output_name, bool checkPort=false);
-	bool getBooleanOutput(std::string fmi_name, std::string output_name, bool checkPort=false);
-	int getIntegerOutput(std::string fmi_name, std::string output_name, bool checkPort=false);
-	std::string getStringOutput(std::string fmi_name, std::string output_name, bool checkPort=false);
-	void setRealInput(std::string fmi_name, std::string input_name, double value, bool simgrid_input);
-	void setBooleanInput(std::string fmi_name, std::string input_name, bool value, bool simgrid_input);
-	void setIntegerInput(std::string fmi_name, std::string input_name, int value, bool simgrid_input);
-	void setStringInput(std::string fmi_name, std::string input_name, std::string value, bool simgrid_input);
+	void enableLazyMode(bool enable, double max_step);
+	void setInterpolation(std::string fmi_name, std::string output_name, int order);
+	void accumulateOutput(const std::string& fmi_name, const std::string& output_name, double threshold,
+			std::size_t histogram_bins, double histogram_min, double histogram_max);
+	port_accumulator getAccumulator(const std::string& fmi_name, const std::string& output_name);
+	void writeAccumulators(std::string file_path);
+	void enableSpeculation(bool enable);
+	void setStepRetry(int max_depth);
+	bool isLagging();
+	void catchUp();
+	double getRealOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort=false);
+	bool getBooleanOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort=false);
+	int getIntegerOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort=false);
+	std::string getStringOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort=false);
+	std::vector<double> getRealArrayOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort=false);
+	port_handle getPortHandle(std::string fmi_name, std::string port_name, FMIVariableType type);
+	double getRealOutput(const port_handle& handle);
+	bool getBooleanOutput(const port_handle& handle);
+	int getIntegerOutput(const port_handle& handle);
+	std::string getStringOutput(const port_handle& handle);
+	void setRealInput(const port_handle& handle, double value);
+	void setBooleanInput(const port_handle& handle, bool value);
+	void setIntegerInput(const port_handle& handle, int value);
+	void setStringInput(const port_handle& handle, const std::string& value);
+	void commitInputs(const InputTransaction& transaction);
+	void setRealArrayInput(const std::string& fmi_name, const std::string& input_name, const std::vector<double>& values, bool simgrid_input);
+	void setRealInput(const std::string& fmi_name, const std::string& input_name, double value, bool simgrid_input);
+	void setBooleanInput(const std::string& fmi_name, const std::string& input_name, bool value, bool simgrid_input);
+	void setIntegerInput(const std::string& fmi_name, const std::string& input_name, int value, bool simgrid_input);
+	void setStringInput(const std::string& fmi_name, const std::string& input_name, const std::string& value, bool simgrid_input);
 	double next_occuring_event(double now) override;
-	void registerEvent(bool (*condition)(std::vector<std::string>), void (*handleEvent)(std::vector<std::string>), std::vector<std::string> params);
+	void registerEvent(std::function<bool(const std::vector<std::string>&)> condition, std::function<void(const std::vector<std::string>&)> handleEvent, std::vector<std::string> params);
 	void deleteEvents();
+	std::shared_ptr<fmu_wait> addWait(std::function<bool()> condition);
+	std::shared_ptr<fmu_wait> addWait(const std::string& fmi_name, const std::string& output_name, port_comparison comparison, double value);
+	void removeWait(const std::shared_ptr<fmu_wait>& wait);
 	void connectFMU(std::string out_fmu_name,std::string output_port,std::string in_fmu_name,std::string input_port);
-	void connectRealFMUToSimgrid(double (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	void connectIntegerFMUToSimgrid(int (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	void connectBooleanFMUToSimgrid(bool (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	void connectStringFMUToSimgrid(std::string (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	void connectFMUs(std::vector<port> outputs, fan_in_operation operation, std::string in_fmu_name, std::string input_port, coupling_transform transform);
+	void connectRealFMUToSimgrid(std::function<double(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	void connectIntegerFMUToSimgrid(std::function<int(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	void connectBooleanFMUToSimgrid(std::function<bool(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	void connectStringFMUToSimgrid(std::function<std::string(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	void connectHostGroupPowerToFMU(std::vector<simgrid::s4u::Host*> hosts, std::string fmu_name, std::string input_name);
+	void bindFMUOutput(std::string fmu_name, std::string output_name, resource_binding binding);
+	void addSnapshotPorts(std::vector<port> ports);
+	SurrogateModel* tabulateFMU(std::string fmu_name, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs, double settle_time);
+	void replaceFMU(std::string fmu_name, FMUCoSimulationBase* model);
+	bool hasSnapshot();
+	bool readSnapshot(std::size_t slot, double* value);
+	bool readSnapshot(const std::string& fmi_name, const std::string& output_name, double* value);
 	void initCouplings();
+	void resetSimulation(fmu_parameters parameters, std::string output_file_path);
 	void configureOutputLog(std::string output_file_path, std::vector<port> ports_to_monitor);
-
+	void closeOutputLog();
+	void startRecording(std::string trace_path);
+	void stopRecording();
+	void replay(std::string trace_path, std::string output_file_path);
+	void enableTelemetry(std::string file_path, std::vector<port> ports, std::size_t capacity);
+	void disableTelemetry();
+	bool hasRemoteFMUs();
+	void enableStatistics(bool enable);
+	fmi_statistics getStatistics();
+	void resetStatistics();
+	void printStatistics();
 
 };
 
 
+/**
+ * Set of input changes applied at once by commit(), in a single simcall: each FMU receives
+ * its new values in one batched set per type and performs at most one zero-length iteration,
+ * then the couplings and the events are solved once.
+ *
+ * FMIPlugin::inputs().set(a, 1.0).set(b, 2).commit();
+ */
+class InputTransaction{
+
+public:
+	InputTransaction& set(const PortHandle<double>& port, double value);
+	InputTransaction& set(const PortHandle<int>& port, int value);
+	InputTransaction& set(const PortHandle<bool>& port, bool value);
+	InputTransaction& set(const PortHandle<std::string>& port, std::string value);
+	InputTransaction& setReal(std::string fmi_name, std::string input_name, double value);
+	InputTransaction& setInteger(std::string fmi_name, std::string input_name, int value);
+	InputTransaction& setBoolean(std::string fmi_name, std::string input_name, bool value);
+	InputTransaction& setString(std::string fmi_name, std::string input_name, std::string value);
+	void commit();
+
+private:
+	friend class MasterFMI;
+	std::vector<std::pair<port_handle,double>> reals;
+	std::vector<std::pair<port_handle,int>> integers;
+	std::vector<std::pair<port_handle,bool>> booleans;
+	std::vector<std::pair<port_handle,std::string>> strings;
+};
+
 class FMIPlugin {
 
 public:
+	/*
+	 * keep unpacked FMU archives and indexes of the model descriptions in directory, across simulations.
+	 * It must be set before adding FMUs given as .fmu archives, which are unpacked there (with unzip).
+	 */
+	static void setCacheDirectory(std::string directory);
 	static void addFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput=true);
+	/*
+	 * add a co-simulation model which is already built in memory (e.g. a synthetic FMU).
+	 * The model is instantiated and initialized by the plugin and must outlive the simulation.
+	 */
+	static void addFMUCS(FMUCoSimulationBase* model, std::string fmu_name, bool iterateAfterInput=true);
+	/*
+	 * run the FMU in a separate worker process: a crash of the FMU does not kill the simulation
+	 * (the worker is restarted) and the workers perform their doSteps in parallel.
+	 * The factory version builds the model in the worker (e.g. a native model).
+	 */
+	static void addRemoteFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput=true);
+	static void addRemoteFMUCS(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name, bool iterateAfterInput=true);
+	/*
+	 * hierarchical co-simulation: add a group of FMUs (e.g. the physical systems of a datacenter) with its own
+	 * master, i.e. its own communication step, couplings, events, SimGrid inputs and output log, configured
+	 * through the returned master before readyForSimulation. The top-level master sees the group as one FMU
+	 * whose ports are those of the FMUs of the group, named "fmu.port", and couples the groups at its own
+	 * (coarser) communication step. At each step of the top-level master, the group is advanced with its own
+	 * step and its couplings are solved between two of its steps, in a thread if parallel is true (the groups
+	 * are then stepped at the same time); its SimGrid side (SimGrid inputs, events, resource bindings) is handled
+	 * at the end of the step. The netzone version names the group after the netzone.
+	 */
+	static MasterFMI* addFMUGroup(std::string group_name, double communication_step, bool parallel=true);
+	static MasterFMI* addFMUGroup(simgrid::s4u::NetZone* netzone, double communication_step, bool parallel=true);
 	static void connectFMU(std::string out_fmu_name,std::string output_port,std::string in_fmu_name,std::string input_port);
+	/*
+	 * couple an output (real or integer) to a real input through a transform, e.g. coupling_transform(1e-3)
+	 * for W to kW, or the sum, mean, maximum or minimum of several outputs (fan-in), e.g. the heat of
+	 * the racks of a room. These couplings are solved with the others, without helper FMU or callback.
+	 */
+	static void connectFMU(std::string out_fmu_name,std::string output_port,std::string in_fmu_name,std::string input_port, coupling_transform transform);
+	static void connectFMUs(std::vector<port> outputs, fan_in_operation operation, std::string in_fmu_name, std::string input_port,
+			coupling_transform transform=coupling_transform());
 	static void initFMIPlugin(double communication_step);
 	static double getRealOutput(std::string fmi_name, std::string output_name);
 	static bool getBooleanOutput(std::string fmi_name, std::string output_name);
 	static int getIntegerOutput(std::string fmi_name, std::string output_name);
 	static std::string getStringOutput(std::string fmi_name, std::string output_name);
+	/*
+	 * resolve a port once (FMU, variable and type are checked here), then read or write it
+	 * without any name lookup. Handles of inputs must be created once the couplings are declared.
+	 */
+	template<typename T> static PortHandle<T> getPort(std::string fmi_name, std::string port_name);
+	static double get(const PortHandle<double>& port);
+	static int get(const PortHandle<int>& port);
+	static bool get(const PortHandle<bool>& port);
+	static std::string get(const PortHandle<std::string>& port);
+	static void set(const PortHandle<double>& port, double value);
+	static void set(const PortHandle<int>& port, int value);
+	static void set(const PortHandle<bool>& port, bool value);
+	static void set(const PortHandle<std::string>& port, std::string value);
+	/*
+	 * whole array variables of FMI 3.0 FMUs (their elements are also available as scalars named name[1], name[2]...)
+	 */
+	static std::vector<double> getRealArrayOutput(std::string fmi_name, std::string output_name);
+	static void setRealArrayInput(std::string fmi_name, std::string input_name, std::vector<double> values);
 	static void setRealInput(std::string fmi_name, std::string input_name, double value);
 	static void setBooleanInput(std::string fmi_name, std::string input_name, bool value);
 	static void setIntegerInput(std::string fmi_name, std::string input_name, int value);
 	static void setStringInput(std::string fmi_name, std::string input_name, std::string value);
-	static void registerEvent(bool (*condition)(std::vector<std::string>), void (*handleEvent)(std::vector<std::string>), std::vector<std::string> params);
+	/*
+	 * start a transaction to set several inputs at once (see InputTransaction)
+	 */
+	static InputTransaction inputs();
+	static void commitInputs(const InputTransaction& transaction);
+	/*
+	 * the callbacks of the events and of the SimGrid inputs receive their parameters by reference
+	 * (callbacks taking them by value are still accepted, but copy them at each call)
+	 */
+	static void registerEvent(std::function<bool(const std::vector<std::string>&)> condition, std::function<void(const std::vector<std::string>&)> handleEvent, std::vector<std::string> params);
 	static void deleteEvents();
-	static void connectRealFMUToSimgrid(double (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	static void connectIntegerFMUToSimgrid(int (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	static void connectBooleanFMUToSimgrid(bool (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
-	static void connectStringFMUToSimgrid(std::string (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	/*
+	 * block the calling actor until the condition holds (waitUntil) or until an output (real, integer or
+	 * boolean) compares to value (waitFor), or for at most timeout seconds if timeout is not negative.
+	 * Return false on timeout, or when the simulation is reset meanwhile. The condition is checked at once, then after each update, like the
+	 * conditions of the events. The actors waiting on the same output share one read of the output per
+	 * update, and those waiting for the same comparison share one condition variable.
+	 */
+	static bool waitUntil(std::function<bool()> condition, double timeout=-1);
+	static bool waitFor(std::string fmi_name, std::string output_name, port_comparison comparison, double value, double timeout=-1);
+	static void connectRealFMUToSimgrid(std::function<double(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	static void connectIntegerFMUToSimgrid(std::function<int(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	static void connectBooleanFMUToSimgrid(std::function<bool(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	static void connectStringFMUToSimgrid(std::function<std::string(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name);
+	/*
+	 * feed a real input with the total power consumption (in W) of a group of hosts, or of all the hosts
+	 * of a netzone, as given by the SimGrid energy plugin (sg_host_energy_plugin_init must be called).
+	 * The hosts are resolved once and the total is updated with the hosts signaled since the last update
+	 * (an execution started or completed, the pstate or the state changed); the input is only set when
+	 * the total changes.
+	 */
+	static void connectHostGroupPowerToFMU(std::vector<simgrid::s4u::Host*> hosts, std::string fmu_name, std::string input_name);
+	static void connectHostGroupPowerToFMU(simgrid::s4u::NetZone* netzone, std::string fmu_name, std::string input_name);
+	/*
+	 * let an FMU output (real, integer or boolean) drive a SimGrid resource. The master applies the
+	 * binding at the end of each update, when the output changed, through the optional mapping:
+	 * - HostPstate: the (rounded) value is the pstate of the host;
+	 * - HostSpeedScale: the value is a fraction of the speed of pstate 0, and the host is set to the
+	 *   pstate whose speed is the closest one;
+	 * - HostOnOff: the host is turned off when the value is 0 (killing its actors), on otherwise;
+	 * - LinkBandwidth: the value is the bandwidth of the link (in bytes per second).
+	 */
+	static void bindFMUOutputToHostPstate(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping=nullptr);
+	static void bindFMUOutputToHostSpeedScale(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping=nullptr);
+	static void bindFMUOutputToHostOnOff(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping=nullptr);
+	static void bindFMUOutputToLinkBandwidth(std::string fmu_name, std::string output_name, simgrid::s4u::Link* link, std::function<double(double)> mapping=nullptr);
+	/*
+	 * publish real, integer and boolean outputs in a snapshot, so that actors can read them without
+	 * touching the FMUs, e.g. when SimGrid runs them in parallel (contexts/nthreads). The snapshot is
+	 * double-buffered and published at the end of each update and after each input change, and the
+	 * getters (and the handles obtained afterwards) read it without lock nor simcall. Once a snapshot
+	 * exists, the other ports are read through a simcall, and the lazy mode is disabled.
+	 * Call it before readyForSimulation.
+	 */
+	static void publishOutputs(std::vector<port> ports);
 	static void readyForSimulation();
+	/*
+	 * start a new replication of the co-simulation at the current simulated time, without building a new
+	 * master nor unpacking the FMUs again: every FMU is reset to its start values (then the given parameters
+	 * are applied) and initialized again, the couplings are solved again and the events are deleted.
+	 * The SimGrid clock is not rewound. If output_file_path is not empty, the output log is reopened there.
+	 */
+	static void resetSimulation(fmu_parameters parameters = fmu_parameters(), std::string output_file_path = "");
 	static void configureOutputLog(std::string output_file_path, std::vector<port> ports_to_monitor);
+	/*
+	 * switch the collection of runtime statistics (doStep times, coupling sweeps, events, logging) on or off.
+	 * If print_at_end is true, the statistics are printed when the simulation ends.
+	 */
+	static void enableStatistics(bool enable, bool print_at_end=false);
+	static fmi_statistics getStatistics();
+	static void resetStatistics();
+	static void printStatistics();
+	/*
+	 * in lazy mode, the FMUs are not advanced while nothing observes them: they catch up (with steps of
+	 * at most max_step, the communication step by default) when an actor reads an output or sets an input,
+	 * when a SimGrid model coupled to an FMU input changes, or when an event is registered.
+	 * The events, waits, output log, telemetry, resource bindings and groups sample the FMUs at the
+	 * horizons, i.e. the multiples of max_step: the FMUs catch up to each horizon reached by the SimGrid
+	 * clock, the output log gets a row at each of their steps, and the events and waits are checked there
+	 * instead of at every communication step. The snapshot of publishOutputs disables the lazy mode.
+	 */
+	static void enableLazyMode(bool enable, double max_step=-1);
+	/*
+	 * interpolate a real output between the communication points with a polynomial of the given order
+	 * (built on the values of the last order+1 points, 0 to stop interpolating the port). As soon as one
+	 * port is interpolated, the FMUs are stepped on the communication grid (i.e. up to the first multiple
+	 * of the communication step after the SimGrid clock), and actors reading an interpolated port get
+	 * its value at the exact SimGrid clock. The other ports return their value at the grid point.
+	 * The FMUs being ahead, the inputs set by actors between two grid points are deferred to the next
+	 * one, like the inputs coupled to SimGrid models (they are counted in the statistics).
+	 */
+	static void setInterpolation(std::string fmi_name, std::string output_name, int order=1);
+	/*
+	 * keep online statistics of an output (real, integer or boolean) instead of logging it: integral,
+	 * minimum and maximum with their time, mean and variance, time above the threshold and histogram
+	 * of histogram_bins bins over [histogram_min,histogram_max] (values out of the range count in the
+	 * first or last bin). They are updated at each step and restart at each call and at each reset.
+	 * writeAccumulators writes them as CSV (one line per port), now or at the end of the simulation.
+	 */
+	static void accumulateOutput(std::string fmi_name, std::string output_name, double threshold=std::numeric_limits<double>::infinity(),
+			std::size_t histogram_bins=0, double histogram_min=0, double histogram_max=0);
+	static port_accumulator getAccumulator(std::string fmi_name, std::string output_name);
+	static void writeAccumulators(std::string file_path, bool at_end=false);
+	/*
+	 * speculative stepping: once the FMUs are updated, a background thread saves their state and
+	 * computes the next communication step with the current inputs, while SimGrid resolves its own
+	 * models. The result is kept if the next update starts with a full communication step and nothing
+	 * touched the FMUs in between (reads included); otherwise the FMUs are rolled back. Every FMU
+	 * must be able to save its state (see StatefulModel), and no FMU can be added once it is enabled.
+	 * Hits and misses are in the statistics.
+	 */
+	static void enableSpeculation(bool enable);
+	/*
+	 * recover from discarded steps: an FMI 3.0 FMU returning fmiDiscard resumes from the last successful
+	 * time it reports. Otherwise, a model that can save its state (see StatefulModel: FMI 3.0 FMUs
+	 * declaring canGetAndSetFMUState and the native models that opt in) is rolled back and steps again
+	 * with two half steps, its inputs being held. Steps are split at most max_depth times before the
+	 * simulation stops (0, the default, stops on the first discard). The FMI 1.0/2.0 FMUs loaded by
+	 * fmipp and the FMU workers can not be retried: a warning names them, and the simulation stops on
+	 * their first discard. Warnings of the FMUs are logged and accepted.
+	 */
+	static void setStepRetry(int max_depth);
+	/*
+	 * run nb_variants variants of the simulation, each one in a child process forked once the platform,
+	 * the FMUs and the couplings are ready (call it after readyForSimulation instead of Engine::run).
+	 * Each child calls setup_variant(i) to apply its own parameters, create its actors and configure its
+	 * output log (the log of the driver is closed before forking), then runs the simulation. Parameters of
+	 * the FMUs can only be set before their initialization: setup_variant applies them with resetSimulation
+	 * (which can also reopen the output log), while inputs can be set directly. At most max_jobs children run
+	 * at the same time (one per core by default), and the summary of every variant is written in the CSV
+	 * file result_file.
+	 */
+	static void runEnsemble(int nb_variants, std::function<void(int)> setup_variant, std::string result_file, int max_jobs=0);
+	/*
+	 * surrogate models (see SurrogateModel): tabulateFMU samples an FMU already added with the communication
+	 * step (its state is restored afterwards), and replaceFMU puts a model with the same ports in place of an
+	 * FMU, keeping its couplings, bindings and monitored ports. Call replaceFMU before readyForSimulation
+	 * and recordInputs, and get the handles of the FMU afterwards. The replaced FMU is deleted if it was
+	 * loaded by the plugin.
+	 */
+	static SurrogateModel* tabulateFMU(std::string fmu_name, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs, double settle_time);
+	static void replaceFMU(std::string fmu_name, FMUCoSimulationBase* model);
+	/*
+	 * record in trace_path everything that changes the FMUs during the simulation: the inputs set by the
+	 * actors and by the SimGrid models, the steps and the coupling solves. Call it once the FMUs are added
+	 * and before connecting them. The trace is closed when the simulation ends (or is reset).
+	 */
+	static void recordInputs(std::string trace_path);
+	/*
+	 * run the FMUs again with the trace recorded by recordInputs, without SimGrid models nor actors, and
+	 * write the ports monitored during the recording in output_file_path (if not empty). The outputs are
+	 * those of the recorded simulation, bit for bit, unless an FMU changed. FMUs loaded from a URI are
+	 * loaded again, while in-memory models must be added under the same names before (and not connected).
+	 * Call it instead of readyForSimulation (see also tools/replay).
+	 */
+	static void replayInputs(std::string trace_path, std::string output_file_path="");
+	/*
+	 * publish the live values of ports (reals, integers or booleans) in a memory-mapped file (e.g. in
+	 * /dev/shm) after each coupling solve, i.e. whenever a line of the output log is written. The file
+	 * keeps the last capacity rows and is read with the TelemetryReader of simgrid-fmi-telemetry.hpp
+	 * (see also tools/telemetry). The publication stops at the end of the simulation.
+	 */
+	static void enableTelemetry(std::string file_path, std::vector<port> ports, std::size_t capacity=1024);
+	static void disableTelemetry();
 private:
 	FMIPlugin();
 	~FMIPlugin();
 	static MasterFMI *master;
+	static void observe();
+	static bool block(std::shared_ptr<fmu_wait> wait, double timeout);
+	template<typename T> static T readPort(std::function<T()> read);
 };
 
+template<typename T> PortHandle<T> FMIPlugin::getPort(std::string fmi_name, std::string port_name){
+	PortHandle<T> handle;
+	static_cast<port_handle&>(handle) = master->getPortHandle(fmi_name, port_name, port_type<T>::type);
+	return handle;
+}
+
 }
 }
 
@@ -0,0 +1,181 @@
+#include "simgrid-fmi.hpp"
+#include <simgrid/simix.hpp>
+#include <simgrid/s4u/Engine.hpp>
+#include <cmath>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_accumulators, surf, "Logging specific to the output accumulators of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * port_accumulator
+ */
+
+void port_accumulator::add(double time, double value){
+
+	if(samples == 0){
+		start_time = time;
+		min = max = mean = value;
+		min_time = max_time = time;
+	}else{
+		double dt = time - last_time;
+		if(dt <= 0)
+			return;
+
+		integral += (last_value + value) / 2 * dt;
+
+		// the output is taken as linear between two samples, as for the integral
+		if(last_value > threshold && value > threshold)
+			time_above += dt;
+		else if(last_value > threshold || value > threshold)
+			time_above += dt * (std::max(last_value, value) - threshold) / std::abs(value - last_value);
+
+		if(value < min){
+			min = value;
+			min_time = time;
+		}
+		if(value > max){
+			max = value;
+			max_time = time;
+		}
+
+		// Welford's algorithm, each value being weighted by the length of the step it ends
+		double delta = value - mean;
+		mean += delta * dt / (time - start_time);
+		m2 += dt * delta * (value - mean);
+	}
+
+	if(!histogram.empty()){
+		// values out of the range are counted in the first or the last bin
+		double position = (value - histogram_min) / (histogram_max - histogram_min) * histogram.size();
+		std::size_t bin = !(position > 0) ? 0 : std::min((std::size_t) position, histogram.size() - 1);
+		histogram[bin]++;
+	}
+
+	samples++;
+	last_time = time;
+	last_value = value;
+}
+
+void port_accumulator::clear(){
+	samples = 0;
+	start_time = last_time = last_value = 0;
+	integral = 0;
+	min = max = min_time = max_time = 0;
+	mean = m2 = 0;
+	time_above = 0;
+	std::fill(histogram.begin(), histogram.end(), 0);
+}
+
+
+/**
+ * FMIPlugin
+ */
+
+void FMIPlugin::accumulateOutput(std::string fmi_name, std::string output_name, double threshold,
+		std::size_t histogram_bins, double histogram_min, double histogram_max){
+	simgrid::simix::simcall([fmi_name,output_name,threshold,histogram_bins,histogram_min,histogram_max]() {
+		master->accumulateOutput(fmi_name, output_name, threshold, histogram_bins, histogram_min, histogram_max);
+	});
+}
+
+port_accumulator FMIPlugin::getAccumulator(std::string fmi_name, std::string output_name){
+	// the accumulators are updated by maestro
+	return simgrid::simix::simcall([&fmi_name,&output_name]() {
+		return master->getAccumulator(fmi_name, output_name);
+	});
+}
+
+void FMIPlugin::writeAccumulators(std::string file_path, bool at_end){
+	if(!at_end){
+		simgrid::simix::simcall([file_path]() {
+			master->writeAccumulators(file_path);
+		});
+		return;
+	}
+	simgrid::s4u::on_simulation_end.connect([file_path]() {
+		master->writeAccumulators(file_path);
+	});
+}
+
+
+/**
+ * MasterFMI
+ */
+
+void MasterFMI::accumulateOutput(const std::string& fmi_name, const std::string& output_name, double threshold,
+		std::size_t histogram_bins, double histogram_min, double histogram_max){
+
+	settle();
+	catchUp();
+	checkPortValidity(fmi_name, output_name, FMIVariableType::fmiTypeUnknown, false);
+	FMIVariableType type = fmus[fmi_name]->getType(output_name);
+	if(type == FMIVariableType::fmiTypeString || getArraySize(fmi_name, output_name) > 0)
+		xbt_die("can not accumulate port %s of FMU %s: it is neither a real, an integer nor a boolean",output_name.c_str(),fmi_name.c_str());
+	if(histogram_bins > 0 && !(histogram_max > histogram_min))
+		xbt_die("empty histogram range [%f,%f] for port %s of FMU %s",histogram_min,histogram_max,output_name.c_str(),fmi_name.c_str());
+
+	port p = {fmi_name, output_name};
+	auto it = accumulator_indexes.find(p);
+	if(it == accumulator_indexes.end()){
+		it = accumulator_indexes.insert({p, accumulators.size()}).first;
+		accumulated_ports.push_back(getPortHandle(fmi_name, output_name, type));
+		accumulators.push_back(port_accumulator());
+	}
+
+	port_accumulator& accumulator = accumulators[it->second];
+	accumulator.threshold = threshold;
+	accumulator.histogram_min = histogram_min;
+	accumulator.histogram_max = histogram_max;
+	accumulator.histogram.assign(histogram_bins, 0);
+	accumulator.clear();
+
+	// before readyForSimulation, the first sample is taken by initCouplings
+	if(ready_for_simulation)
+		accumulator.add(current_time, readNumericOutput(accumulated_ports[it->second]));
+}
+
+port_accumulator MasterFMI::getAccumulator(const std::string& fmi_name, const std::string& output_name){
+	settle();
+	catchUp();
+	auto it = accumulator_indexes.find({fmi_name, output_name});
+	if(it == accumulator_indexes.end())
+		xbt_die("port %s of FMU %s is not accumulated (see FMIPlugin::accumulateOutput)",output_name.c_str(),fmi_name.c_str());
+	return accumulators[it->second];
+}
+
+/**
+ * add the current value of the accumulated outputs (at the end of each step)
+ */
+void MasterFMI::accumulateOutputs(){
+	for(std::size_t i = 0; i < accumulators.size(); i++)
+		accumulators[i].add(current_time, readNumericOutput(accumulated_ports[i]));
+}
+
+void MasterFMI::writeAccumulators(std::string file_path){
+
+	settle();
+	catchUp();
+	std::ofstream out(file_path);
+	if(!out.is_open())
+		xbt_die("can not write the accumulators in %s",file_path.c_str());
+
+	out << "fmu;port;samples;start_time;end_time;integral;min;min_time;max;max_time;mean;variance;threshold;time_above;histogram\n";
+	for(std::size_t i = 0; i < accumulators.size(); i++){
+		const port& p = accumulated_ports[i].p;
+		const port_accumulator& a = accumulators[i];
+		out << p.fmu << ";" << p.name << ";" << a.samples << ";" << a.start_time << ";" << a.last_time << ";" << a.integral
+				<< ";" << a.min << ";" << a.min_time << ";" << a.max << ";" << a.max_time << ";" << a.mean << ";" << a.variance()
+				<< ";" << a.threshold << ";" << a.time_above << ";";
+		// histogram bins are space-separated, like the elements of arrays in the output log
+		for(std::size_t b = 0; b < a.histogram.size(); b++)
+			out << (b == 0 ? "" : " ") << a.histogram[b];
+		out << "\n";
+	}
+	XBT_INFO("%zu accumulators written in %s",accumulators.size(),file_path.c_str());
+}
+
+}
+}
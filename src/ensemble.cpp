@@ -0,0 +1,113 @@
+#include "simgrid-fmi.hpp"
+#include <simgrid/s4u.hpp>
+#include <simgrid/s4u/Engine.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_ensemble, surf, "Logging specific to the ensembles of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * simulate one variant in a child process and store its summary in result
+ */
+static void runVariant(MasterFMI* master, int variant, std::function<void(int)> setup_variant, ensemble_result* result){
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	master->resetStatistics();
+	master->enableStatistics(true);
+	setup_variant(variant);
+	simgrid::s4u::Engine::get_instance()->run();
+
+	fmi_statistics stats = master->getStatistics();
+	result->simulated_time = simgrid::s4u::Engine::get_clock();
+	result->steps = stats.steps;
+	for(auto it : stats.fmus)
+		result->doSteps += it.second.steps + it.second.zero_steps;
+	result->coupling_solves = stats.coupling_solves;
+	result->coupling_sweeps = stats.coupling_sweeps;
+	result->events_fired = stats.events_fired;
+	result->wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result->done = true;
+
+	master->closeOutputLog();
+	std::fflush(stdout);
+	std::fflush(stderr);
+}
+
+void FMIPlugin::runEnsemble(int nb_variants, std::function<void(int)> setup_variant, std::string result_file, int max_jobs){
+
+	// the children would share the workers of the driver
+	if(master->hasRemoteFMUs())
+		xbt_die("FMUs running in a worker process can not be used in an ensemble");
+
+	if(max_jobs <= 0)
+		max_jobs = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+	// the children write their summary in a shared array, read by the driver once they exit
+	std::size_t results_size = std::max(1, nb_variants) * sizeof(ensemble_result);
+	void* shared = mmap(nullptr, results_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+		xbt_die("can not allocate the shared memory of the ensemble");
+	ensemble_result* results = static_cast<ensemble_result*>(shared);
+	for(int i = 0; i < nb_variants; i++){
+		results[i] = ensemble_result();
+		results[i].variant = i;
+	}
+
+	master->closeOutputLog();
+	std::fflush(stdout);
+	std::fflush(stderr);
+
+	std::unordered_map<pid_t,int> running;
+	int next = 0;
+	while(next < nb_variants || !running.empty()){
+
+		while(next < nb_variants && (int) running.size() < max_jobs){
+			pid_t child = fork();
+			if(child < 0)
+				xbt_die("can not fork the process of variant %d of the ensemble",next);
+			if(child == 0){
+				runVariant(master, next, setup_variant, &results[next]);
+				_exit(0);
+			}
+			XBT_DEBUG("variant %d started in process %d",next,(int) child);
+			running[child] = next;
+			next++;
+		}
+
+		int status;
+		pid_t child = waitpid(-1, &status, 0);
+		if(child < 0)
+			break;
+		auto it = running.find(child);
+		if(it == running.end())
+			continue;
+		results[it->second].exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		if(!results[it->second].done || results[it->second].exit_status != 0)
+			XBT_WARN("variant %d of the ensemble failed (exit status %d)",it->second,results[it->second].exit_status);
+		running.erase(it);
+	}
+
+	std::ofstream out(result_file, std::ios::out);
+	out << "variant,exit_status,simulated_time,wall_time,steps,doSteps,coupling_solves,coupling_sweeps,events_fired" << std::endl;
+	for(int i = 0; i < nb_variants; i++){
+		ensemble_result &r = results[i];
+		out << r.variant << "," << r.exit_status << "," << r.simulated_time << "," << r.wall_time << ","
+				<< r.steps << "," << r.doSteps << "," << r.coupling_solves << "," << r.coupling_sweeps << ","
+				<< r.events_fired << std::endl;
+	}
+	out.close();
+
+	munmap(shared, results_size);
+}
+
+}
+}
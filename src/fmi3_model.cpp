@@ -0,0 +1,807 @@
+#include "fmi3_model.hpp"
+#include "fmu_cache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <dlfcn.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi3, surf, "Logging specific to the FMI 3.0 models of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+static void fmi3Logger(fmi3InstanceEnvironment env, fmi3Status status, fmi3String category, fmi3String message){
+	XBT_DEBUG("[%s] %s", category == nullptr ? "" : category, message == nullptr ? "" : message);
+}
+
+
+/**
+ * FMU3CoSimulation
+ */
+
+FMU3CoSimulation::FMU3CoSimulation(std::string fmu_uri, std::string fmu_name)
+: FMUCoSimulationBase(false){
+
+	fmu_path = uriToPath(fmu_uri);
+	has_event_mode = false;
+	can_save_state = false;
+	state_restores = false;
+	library = nullptr;
+	instance = nullptr;
+	time = 0;
+	last_status = fmiOK;
+
+	parseModelDescription();
+	loadLibrary();
+}
+
+FMU3CoSimulation::~FMU3CoSimulation(){
+	if(instance != nullptr){
+		fmi3Terminate(instance);
+		fmi3FreeInstance(instance);
+	}
+	if(library != nullptr)
+		dlclose(library);
+}
+
+bool FMU3CoSimulation::isFMI3(std::string fmu_uri){
+
+	std::string description_path = uriToPath(fmu_uri) + "/modelDescription.xml";
+	int fmi_version;
+	if(FMUCache::loadDescription(description_path, &fmi_version, nullptr))
+		return fmi_version == 3;
+
+	boost::property_tree::ptree description;
+	try{
+		boost::property_tree::read_xml(description_path, description);
+	}catch(boost::property_tree::xml_parser_error&){
+		return false;
+	}
+	std::string version = description.get<std::string>("fmiModelDescription.<xmlattr>.fmiVersion", "");
+	// the variables of an FMI 3.0 description are indexed when the FMU is built
+	if(version.compare(0, 2, "3.") == 0)
+		return true;
+	FMUCache::storeDescription(description_path, version.compare(0, 2, "1.") == 0 ? 1 : 2, nullptr);
+	return false;
+}
+
+void FMU3CoSimulation::parseModelDescription(){
+
+	std::string description_path = fmu_path + "/modelDescription.xml";
+	fmi3_description description;
+	int fmi_version;
+	if(!FMUCache::loadDescription(description_path, &fmi_version, &description) || fmi_version != 3){
+		description = fmi3_description();
+		readModelDescription(description_path, description);
+		FMUCache::storeDescription(description_path, 3, &description);
+	}
+
+	model_identifier = description.model_identifier;
+	instantiation_token = description.instantiation_token;
+	has_event_mode = description.has_event_mode;
+	can_save_state = description.can_save_state;
+	variables = std::move(description.variables);
+
+	for(std::size_t v = 0; v < variables.size(); v++){
+		const fmi3_variable& var = variables[v];
+		names[var.name] = std::make_pair(v, -1L);
+		if(var.size != 1){
+			for(std::size_t i = 0; i < var.size; i++)
+				names[var.name + "[" + std::to_string(i + 1) + "]"] = std::make_pair(v, (long) i);
+		}
+
+		if(var.clock && !var.input){
+			output_clocks.push_back(var.vr);
+			output_clock_ticks.push_back(false);
+		}
+		// input clocks can only be activated in event mode
+		if(var.clock && var.input && !has_event_mode)
+			xbt_die("FMU %s has the input clock %s but no event mode: its clocks can not be activated",fmu_path.c_str(),var.name.c_str());
+	}
+}
+
+/**
+ * parse the XML model description at description_path
+ */
+void FMU3CoSimulation::readModelDescription(const std::string& description_path, fmi3_description& description){
+
+	boost::property_tree::ptree tree;
+	try{
+		boost::property_tree::read_xml(description_path, tree);
+	}catch(boost::property_tree::xml_parser_error& e){
+		xbt_die("can not read the model description of FMU %s: %s",fmu_path.c_str(),e.what());
+	}
+
+	boost::property_tree::ptree& root = tree.get_child("fmiModelDescription");
+	description.instantiation_token = root.get<std::string>("<xmlattr>.instantiationToken", "");
+
+	boost::optional<boost::property_tree::ptree&> cs = root.get_child_optional("CoSimulation");
+	if(!cs)
+		xbt_die("FMU %s does not support co-simulation",fmu_path.c_str());
+	description.model_identifier = cs->get<std::string>("<xmlattr>.modelIdentifier");
+	description.has_event_mode = cs->get<std::string>("<xmlattr>.hasEventMode", "false") == "true";
+	description.can_save_state = cs->get<std::string>("<xmlattr>.canGetAndSetFMUState", "false") == "true";
+
+	// structural parameters giving the size of arrays, by value reference
+	std::unordered_map<fmi3ValueReference,std::size_t> structural_sizes;
+	for(auto& v : root.get_child("ModelVariables")){
+		if(v.second.get<std::string>("<xmlattr>.causality", "") == "structuralParameter")
+			structural_sizes[v.second.get<fmi3ValueReference>("<xmlattr>.valueReference")] = v.second.get<std::size_t>("<xmlattr>.start", 0);
+	}
+
+	for(auto& v : root.get_child("ModelVariables")){
+
+		fmi3_variable var;
+		var.name = v.second.get<std::string>("<xmlattr>.name");
+		var.vr = v.second.get<fmi3ValueReference>("<xmlattr>.valueReference");
+		var.input = v.second.get<std::string>("<xmlattr>.causality", "local") == "input";
+		var.clock = false;
+		var.size = 1;
+
+		if(v.first == "Float64"){
+			var.type = FMIVariableType::fmiTypeReal;
+		}else if(v.first == "Int32"){
+			var.type = FMIVariableType::fmiTypeInteger;
+		}else if(v.first == "Boolean"){
+			var.type = FMIVariableType::fmiTypeBoolean;
+		}else if(v.first == "String"){
+			var.type = FMIVariableType::fmiTypeString;
+		}else if(v.first == "Clock"){
+			var.type = FMIVariableType::fmiTypeBoolean;
+			var.clock = true;
+		}else{
+			if(v.first != "<xmlcomment>")
+				XBT_DEBUG("variable %s of FMU %s has the unsupported type %s and is ignored",var.name.c_str(),fmu_path.c_str(),v.first.c_str());
+			continue;
+		}
+
+		for(auto& d : v.second){
+			if(d.first != "Dimension")
+				continue;
+			boost::optional<std::size_t> start = d.second.get_optional<std::size_t>("<xmlattr>.start");
+			if(start)
+				var.size *= *start;
+			else
+				var.size *= structural_sizes[d.second.get<fmi3ValueReference>("<xmlattr>.valueReference")];
+		}
+
+		if(var.size != 1 && var.type != FMIVariableType::fmiTypeReal){
+			XBT_DEBUG("array variable %s of FMU %s is not a Float64 array and is ignored",var.name.c_str(),fmu_path.c_str());
+			continue;
+		}
+
+		description.variables.push_back(var);
+	}
+}
+
+void FMU3CoSimulation::loadLibrary(){
+
+	std::string library_path = fmu_path + "/binaries/x86_64-linux/" + model_identifier + ".so";
+	library = dlopen(library_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if(library == nullptr)
+		xbt_die("can not load the binary of FMU %s: %s",fmu_path.c_str(),dlerror());
+
+#define LOAD_FMI3_FUNCTION(f) \
+	f = reinterpret_cast<f##TYPE>(dlsym(library, #f)); \
+	if(f == nullptr) \
+		xbt_die("FMU %s does not provide function %s",fmu_path.c_str(),#f);
+
+	LOAD_FMI3_FUNCTION(fmi3InstantiateCoSimulation);
+	LOAD_FMI3_FUNCTION(fmi3FreeInstance);
+	fmi3Reset = reinterpret_cast<fmi3InstanceTYPE>(dlsym(library, "fmi3Reset"));
+	LOAD_FMI3_FUNCTION(fmi3EnterInitializationMode);
+	LOAD_FMI3_FUNCTION(fmi3UpdateDiscreteStates);
+	LOAD_FMI3_FUNCTION(fmi3DoStep);
+	LOAD_FMI3_FUNCTION(fmi3GetFloat64);
+	LOAD_FMI3_FUNCTION(fmi3SetFloat64);
+	LOAD_FMI3_FUNCTION(fmi3GetInt32);
+	LOAD_FMI3_FUNCTION(fmi3SetInt32);
+	LOAD_FMI3_FUNCTION(fmi3GetBoolean);
+	LOAD_FMI3_FUNCTION(fmi3SetBoolean);
+	LOAD_FMI3_FUNCTION(fmi3GetString);
+	LOAD_FMI3_FUNCTION(fmi3SetString);
+	LOAD_FMI3_FUNCTION(fmi3GetClock);
+	LOAD_FMI3_FUNCTION(fmi3SetClock);
+#undef LOAD_FMI3_FUNCTION
+
+	fmi3ExitInitializationMode = reinterpret_cast<fmi3InstanceTYPE>(dlsym(library, "fmi3ExitInitializationMode"));
+	fmi3EnterEventMode = reinterpret_cast<fmi3InstanceTYPE>(dlsym(library, "fmi3EnterEventMode"));
+	fmi3EnterStepMode = reinterpret_cast<fmi3InstanceTYPE>(dlsym(library, "fmi3EnterStepMode"));
+	fmi3Terminate = reinterpret_cast<fmi3InstanceTYPE>(dlsym(library, "fmi3Terminate"));
+	fmi3GetFMUState = reinterpret_cast<fmi3GetFMUStateTYPE>(dlsym(library, "fmi3GetFMUState"));
+	fmi3SetFMUState = reinterpret_cast<fmi3SetFMUStateTYPE>(dlsym(library, "fmi3SetFMUState"));
+	fmi3FreeFMUState = reinterpret_cast<fmi3FreeFMUStateTYPE>(dlsym(library, "fmi3FreeFMUState"));
+	if(fmi3GetFMUState == nullptr || fmi3SetFMUState == nullptr || fmi3FreeFMUState == nullptr)
+		can_save_state = false;
+	fmi3SerializedFMUStateSize = reinterpret_cast<fmi3SerializedFMUStateSizeTYPE>(dlsym(library, "fmi3SerializedFMUStateSize"));
+	fmi3SerializeFMUState = reinterpret_cast<fmi3SerializeFMUStateTYPE>(dlsym(library, "fmi3SerializeFMUState"));
+	fmi3DeserializeFMUState = reinterpret_cast<fmi3DeserializeFMUStateTYPE>(dlsym(library, "fmi3DeserializeFMUState"));
+	if(fmi3ExitInitializationMode == nullptr || fmi3EnterEventMode == nullptr || fmi3EnterStepMode == nullptr || fmi3Terminate == nullptr || fmi3Reset == nullptr)
+		xbt_die("FMU %s does not provide the FMI 3.0 state machine functions",fmu_path.c_str());
+}
+
+fmiStatus FMU3CoSimulation::toStatus(fmi3Status status){
+	switch(status){
+		case fmi3OK:
+			return last_status = fmiOK;
+		case fmi3Warning:
+			return last_status = fmiWarning;
+		case fmi3Discard:
+			return last_status = fmiDiscard;
+		case fmi3Error:
+			return last_status = fmiError;
+		default:
+			return last_status = fmiFatal;
+	}
+}
+
+fmiStatus FMU3CoSimulation::instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive){
+	std::string resources = fmu_path + "/resources/";
+	instance = fmi3InstantiateCoSimulation(instanceName.c_str(), instantiation_token.c_str(), resources.c_str(),
+			visible != fmiFalse, false, has_event_mode, false, nullptr, 0, this, fmi3Logger, nullptr);
+	return last_status = (instance == nullptr) ? fmiError : fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::reset(){
+	pending_input_clocks.clear();
+	output_clock_ticks.assign(output_clock_ticks.size(), false);
+	time = 0;
+	return toStatus(fmi3Reset(instance));
+}
+
+/*
+ * the FMU state does not include the pending clocks nor the master time, which are saved along
+ */
+struct fmu3_state{
+	fmi3FMUState state;
+	double time;
+	std::vector<bool> output_clock_ticks;
+};
+
+bool FMU3CoSimulation::canSaveState() const{
+	return can_save_state;
+}
+
+fmiStatus FMU3CoSimulation::saveState(void** state){
+	if(*state == nullptr){
+		fmu3_state* created = new fmu3_state();
+		created->state = nullptr;
+		*state = created;
+	}
+	fmu3_state* saved = static_cast<fmu3_state*>(*state);
+	saved->time = time;
+	saved->output_clock_ticks = output_clock_ticks;
+	return toStatus(fmi3GetFMUState(instance, &saved->state));
+}
+
+fmiStatus FMU3CoSimulation::restoreState(void* state){
+	fmu3_state* saved = static_cast<fmu3_state*>(state);
+	time = saved->time;
+	output_clock_ticks = saved->output_clock_ticks;
+	return toStatus(fmi3SetFMUState(instance, saved->state));
+}
+
+/**
+ * fmi3DoStep promises the FMU that it is never set back before the current point
+ * (noSetFMUStatePriorToCurrentPoint) unless the master may restore a saved state
+ */
+void FMU3CoSimulation::allowStateRestores(bool allow){
+	state_restores = allow;
+}
+
+void FMU3CoSimulation::freeState(void* state){
+	fmu3_state* saved = static_cast<fmu3_state*>(state);
+	if(saved->state != nullptr)
+		fmi3FreeFMUState(instance, &saved->state);
+	delete saved;
+}
+
+/**
+ * a serialized state holds the time and the output clock ticks, followed by the bytes of
+ * fmi3SerializeFMUState (FMUs that do not export it can not be serialized)
+ */
+fmiStatus FMU3CoSimulation::serializeState(void* state, std::vector<char>& data){
+	fmu3_state* saved = static_cast<fmu3_state*>(state);
+	std::size_t size = 0;
+	if(fmi3SerializedFMUStateSize == nullptr || fmi3SerializeFMUState == nullptr
+			|| toStatus(fmi3SerializedFMUStateSize(instance, saved->state, &size)) > fmiWarning)
+		return last_status = fmiError;
+	const std::size_t header = sizeof(double) + saved->output_clock_ticks.size();
+	data.resize(header + size);
+	std::memcpy(data.data(), &saved->time, sizeof(double));
+	for(std::size_t i = 0; i < saved->output_clock_ticks.size(); i++)
+		data[sizeof(double) + i] = saved->output_clock_ticks[i];
+	return toStatus(fmi3SerializeFMUState(instance, saved->state, reinterpret_cast<uint8_t*>(data.data() + header), size));
+}
+
+fmiStatus FMU3CoSimulation::deserializeState(const char* data, std::size_t size, void** state){
+	const std::size_t header = sizeof(double) + output_clock_ticks.size();
+	if(fmi3DeserializeFMUState == nullptr || size < header)
+		return last_status = fmiError;
+	if(*state == nullptr){
+		fmu3_state* created = new fmu3_state();
+		created->state = nullptr;
+		*state = created;
+	}
+	fmu3_state* saved = static_cast<fmu3_state*>(*state);
+	std::memcpy(&saved->time, data, sizeof(double));
+	saved->output_clock_ticks.resize(output_clock_ticks.size());
+	for(std::size_t i = 0; i < output_clock_ticks.size(); i++)
+		saved->output_clock_ticks[i] = data[sizeof(double) + i] != 0;
+	if(saved->state != nullptr)
+		fmi3FreeFMUState(instance, &saved->state);
+	return toStatus(fmi3DeserializeFMUState(instance, reinterpret_cast<const uint8_t*>(data + header), size - header, &saved->state));
+}
+
+fmiStatus FMU3CoSimulation::initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime){
+	time = startTime;
+	fmiStatus status = toStatus(fmi3EnterInitializationMode(instance, false, 0, startTime, stopTimeDefined != fmiFalse, stopTime));
+	if(status != fmiOK)
+		return status;
+	status = toStatus(fmi3ExitInitializationMode(instance));
+	if(status != fmiOK || !has_event_mode)
+		return status;
+	// with event mode, the FMU is already in event mode after initialization
+	return handleEvents(false);
+}
+
+fmiStatus FMU3CoSimulation::handleEvents(bool enter_event_mode){
+
+	fmiStatus status;
+	if(enter_event_mode){
+		status = toStatus(fmi3EnterEventMode(instance));
+		if(status != fmiOK)
+			return status;
+	}
+
+	if(!pending_input_clocks.empty()){
+		// std::vector<bool> is not contiguous
+		std::unique_ptr<fmi3Clock[]> values(new fmi3Clock[pending_input_clocks.size()]);
+		for(std::size_t i = 0; i < pending_input_clocks.size(); i++)
+			values[i] = true;
+		status = toStatus(fmi3SetClock(instance, pending_input_clocks.data(), pending_input_clocks.size(), values.get()));
+		pending_input_clocks.clear();
+		if(status != fmiOK)
+			return status;
+	}
+
+	if(!output_clocks.empty()){
+		std::unique_ptr<fmi3Clock[]> values(new fmi3Clock[output_clocks.size()]);
+		status = toStatus(fmi3GetClock(instance, output_clocks.data(), output_clocks.size(), values.get()));
+		if(status != fmiOK)
+			return status;
+		for(std::size_t i = 0; i < output_clocks.size(); i++)
+			output_clock_ticks[i] = output_clock_ticks[i] || values[i];
+	}
+
+	fmi3Boolean need_update = true;
+	while(need_update){
+		fmi3Boolean terminate, nominals_changed, values_changed, next_event_defined;
+		fmi3Float64 next_event;
+		status = toStatus(fmi3UpdateDiscreteStates(instance, &need_update, &terminate, &nominals_changed, &values_changed, &next_event_defined, &next_event));
+		if(status != fmiOK)
+			return status;
+		if(terminate)
+			xbt_die("FMU %s requested the end of the simulation at time %f",fmu_path.c_str(),time);
+	}
+
+	return toStatus(fmi3EnterStepMode(instance));
+}
+
+fmiReal FMU3CoSimulation::getTime() const{
+	return time;
+}
+
+fmiStatus FMU3CoSimulation::doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep){
+
+	// the output clocks report the ticks of the last step only
+	if(communicationStepSize > 0)
+		std::fill(output_clock_ticks.begin(), output_clock_ticks.end(), false);
+
+	// the input clocks activated since the last step tick at its start, then the FMU steps as usual
+	fmiStatus status = fmiOK;
+	if(has_event_mode && (communicationStepSize == 0 || !pending_input_clocks.empty())){
+		status = handleEvents(true);
+		if(status != fmiOK)
+			return status;
+	}
+	if(communicationStepSize == 0)
+		return last_status = status;
+
+	fmi3Boolean event_needed = false;
+	fmi3Boolean terminate = false;
+	fmi3Boolean early_return = false;
+	fmi3Float64 last_successful_time = currentCommunicationPoint;
+	status = toStatus(fmi3DoStep(instance, currentCommunicationPoint, communicationStepSize, !state_restores,
+			&event_needed, &terminate, &early_return, &last_successful_time));
+	time = last_successful_time;
+	if(status != fmiOK)
+		return status;
+	if(terminate)
+		xbt_die("FMU %s requested the end of the simulation at time %f",fmu_path.c_str(),time);
+
+	if(event_needed && has_event_mode)
+		return handleEvents(true);
+	return status;
+}
+
+const fmi3_variable* FMU3CoSimulation::lookup(const std::string& name, long* element) const{
+	std::unordered_map<std::string,std::pair<std::size_t,long>>::const_iterator it = names.find(name);
+	if(it == names.end())
+		return nullptr;
+	*element = it->second.second;
+	return &variables[it->second.first];
+}
+
+bool FMU3CoSimulation::isArray(const std::string& name) const{
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	return var != nullptr && element < 0 && var->size != 1;
+}
+
+std::size_t FMU3CoSimulation::getArraySize(const std::string& name) const{
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	return (var == nullptr || element >= 0) ? 0 : var->size;
+}
+
+fmiStatus FMU3CoSimulation::getArray(const std::string& name, std::vector<double>& values){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr || element >= 0 || var->type != FMIVariableType::fmiTypeReal)
+		return last_status = fmiError;
+	values.resize(var->size);
+	return toStatus(fmi3GetFloat64(instance, &var->vr, 1, values.data(), values.size()));
+}
+
+fmiStatus FMU3CoSimulation::setArray(const std::string& name, const std::vector<double>& values){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr || element >= 0 || var->type != FMIVariableType::fmiTypeReal || values.size() != var->size)
+		return last_status = fmiError;
+	return toStatus(fmi3SetFloat64(instance, &var->vr, 1, values.data(), values.size()));
+}
+
+fmiStatus FMU3CoSimulation::getElement(const fmi3_variable& var, long element, double& val){
+	if(element < 0 && var.size == 1)
+		return toStatus(fmi3GetFloat64(instance, &var.vr, 1, &val, 1));
+	if(element < 0)
+		return last_status = fmiError;
+	element_buffer.resize(var.size);
+	fmiStatus status = toStatus(fmi3GetFloat64(instance, &var.vr, 1, element_buffer.data(), var.size));
+	val = element_buffer[element];
+	return status;
+}
+
+fmiStatus FMU3CoSimulation::setElement(const fmi3_variable& var, long element, double val){
+	if(element < 0 && var.size == 1)
+		return toStatus(fmi3SetFloat64(instance, &var.vr, 1, &val, 1));
+	if(element < 0)
+		return last_status = fmiError;
+	// FMI 3.0 sets arrays as a whole
+	element_buffer.resize(var.size);
+	fmiStatus status = toStatus(fmi3GetFloat64(instance, &var.vr, 1, element_buffer.data(), var.size));
+	if(status != fmiOK)
+		return status;
+	element_buffer[element] = val;
+	return toStatus(fmi3SetFloat64(instance, &var.vr, 1, element_buffer.data(), var.size));
+}
+
+/*
+ * SETTERS (booleans are also accepted as integers since fmiBoolean and fmi2Boolean are not the same type).
+ * The value reference of a variable gives it directly, without the lookup of its name.
+ */
+
+fmiStatus FMU3CoSimulation::setVariable(const fmi3_variable& var, long element, const fmiReal& val){
+	if(var.type != FMIVariableType::fmiTypeReal)
+		return last_status = fmiError;
+	return setElement(var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::setVariable(const fmi3_variable& var, long element, const fmiInteger& val){
+	if(var.type == FMIVariableType::fmiTypeBoolean)
+		return setVariable(var, element, (fmiBoolean) (val != 0 ? fmiTrue : fmiFalse));
+	if(var.type != FMIVariableType::fmiTypeInteger)
+		return last_status = fmiError;
+	fmi3Int32 v = val;
+	return toStatus(fmi3SetInt32(instance, &var.vr, 1, &v, 1));
+}
+
+fmiStatus FMU3CoSimulation::setVariable(const fmi3_variable& var, long element, const fmiBoolean& val){
+	if(var.type != FMIVariableType::fmiTypeBoolean)
+		return last_status = fmiError;
+	if(var.clock){
+		// input clocks can only be set in event mode: they are activated at the next event iteration
+		if(!var.input)
+			return last_status = fmiError;
+		if(val != fmiFalse)
+			pending_input_clocks.push_back(var.vr);
+		return last_status = fmiOK;
+	}
+	fmi3Boolean v = (val != fmiFalse);
+	return toStatus(fmi3SetBoolean(instance, &var.vr, 1, &v, 1));
+}
+
+fmiStatus FMU3CoSimulation::setVariable(const fmi3_variable& var, long element, const std::string& val){
+	if(var.type != FMIVariableType::fmiTypeString)
+		return last_status = fmiError;
+	fmi3String v = val.c_str();
+	return toStatus(fmi3SetString(instance, &var.vr, 1, &v, 1));
+}
+
+fmiStatus FMU3CoSimulation::setValue(const std::string& name, const fmiReal& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return setVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(const std::string& name, const fmiInteger& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return setVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(const std::string& name, const fmiBoolean& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return setVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(const std::string& name, const std::string& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return setVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference valref, const fmiReal& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return setVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference valref, const fmiInteger& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return setVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference valref, const fmiBoolean& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return setVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference valref, const std::string& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return setVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::setValue(fmiValueReference* valref, const std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+/*
+ * GETTERS
+ */
+
+fmiStatus FMU3CoSimulation::getVariable(const fmi3_variable& var, long element, fmiReal& val){
+	if(var.type != FMIVariableType::fmiTypeReal)
+		return last_status = fmiError;
+	return getElement(var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::getVariable(const fmi3_variable& var, long element, fmiInteger& val){
+	if(var.type == FMIVariableType::fmiTypeBoolean){
+		fmiBoolean b;
+		fmiStatus status = getVariable(var, element, b);
+		val = (b != fmiFalse) ? 1 : 0;
+		return status;
+	}
+	if(var.type != FMIVariableType::fmiTypeInteger)
+		return last_status = fmiError;
+	fmi3Int32 v;
+	fmiStatus status = toStatus(fmi3GetInt32(instance, &var.vr, 1, &v, 1));
+	val = v;
+	return status;
+}
+
+fmiStatus FMU3CoSimulation::getVariable(const fmi3_variable& var, long element, fmiBoolean& val){
+	if(var.type != FMIVariableType::fmiTypeBoolean)
+		return last_status = fmiError;
+	if(var.clock){
+		if(var.input)
+			return last_status = fmiError;
+		std::size_t i = std::find(output_clocks.begin(), output_clocks.end(), var.vr) - output_clocks.begin();
+		val = output_clock_ticks[i] ? fmiTrue : fmiFalse;
+		return last_status = fmiOK;
+	}
+	fmi3Boolean v;
+	fmiStatus status = toStatus(fmi3GetBoolean(instance, &var.vr, 1, &v, 1));
+	val = v ? fmiTrue : fmiFalse;
+	return status;
+}
+
+fmiStatus FMU3CoSimulation::getVariable(const fmi3_variable& var, long element, std::string& val){
+	if(var.type != FMIVariableType::fmiTypeString)
+		return last_status = fmiError;
+	fmi3String v = nullptr;
+	fmiStatus status = toStatus(fmi3GetString(instance, &var.vr, 1, &v, 1));
+	val = (v == nullptr) ? "" : v;
+	return status;
+}
+
+fmiStatus FMU3CoSimulation::getValue(const std::string& name, fmiReal& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return getVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(const std::string& name, fmiInteger& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return getVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(const std::string& name, fmiBoolean& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return getVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(const std::string& name, std::string& val){
+	long element;
+	const fmi3_variable* var = lookup(name, &element);
+	if(var == nullptr)
+		return last_status = fmiError;
+	return getVariable(*var, element, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference valref, fmiReal& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return getVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference valref, fmiInteger& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return getVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference valref, fmiBoolean& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return getVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference valref, std::string& val){
+	if(valref >= variables.size())
+		return last_status = fmiError;
+	return getVariable(variables[valref], -1, val);
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMU3CoSimulation::getValue(fmiValueReference* valref, std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+/*
+ * MODEL DESCRIPTION
+ */
+
+fmiValueReference FMU3CoSimulation::getValueRef(const std::string& name) const{
+	std::unordered_map<std::string,std::pair<std::size_t,long>>::const_iterator it = names.find(name);
+	if(it == names.end() || it->second.second >= 0)
+		return fmiValueReference(-1);
+	return it->second.first;
+}
+
+FMIVariableType FMU3CoSimulation::getType(const std::string& variableName) const{
+	long element;
+	const fmi3_variable* var = lookup(variableName, &element);
+	return (var == nullptr) ? FMIVariableType::fmiTypeUnknown : var->type;
+}
+
+fmiStatus FMU3CoSimulation::getLastStatus() const{
+	return last_status;
+}
+
+std::size_t FMU3CoSimulation::nStates() const{
+	return 0;
+}
+
+std::size_t FMU3CoSimulation::nEventInds() const{
+	return 0;
+}
+
+std::size_t FMU3CoSimulation::nValueRefs() const{
+	return variables.size();
+}
+
+const ModelDescription* FMU3CoSimulation::getModelDescription() const{
+	return nullptr;
+}
+
+void FMU3CoSimulation::sendDebugMessage(const std::string& msg) const{
+	XBT_DEBUG("%s",msg.c_str());
+}
+
+void FMU3CoSimulation::logger(fmiStatus status, const std::string& category, const std::string& msg) const{
+	XBT_DEBUG("[%s] %s",category.c_str(),msg.c_str());
+}
+
+}
+}
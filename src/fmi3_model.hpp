@@ -0,0 +1,231 @@
+#ifndef SRC_FMI3_MODEL_HPP_
+#define SRC_FMI3_MODEL_HPP_
+
+#include "simgrid-fmi.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace simgrid{
+namespace fmi{
+
+/*
+ * Subset of the FMI 3.0 C API used by the plugin (see fmi3FunctionTypes.h of the standard)
+ */
+typedef void* fmi3Instance;
+typedef void* fmi3InstanceEnvironment;
+typedef void* fmi3FMUState;
+typedef uint32_t fmi3ValueReference;
+typedef double fmi3Float64;
+typedef int32_t fmi3Int32;
+typedef bool fmi3Boolean;
+typedef bool fmi3Clock;
+typedef const char* fmi3String;
+typedef enum { fmi3OK, fmi3Warning, fmi3Discard, fmi3Error, fmi3Fatal } fmi3Status;
+
+typedef void (*fmi3LogMessageCallback)(fmi3InstanceEnvironment, fmi3Status, fmi3String, fmi3String);
+typedef void (*fmi3IntermediateUpdateCallback)(fmi3InstanceEnvironment, fmi3Float64, fmi3Boolean, fmi3Boolean, fmi3Boolean, fmi3Boolean, fmi3Boolean*, fmi3Float64*);
+
+typedef fmi3Instance (*fmi3InstantiateCoSimulationTYPE)(fmi3String, fmi3String, fmi3String, fmi3Boolean, fmi3Boolean, fmi3Boolean, fmi3Boolean,
+		const fmi3ValueReference[], size_t, fmi3InstanceEnvironment, fmi3LogMessageCallback, fmi3IntermediateUpdateCallback);
+typedef void (*fmi3FreeInstanceTYPE)(fmi3Instance);
+typedef fmi3Status (*fmi3EnterInitializationModeTYPE)(fmi3Instance, fmi3Boolean, fmi3Float64, fmi3Float64, fmi3Boolean, fmi3Float64);
+typedef fmi3Status (*fmi3InstanceTYPE)(fmi3Instance);
+typedef fmi3Status (*fmi3UpdateDiscreteStatesTYPE)(fmi3Instance, fmi3Boolean*, fmi3Boolean*, fmi3Boolean*, fmi3Boolean*, fmi3Boolean*, fmi3Float64*);
+typedef fmi3Status (*fmi3DoStepTYPE)(fmi3Instance, fmi3Float64, fmi3Float64, fmi3Boolean, fmi3Boolean*, fmi3Boolean*, fmi3Boolean*, fmi3Float64*);
+typedef fmi3Status (*fmi3GetFloat64TYPE)(fmi3Instance, const fmi3ValueReference[], size_t, fmi3Float64[], size_t);
+typedef fmi3Status (*fmi3SetFloat64TYPE)(fmi3Instance, const fmi3ValueReference[], size_t, const fmi3Float64[], size_t);
+typedef fmi3Status (*fmi3GetInt32TYPE)(fmi3Instance, const fmi3ValueReference[], size_t, fmi3Int32[], size_t);
+typedef fmi3Status (*fmi3SetInt32TYPE)(fmi3Instance, const fmi3ValueReference[], size_t, const fmi3Int32[], size_t);
+typedef fmi3Status (*fmi3GetBooleanTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, fmi3Boolean[], size_t);
+typedef fmi3Status (*fmi3SetBooleanTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, const fmi3Boolean[], size_t);
+typedef fmi3Status (*fmi3GetStringTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, fmi3String[], size_t);
+typedef fmi3Status (*fmi3SetStringTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, const fmi3String[], size_t);
+typedef fmi3Status (*fmi3GetClockTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, fmi3Clock[]);
+typedef fmi3Status (*fmi3SetClockTYPE)(fmi3Instance, const fmi3ValueReference[], size_t, const fmi3Clock[]);
+typedef fmi3Status (*fmi3GetFMUStateTYPE)(fmi3Instance, fmi3FMUState*);
+typedef fmi3Status (*fmi3SetFMUStateTYPE)(fmi3Instance, fmi3FMUState);
+typedef fmi3Status (*fmi3FreeFMUStateTYPE)(fmi3Instance, fmi3FMUState*);
+typedef fmi3Status (*fmi3SerializedFMUStateSizeTYPE)(fmi3Instance, fmi3FMUState, size_t*);
+typedef fmi3Status (*fmi3SerializeFMUStateTYPE)(fmi3Instance, fmi3FMUState, uint8_t[], size_t);
+typedef fmi3Status (*fmi3DeserializeFMUStateTYPE)(fmi3Instance, const uint8_t[], size_t, fmi3FMUState*);
+
+/**
+ * a variable of an FMI 3.0 model description
+ */
+struct fmi3_variable{
+	std::string name;
+	FMIVariableType type; // clocks are seen as booleans
+	bool clock;
+	bool input;
+	fmi3ValueReference vr;
+	std::size_t size; // number of elements (1 for scalars)
+};
+
+/**
+ * the part of an FMI 3.0 model description used by the plugin (supported variables only)
+ */
+struct fmi3_description{
+	std::string model_identifier;
+	std::string instantiation_token;
+	bool has_event_mode = false;
+	bool can_save_state = false;
+	std::vector<fmi3_variable> variables;
+};
+
+/**
+ * FMI 3.0 co-simulation FMU (unpacked directory), exposed through the fmipp co-simulation interface.
+ *
+ * Scalars are accessed as usual. The elements of an array variable T can be accessed as scalars
+ * named T[1], T[2]... (FMI 2.0 style), and the whole array with getArray / setArray, which perform
+ * a single fmi3GetFloat64 / fmi3SetFloat64 call. Clocks are seen as boolean ports: an output clock
+ * is true if it ticked during the last step, and setting an input clock to true activates it at the
+ * next event iteration, i.e. at the start of the next step (FMUs with input clocks must support event
+ * mode). When the FMU supports event mode, a doStep of length 0 is replaced by an event iteration
+ * (fmi3EnterEventMode / fmi3UpdateDiscreteStates / fmi3EnterStepMode).
+ */
+class FMU3CoSimulation : public FMUCoSimulationBase, public StatefulModel{
+
+public:
+	FMU3CoSimulation(std::string fmu_uri, std::string fmu_name);
+	~FMU3CoSimulation();
+
+	/**
+	 * return true if the unpacked FMU at fmu_uri has a FMI 3.0 model description
+	 */
+	static bool isFMI3(std::string fmu_uri);
+
+	/**
+	 * go back to the instantiated state (fmi3Reset): the FMU can then be initialized again
+	 */
+	fmiStatus reset();
+
+	bool isArray(const std::string& name) const;
+	std::size_t getArraySize(const std::string& name) const;
+	fmiStatus getArray(const std::string& name, std::vector<double>& values);
+	fmiStatus setArray(const std::string& name, const std::vector<double>& values);
+
+	fmiStatus instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive) override;
+	fmiStatus initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime) override;
+	fmiReal getTime() const override;
+	fmiStatus doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep) override;
+
+	fmiStatus setValue(fmiValueReference valref, const fmiReal& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiInteger& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiBoolean& val) override;
+	fmiStatus setValue(fmiValueReference valref, const std::string& val) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const std::string* val, std::size_t ival) override;
+	fmiStatus setValue(const std::string& name, const fmiReal& val) override;
+	fmiStatus setValue(const std::string& name, const fmiInteger& val) override;
+	fmiStatus setValue(const std::string& name, const fmiBoolean& val) override;
+	fmiStatus setValue(const std::string& name, const std::string& val) override;
+
+	fmiStatus getValue(fmiValueReference valref, fmiReal& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiInteger& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiBoolean& val) override;
+	fmiStatus getValue(fmiValueReference valref, std::string& val) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, std::string* val, std::size_t ival) override;
+	fmiStatus getValue(const std::string& name, fmiReal& val) override;
+	fmiStatus getValue(const std::string& name, fmiInteger& val) override;
+	fmiStatus getValue(const std::string& name, fmiBoolean& val) override;
+	fmiStatus getValue(const std::string& name, std::string& val) override;
+
+	fmiValueReference getValueRef(const std::string& name) const override;
+	FMIVariableType getType(const std::string& variableName) const override;
+	fmiStatus getLastStatus() const override;
+	std::size_t nStates() const override;
+	std::size_t nEventInds() const override;
+	std::size_t nValueRefs() const override;
+	const ModelDescription* getModelDescription() const override;
+	void sendDebugMessage(const std::string& msg) const override;
+	void logger(fmiStatus status, const std::string& category, const std::string& msg) const override;
+
+	bool canSaveState() const override;
+	fmiStatus saveState(void** state) override;
+	fmiStatus restoreState(void* state) override;
+	void freeState(void* state) override;
+	void allowStateRestores(bool allow) override;
+	fmiStatus serializeState(void* state, std::vector<char>& data) override;
+	fmiStatus deserializeState(const char* data, std::size_t size, void** state) override;
+
+private:
+	std::string fmu_path;
+	std::string model_identifier;
+	std::string instantiation_token;
+	bool has_event_mode;
+	bool can_save_state;
+	bool state_restores; // the master may set a state saved before the current point
+
+	void* library;
+	fmi3Instance instance;
+	double time;
+	fmiStatus last_status;
+
+	/**
+	 * model variables (the fmipp value reference of a variable is its index in this vector)
+	 * and the index of each name (element index -1 for a whole variable)
+	 */
+	std::vector<fmi3_variable> variables;
+	std::unordered_map<std::string,std::pair<std::size_t,long>> names;
+
+	std::vector<fmi3ValueReference> output_clocks;
+	std::vector<bool> output_clock_ticks;
+	std::vector<fmi3ValueReference> pending_input_clocks;
+	std::vector<double> element_buffer;
+
+	fmi3InstantiateCoSimulationTYPE fmi3InstantiateCoSimulation;
+	fmi3FreeInstanceTYPE fmi3FreeInstance;
+	fmi3EnterInitializationModeTYPE fmi3EnterInitializationMode;
+	fmi3InstanceTYPE fmi3ExitInitializationMode;
+	fmi3InstanceTYPE fmi3EnterEventMode;
+	fmi3InstanceTYPE fmi3EnterStepMode;
+	fmi3InstanceTYPE fmi3Terminate;
+	fmi3InstanceTYPE fmi3Reset;
+	fmi3UpdateDiscreteStatesTYPE fmi3UpdateDiscreteStates;
+	fmi3DoStepTYPE fmi3DoStep;
+	fmi3GetFloat64TYPE fmi3GetFloat64;
+	fmi3SetFloat64TYPE fmi3SetFloat64;
+	fmi3GetInt32TYPE fmi3GetInt32;
+	fmi3SetInt32TYPE fmi3SetInt32;
+	fmi3GetBooleanTYPE fmi3GetBoolean;
+	fmi3SetBooleanTYPE fmi3SetBoolean;
+	fmi3GetStringTYPE fmi3GetString;
+	fmi3SetStringTYPE fmi3SetString;
+	fmi3GetClockTYPE fmi3GetClock;
+	fmi3SetClockTYPE fmi3SetClock;
+	fmi3GetFMUStateTYPE fmi3GetFMUState;
+	fmi3SetFMUStateTYPE fmi3SetFMUState;
+	fmi3FreeFMUStateTYPE fmi3FreeFMUState;
+	fmi3SerializedFMUStateSizeTYPE fmi3SerializedFMUStateSize;
+	fmi3SerializeFMUStateTYPE fmi3SerializeFMUState;
+	fmi3DeserializeFMUStateTYPE fmi3DeserializeFMUState;
+
+	void parseModelDescription();
+	void readModelDescription(const std::string& description_path, fmi3_description& description);
+	void loadLibrary();
+	fmiStatus handleEvents(bool enter_event_mode);
+	fmiStatus toStatus(fmi3Status status);
+	const fmi3_variable* lookup(const std::string& name, long* element) const;
+	fmiStatus getElement(const fmi3_variable& var, long element, double& val);
+	fmiStatus setElement(const fmi3_variable& var, long element, double val);
+	fmiStatus setVariable(const fmi3_variable& var, long element, const fmiReal& val);
+	fmiStatus setVariable(const fmi3_variable& var, long element, const fmiInteger& val);
+	fmiStatus setVariable(const fmi3_variable& var, long element, const fmiBoolean& val);
+	fmiStatus setVariable(const fmi3_variable& var, long element, const std::string& val);
+	fmiStatus getVariable(const fmi3_variable& var, long element, fmiReal& val);
+	fmiStatus getVariable(const fmi3_variable& var, long element, fmiInteger& val);
+	fmiStatus getVariable(const fmi3_variable& var, long element, fmiBoolean& val);
+	fmiStatus getVariable(const fmi3_variable& var, long element, std::string& val);
+};
+
+}
+}
+
+#endif /* SRC_FMI3_MODEL_HPP_ */
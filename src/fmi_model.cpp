@@ -1,5 +1,9 @@
 //#include "src/surf/surf_interface.hpp"
 #include "simgrid-fmi.hpp"
+#include "fmi3_model.hpp"
+#include "remote_model.hpp"
+#include "fmu_group.hpp"
+#include "fmu_cache.hpp"
 #include "FMUCoSimulation_v1.h"
 #include "FMUCoSimulation_v2.h"
 #include "ModelManager.h"
@@ -8,6 +12,15 @@
 #include <fmiModelTypes.h>
 #include <simgrid/simix.hpp>
 #include <FMIVariableType.h>
+#include <simgrid/s4u/Actor.hpp>
+#include <simgrid/s4u/Engine.hpp>
+#include <simgrid/s4u/Exec.hpp>
+#include <simgrid/s4u/Host.hpp>
+#include <simgrid/s4u/Link.hpp>
+#include <simgrid/s4u/NetZone.hpp>
+#include <simgrid/plugins/energy.h>
+#include <chrono>
+#include <cmath>
 
 XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi, surf, "Logging specific to the SURF FMI plugin");
 
@@ -17,6 +30,42 @@ namespace fmi{
 
 MasterFMI* FMIPlugin::master;
 
+static double elapsedSince(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * load the FMU at fmu_uri (FMI 1.0, 2.0 or 3.0), return nullptr on failure
+ */
+static FMUCoSimulationBase* loadFMU(std::string fmu_uri, std::string fmu_name){
+
+	fmu_uri = FMUCache::unpack(fmu_uri);
+
+	// FMI 3.0 FMUs are not handled by fmipp
+	if(FMU3CoSimulation::isFMI3(fmu_uri)){
+		XBT_DEBUG("instantiation of the FMU-CS v 3.0");
+		return new FMU3CoSimulation(fmu_uri, fmu_name);
+	}
+
+	FMUType fmuType = invalid;
+	ModelManager::LoadFMUStatus loadStatus = ModelManager::loadFMU( fmu_name, fmu_uri, false, fmuType );
+
+	FMUCoSimulationBase *model = nullptr;
+	if (( ModelManager::success != loadStatus ) && ( ModelManager::duplicate != loadStatus) ) {
+		// TODO : manage loading failure
+		return nullptr;
+	}
+
+	if(fmi_1_0_cs == fmuType){
+		XBT_DEBUG("instantiation of the FMU-CS v 1.0");
+		model = new fmi_1_0::FMUCoSimulation( fmu_name, true, 1e-4  );
+	}else if( (fmi_2_0_cs == fmuType) || (fmi_2_0_me_and_cs == fmuType) ){
+		XBT_DEBUG("instantiation of the FMU-CS v 2.0");
+		model = new fmi_2_0::FMUCoSimulation( fmu_name , true, 1e-4  );
+	}
+	return model;
+}
+
 
 /**
  * FMIPlugin
@@ -28,30 +77,94 @@ FMIPlugin::FMIPlugin(){
 FMIPlugin::~FMIPlugin(){
 }
 
+void FMIPlugin::setCacheDirectory(std::string directory){
+	FMUCache::setDirectory(directory);
+}
+
 void FMIPlugin::addFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput){
 	master->addFMUCS(fmu_uri, fmu_name, iterateAfterInput);
 }
 
+void FMIPlugin::addFMUCS(FMUCoSimulationBase* model, std::string fmu_name, bool iterateAfterInput){
+	master->addFMUCS(model, fmu_name, iterateAfterInput);
+}
+
+void FMIPlugin::addRemoteFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput){
+	master->addRemoteFMUCS(fmu_uri, fmu_name, iterateAfterInput);
+}
+
+void FMIPlugin::addRemoteFMUCS(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name, bool iterateAfterInput){
+	master->addRemoteFMUCS(factory, fmu_name, iterateAfterInput);
+}
+
 void FMIPlugin::connectFMU(std::string out_fmu_name,std::string output_port,std::string in_fmu_name,std::string input_port){
 	master->connectFMU(out_fmu_name,output_port,in_fmu_name,input_port);
 }
 
-void FMIPlugin::connectRealFMUToSimgrid(double (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void FMIPlugin::connectFMU(std::string out_fmu_name,std::string output_port,std::string in_fmu_name,std::string input_port, coupling_transform transform){
+	master->connectFMUs({{out_fmu_name, output_port}}, fan_in_operation::SUM, in_fmu_name, input_port, transform);
+}
+
+void FMIPlugin::connectFMUs(std::vector<port> outputs, fan_in_operation operation, std::string in_fmu_name, std::string input_port, coupling_transform transform){
+	master->connectFMUs(outputs, operation, in_fmu_name, input_port, transform);
+}
+
+void FMIPlugin::connectRealFMUToSimgrid(std::function<double(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 	master->connectRealFMUToSimgrid(generateInput,params,fmu_name,input_name);
 }
 
-void FMIPlugin::connectIntegerFMUToSimgrid(int (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void FMIPlugin::connectIntegerFMUToSimgrid(std::function<int(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 	master->connectIntegerFMUToSimgrid(generateInput,params,fmu_name,input_name);
 }
 
-void FMIPlugin::connectBooleanFMUToSimgrid(bool (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void FMIPlugin::connectBooleanFMUToSimgrid(std::function<bool(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 	master->connectBooleanFMUToSimgrid(generateInput,params,fmu_name,input_name);
 }
 
-void FMIPlugin::connectStringFMUToSimgrid(std::string (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void FMIPlugin::connectStringFMUToSimgrid(std::function<std::string(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 	master->connectStringFMUToSimgrid(generateInput,params,fmu_name,input_name);
 }
 
+void FMIPlugin::connectHostGroupPowerToFMU(std::vector<simgrid::s4u::Host*> hosts, std::string fmu_name, std::string input_name){
+	master->connectHostGroupPowerToFMU(hosts,fmu_name,input_name);
+}
+
+void FMIPlugin::connectHostGroupPowerToFMU(simgrid::s4u::NetZone* netzone, std::string fmu_name, std::string input_name){
+	master->connectHostGroupPowerToFMU(netzone->get_all_hosts(),fmu_name,input_name);
+}
+
+void FMIPlugin::bindFMUOutputToHostPstate(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping){
+	resource_binding binding;
+	binding.type = resource_binding_type::HOST_PSTATE;
+	binding.host = host;
+	binding.mapping = mapping;
+	master->bindFMUOutput(fmu_name, output_name, binding);
+}
+
+void FMIPlugin::bindFMUOutputToHostSpeedScale(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping){
+	resource_binding binding;
+	binding.type = resource_binding_type::HOST_SPEED_SCALE;
+	binding.host = host;
+	binding.mapping = mapping;
+	master->bindFMUOutput(fmu_name, output_name, binding);
+}
+
+void FMIPlugin::bindFMUOutputToHostOnOff(std::string fmu_name, std::string output_name, simgrid::s4u::Host* host, std::function<double(double)> mapping){
+	resource_binding binding;
+	binding.type = resource_binding_type::HOST_ON_OFF;
+	binding.host = host;
+	binding.mapping = mapping;
+	master->bindFMUOutput(fmu_name, output_name, binding);
+}
+
+void FMIPlugin::bindFMUOutputToLinkBandwidth(std::string fmu_name, std::string output_name, simgrid::s4u::Link* link, std::function<double(double)> mapping){
+	resource_binding binding;
+	binding.type = resource_binding_type::LINK_BANDWIDTH;
+	binding.link = link;
+	binding.mapping = mapping;
+	master->bindFMUOutput(fmu_name, output_name, binding);
+}
+
 
 void FMIPlugin::initFMIPlugin(double communication_step){
 	if(master == 0){
@@ -64,20 +177,160 @@ void FMIPlugin::readyForSimulation(){
 	all_existing_models.push_back(master);
 }
 
+/*
+ * in lazy mode, the FMUs are brought up to date before being read by an actor
+ */
+void FMIPlugin::observe(){
+	if(master->isLagging()){
+		simgrid::simix::simcall([]() {
+			master->catchUp();
+		});
+	}
+}
+
+void FMIPlugin::enableLazyMode(bool enable, double max_step){
+	simgrid::simix::simcall([enable,max_step]() {
+		master->enableLazyMode(enable, max_step);
+	});
+}
+
+void FMIPlugin::enableSpeculation(bool enable){
+	simgrid::simix::simcall([enable]() {
+		master->enableSpeculation(enable);
+	});
+}
+
+void FMIPlugin::setStepRetry(int max_depth){
+	simgrid::simix::simcall([max_depth]() {
+		master->setStepRetry(max_depth);
+	});
+}
+
+void FMIPlugin::setInterpolation(std::string fmi_name, std::string output_name, int order){
+	simgrid::simix::simcall([fmi_name,output_name,order]() {
+		master->setInterpolation(fmi_name, output_name, order);
+	});
+}
+
+void FMIPlugin::publishOutputs(std::vector<port> ports){
+	master->addSnapshotPorts(ports);
+}
+
+/*
+ * read a port which is not in the output snapshot: once there is a snapshot, actors may run
+ * in parallel, so the FMUs are only accessed by maestro
+ */
+template<typename T> T FMIPlugin::readPort(std::function<T()> read){
+	if(master->hasSnapshot())
+		return simgrid::simix::simcall(read);
+	observe();
+	return read();
+}
+
 double FMIPlugin::getRealOutput(std::string fmi_name, std::string output_name){
-	return master->getRealOutput(fmi_name, output_name, true);
+	double value;
+	if(master->readSnapshot(fmi_name, output_name, &value))
+		return value;
+	return readPort<double>([&fmi_name,&output_name]() {
+		return master->getRealOutput(fmi_name, output_name, true);
+	});
 }
 
 bool FMIPlugin::getBooleanOutput(std::string fmi_name, std::string output_name){
-	return master->getBooleanOutput(fmi_name, output_name, true);
+	double value;
+	if(master->readSnapshot(fmi_name, output_name, &value))
+		return value != 0;
+	return readPort<bool>([&fmi_name,&output_name]() {
+		return master->getBooleanOutput(fmi_name, output_name, true);
+	});
 }
 
 int FMIPlugin::getIntegerOutput(std::string fmi_name, std::string output_name){
-	return master->getIntegerOutput(fmi_name, output_name, true);
+	double value;
+	if(master->readSnapshot(fmi_name, output_name, &value))
+		return (int) value;
+	return readPort<int>([&fmi_name,&output_name]() {
+		return master->getIntegerOutput(fmi_name, output_name, true);
+	});
 }
 
 std::string FMIPlugin::getStringOutput(std::string fmi_name, std::string output_name){
-	return master->getStringOutput(fmi_name, output_name, true);
+	return readPort<std::string>([&fmi_name,&output_name]() {
+		return master->getStringOutput(fmi_name, output_name, true);
+	});
+}
+
+double FMIPlugin::get(const PortHandle<double>& port){
+	double value;
+	if(master->readSnapshot(port.snapshot_slot, &value))
+		return value;
+	return readPort<double>([&port]() {
+		return master->getRealOutput(port);
+	});
+}
+
+int FMIPlugin::get(const PortHandle<int>& port){
+	double value;
+	if(master->readSnapshot(port.snapshot_slot, &value))
+		return (int) value;
+	return readPort<int>([&port]() {
+		return master->getIntegerOutput(port);
+	});
+}
+
+bool FMIPlugin::get(const PortHandle<bool>& port){
+	double value;
+	if(master->readSnapshot(port.snapshot_slot, &value))
+		return value != 0;
+	return readPort<bool>([&port]() {
+		return master->getBooleanOutput(port);
+	});
+}
+
+std::string FMIPlugin::get(const PortHandle<std::string>& port){
+	return readPort<std::string>([&port]() {
+		return master->getStringOutput(port);
+	});
+}
+
+/*
+ * the simcalls are synchronous, so the handles can be captured by reference
+ */
+
+void FMIPlugin::set(const PortHandle<double>& port, double value){
+	simgrid::simix::simcall([&port,value]() {
+		master->setRealInput(port, value);
+	});
+}
+
+void FMIPlugin::set(const PortHandle<int>& port, int value){
+	simgrid::simix::simcall([&port,value]() {
+		master->setIntegerInput(port, value);
+	});
+}
+
+void FMIPlugin::set(const PortHandle<bool>& port, bool value){
+	simgrid::simix::simcall([&port,value]() {
+		master->setBooleanInput(port, value);
+	});
+}
+
+void FMIPlugin::set(const PortHandle<std::string>& port, std::string value){
+	simgrid::simix::simcall([&port,&value]() {
+		master->setStringInput(port, value);
+	});
+}
+
+std::vector<double> FMIPlugin::getRealArrayOutput(std::string fmi_name, std::string output_name){
+	return readPort<std::vector<double>>([&fmi_name,&output_name]() {
+		return master->getRealArrayOutput(fmi_name, output_name, true);
+	});
+}
+
+void FMIPlugin::setRealArrayInput(std::string fmi_name, std::string input_name, std::vector<double> values){
+	simgrid::simix::simcall([fmi_name, input_name, values]() {
+		master->setRealArrayInput(fmi_name, input_name, values, true);
+	});
 }
 
 void FMIPlugin::setRealInput(std::string fmi_name, std::string input_name, double value){
@@ -105,12 +358,28 @@ void FMIPlugin::setStringInput(std::string fmi_name, std::string input_name, std
 
 }
 
-void FMIPlugin::registerEvent(bool (*condition)(std::vector<std::string>), void (*handleEvent)(std::vector<std::string>), std::vector<std::string> params){
+InputTransaction FMIPlugin::inputs(){
+	return InputTransaction();
+}
+
+void FMIPlugin::commitInputs(const InputTransaction& transaction){
+	simgrid::simix::simcall([&transaction]() {
+		master->commitInputs(transaction);
+	});
+}
+
+void FMIPlugin::registerEvent(std::function<bool(const std::vector<std::string>&)> condition, std::function<void(const std::vector<std::string>&)> handleEvent, std::vector<std::string> params){
 	simgrid::simix::simcall([condition,handleEvent,params]() {
 		master->registerEvent(condition,handleEvent,params);
 	});
 }
 
+void FMIPlugin::resetSimulation(fmu_parameters parameters, std::string output_file_path){
+	simgrid::simix::simcall([parameters,output_file_path]() {
+		master->resetSimulation(parameters, output_file_path);
+	});
+}
+
 void FMIPlugin::deleteEvents(){
 	master->deleteEvents();
 }
@@ -119,6 +388,74 @@ void FMIPlugin::configureOutputLog(std::string output_file_path, std::vector<por
 	master->configureOutputLog(output_file_path,ports_to_monitor);
 }
 
+void FMIPlugin::enableStatistics(bool enable, bool print_at_end){
+	master->enableStatistics(enable);
+	static bool print_connected = false;
+	if(print_at_end && !print_connected){
+		print_connected = true;
+		simgrid::s4u::on_simulation_end.connect([]() {
+			master->printStatistics();
+		});
+	}
+}
+
+fmi_statistics FMIPlugin::getStatistics(){
+	return master->getStatistics();
+}
+
+void FMIPlugin::resetStatistics(){
+	master->resetStatistics();
+}
+
+void FMIPlugin::printStatistics(){
+	master->printStatistics();
+}
+
+
+
+/**
+ * InputTransaction
+ */
+
+InputTransaction& InputTransaction::set(const PortHandle<double>& port, double value){
+	reals.push_back(std::make_pair(port, value));
+	return *this;
+}
+
+InputTransaction& InputTransaction::set(const PortHandle<int>& port, int value){
+	integers.push_back(std::make_pair(port, value));
+	return *this;
+}
+
+InputTransaction& InputTransaction::set(const PortHandle<bool>& port, bool value){
+	booleans.push_back(std::make_pair(port, value));
+	return *this;
+}
+
+InputTransaction& InputTransaction::set(const PortHandle<std::string>& port, std::string value){
+	strings.push_back(std::make_pair(port, value));
+	return *this;
+}
+
+InputTransaction& InputTransaction::setReal(std::string fmi_name, std::string input_name, double value){
+	return set(FMIPlugin::getPort<double>(fmi_name, input_name), value);
+}
+
+InputTransaction& InputTransaction::setInteger(std::string fmi_name, std::string input_name, int value){
+	return set(FMIPlugin::getPort<int>(fmi_name, input_name), value);
+}
+
+InputTransaction& InputTransaction::setBoolean(std::string fmi_name, std::string input_name, bool value){
+	return set(FMIPlugin::getPort<bool>(fmi_name, input_name), value);
+}
+
+InputTransaction& InputTransaction::setString(std::string fmi_name, std::string input_name, std::string value){
+	return set(FMIPlugin::getPort<std::string>(fmi_name, input_name), value);
+}
+
+void InputTransaction::commit(){
+	FMIPlugin::commitInputs(*this);
+}
 
 
 
@@ -134,31 +471,51 @@ MasterFMI::MasterFMI(const double stepSize)
 	current_time = 0;
 	firstEvent = true;
 	ready_for_simulation = false;
+	fmus_started = false;
+	collect_statistics = false;
+	lazy = false;
+	lazy_step = stepSize;
+	lazy_target = 0;
+	check_input_time = true;
+	speculative = false;
+	speculating = false;
+	spec_time = 0;
+	step_retry_depth = 0;
+	snapshot_epoch = 0;
+	trace_paused = false;
+	telemetry = nullptr;
 }
 
 
 MasterFMI::~MasterFMI() {
+	settle();
+	freeStepStates();
+	for(auto& it : fmu_groups)
+		delete it.second;
 	output.close();
+	stopRecording();
+	disableTelemetry();
 }
 
 
 void MasterFMI::addFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput){
-	FMUType fmuType = invalid;
-	ModelManager::LoadFMUStatus loadStatus = ModelManager::loadFMU( fmu_name, fmu_uri, false, fmuType );
 
-	FMUCoSimulationBase *model;
-	if (( ModelManager::success != loadStatus ) && ( ModelManager::duplicate != loadStatus) ) {
-		// TODO : manage loading failure
+	FMUCoSimulationBase *model = loadFMU(fmu_uri, fmu_name);
+	if(model == nullptr)
 		return;
-	}
 
-	if(fmi_1_0_cs == fmuType){
-		XBT_DEBUG("instantiation of the FMU-CS v 1.0");
-		model = new fmi_1_0::FMUCoSimulation( fmu_name, true, 1e-4  );
-	}else if( (fmi_2_0_cs == fmuType) || (fmi_2_0_me_and_cs == fmuType) ){
-		XBT_DEBUG("instantiation of the FMU-CS v 2.0");
-		model = new fmi_2_0::FMUCoSimulation( fmu_name , true, 1e-4  );
-	}
+	addFMUCS(model, fmu_name, iterateAfterInput);
+	fmu_uris[fmu_name] = fmu_uri;
+}
+
+
+void MasterFMI::addFMUCS(FMUCoSimulationBase* model, std::string fmu_name, bool iterateAfterInput){
+
+	if(trace.is_open())
+		xbt_die("FMU %s added while the inputs are recorded: add the FMUs before FMIPlugin::recordInputs",fmu_name.c_str());
+	// the speculative states are sized, and the FMUs checked, when the speculation is enabled
+	if(speculative)
+		xbt_die("FMU %s added while the speculative stepping is enabled: add the FMUs before FMIPlugin::enableSpeculation",fmu_name.c_str());
 
 	const double startTime = SIMIX_get_clock();
 
@@ -174,6 +531,33 @@ void MasterFMI::addFMUCS(std::string fmu_uri, std::string fmu_name, bool iterate
 	fmus[fmu_name] = model;
 	iterate_input[fmu_name] = iterateAfterInput;
 
+	fmu_indexes[fmu_name] = fmu_table.size();
+	fmu_table.push_back(model);
+	fmu_table_names.push_back(fmu_name);
+	fmu_table_iterate_input.push_back(iterateAfterInput);
+	updateStateRestores();
+	checkStepRetry(fmu_table.size() - 1);
+}
+
+
+void MasterFMI::addRemoteFMUCS(std::string fmu_uri, std::string fmu_name, bool iterateAfterInput){
+	addRemoteFMUCS([fmu_uri, fmu_name]() {
+		return loadFMU(fmu_uri, fmu_name);
+	}, fmu_name, iterateAfterInput);
+	// used by the replay only, the worker reloads the FMU itself on reset
+	fmu_uris[fmu_name] = fmu_uri;
+}
+
+
+void MasterFMI::addRemoteFMUCS(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name, bool iterateAfterInput){
+
+	if(speculative)
+		xbt_die("FMUs running in a worker process can not be stepped speculatively");
+	RemoteFMU* model = new RemoteFMU(factory, fmu_name);
+	XBT_DEBUG("FMU-CS %s started in a worker process",fmu_name.c_str());
+
+	addFMUCS(model, fmu_name, iterateAfterInput);
+	remote_fmus[fmu_name] = model;
 }
 
 
@@ -189,11 +573,52 @@ void MasterFMI::connectFMU(std::string out_fmu_name,std::string output_port,std:
 	out.name = output_port;
 	in.fmu = in_fmu_name;
 	in.name = input_port;
-	in_coupled_input.push_back(in);
-	couplings[in]=out;
+
+	std::size_t out_size = getArraySize(out_fmu_name, output_port);
+	std::size_t in_size = getArraySize(in_fmu_name, input_port);
+	if(out_size != in_size)
+		xbt_die("can not connect port %s of FMU %s (%zu elements) to port %s of FMU %s (%zu elements)",
+				output_port.c_str(), out_fmu_name.c_str(), out_size, input_port.c_str(), in_fmu_name.c_str(), in_size);
+
+	if(out_size > 0){
+		in_array_coupled_input.push_back(in);
+		array_couplings[in]=out;
+	}else{
+		in_coupled_input.push_back(in);
+		couplings[in]=out;
+	}
+}
+
+void MasterFMI::connectFMUs(std::vector<port> outputs, fan_in_operation operation, std::string in_fmu_name, std::string input_port, coupling_transform transform){
+
+	checkNotReadyForSimulation();
+	if(outputs.empty())
+		xbt_die("can not couple port %s of FMU %s to an empty set of outputs",input_port.c_str(),in_fmu_name.c_str());
+	checkPortValidity(in_fmu_name,input_port,FMIVariableType::fmiTypeReal,true);
+	if(getArraySize(in_fmu_name, input_port) > 0)
+		xbt_die("can not couple array port %s of FMU %s through a transform",input_port.c_str(),in_fmu_name.c_str());
+
+	transformed_coupling coupling;
+	coupling.in = getPortHandle(in_fmu_name, input_port, FMIVariableType::fmiTypeReal);
+	coupling.first = transformed_sources.size();
+	coupling.count = outputs.size();
+	coupling.operation = operation;
+	coupling.transform = transform;
+
+	for(const port& out : outputs){
+		checkPortValidity(out.fmu,out.name,FMIVariableType::fmiTypeUnknown,false);
+		FMIVariableType type = fmus[out.fmu]->getType(out.name);
+		if((type != FMIVariableType::fmiTypeReal && type != FMIVariableType::fmiTypeInteger) || getArraySize(out.fmu, out.name) > 0)
+			xbt_die("can not couple port %s of FMU %s through a transform: it is neither a real nor an integer",out.name.c_str(),out.fmu.c_str());
+		transformed_sources.push_back(getPortHandle(out.fmu, out.name, type));
+	}
+
+	transformed_couplings.push_back(coupling);
+	transformed_values.resize(transformed_sources.size());
+	last_transformed_inputs.resize(transformed_couplings.size());
 }
 
-void MasterFMI::connectRealFMUToSimgrid(double (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void MasterFMI::connectRealFMUToSimgrid(std::function<double(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 
 	checkNotReadyForSimulation();
 	checkPortValidity(fmu_name,input_name,FMIVariableType::fmiTypeReal,true);
@@ -210,7 +635,7 @@ void MasterFMI::connectRealFMUToSimgrid(double (*generateInput)(std::vector<std:
 	ext_coupled_input.push_back(in);
 }
 
-void MasterFMI::connectIntegerFMUToSimgrid(int (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void MasterFMI::connectIntegerFMUToSimgrid(std::function<int(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 
 	checkNotReadyForSimulation();
 	checkPortValidity(fmu_name,input_name,FMIVariableType::fmiTypeInteger,true);
@@ -227,7 +652,7 @@ void MasterFMI::connectIntegerFMUToSimgrid(int (*generateInput)(std::vector<std:
 	ext_coupled_input.push_back(in);
 }
 
-void MasterFMI::connectBooleanFMUToSimgrid(bool (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void MasterFMI::connectBooleanFMUToSimgrid(std::function<bool(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 
 	checkNotReadyForSimulation();
 	checkPortValidity(fmu_name,input_name,FMIVariableType::fmiTypeBoolean,true);
@@ -244,7 +669,7 @@ void MasterFMI::connectBooleanFMUToSimgrid(bool (*generateInput)(std::vector<std
 	ext_coupled_input.push_back(in);
 }
 
-void MasterFMI::connectStringFMUToSimgrid(std::string (*generateInput)(std::vector<std::string>), std::vector<std::string> params, std::string fmu_name, std::string input_name){
+void MasterFMI::connectStringFMUToSimgrid(std::function<std::string(const std::vector<std::string>&)> generateInput, std::vector<std::string> params, std::string fmu_name, std::string input_name){
 
 	checkNotReadyForSimulation();
 	checkPortValidity(fmu_name,input_name,FMIVariableType::fmiTypeString,true);
@@ -261,14 +686,254 @@ void MasterFMI::connectStringFMUToSimgrid(std::string (*generateInput)(std::vect
 	ext_coupled_input.push_back(in);
 }
 
+void MasterFMI::connectHostGroupPowerToFMU(std::vector<simgrid::s4u::Host*> hosts, std::string fmu_name, std::string input_name){
+
+	checkNotReadyForSimulation();
+	checkPortValidity(fmu_name,input_name,FMIVariableType::fmiTypeReal,true);
+
+	// the load of a host changes when an execution starts or completes on it, its pstate and state are signaled
+	if(host_groups.empty()){
+		simgrid::s4u::Host::on_state_change.connect([this](simgrid::s4u::Host& host) {
+			markHostPower(&host);
+		});
+		simgrid::s4u::Host::on_speed_change.connect([this](simgrid::s4u::Host& host) {
+			markHostPower(&host);
+		});
+		simgrid::s4u::Exec::on_start.connect([this](simgrid::s4u::ActorPtr actor) {
+			markHostPower(actor->get_host());
+		});
+		simgrid::s4u::Exec::on_completion.connect([this](simgrid::s4u::ActorPtr actor) {
+			markHostPower(actor->get_host());
+		});
+	}
+
+	host_group_power group;
+	group.in.fmu = fmu_name;
+	group.in.name = input_name;
+	group.hosts = hosts;
+	group.loads.assign(hosts.size(), -1);
+	group.powers.assign(hosts.size(), 0);
+	group.dirty.assign(hosts.size(), true);
+	for(std::size_t i = 0; i < hosts.size(); i++)
+		group.dirty_hosts.push_back(i);
+
+	for(std::size_t i = 0; i < hosts.size(); i++)
+		host_group_members[hosts[i]].push_back(std::make_pair(host_groups.size(), i));
+
+	host_groups.push_back(group);
+	ext_coupled_input.push_back(group.in);
+}
+
+void MasterFMI::bindFMUOutput(std::string fmu_name, std::string output_name, resource_binding binding){
+
+	checkNotReadyForSimulation();
+	if(binding.host == nullptr && binding.link == nullptr)
+		xbt_die("no resource to bind to output %s of FMU %s",output_name.c_str(),fmu_name.c_str());
+
+	checkPortValidity(fmu_name, output_name, FMIVariableType::fmiTypeUnknown, false);
+	FMIVariableType type = fmus[fmu_name]->getType(output_name);
+	if(type == FMIVariableType::fmiTypeString)
+		xbt_die("string output %s of FMU %s can not drive a resource",output_name.c_str(),fmu_name.c_str());
+
+	binding.out = getPortHandle(fmu_name, output_name, type);
+	resource_bindings.push_back(binding);
+}
+
+/**
+ * apply the bindings whose output changed since they were last applied
+ */
+void MasterFMI::applyResourceBindings(){
+
+	for(resource_binding& binding : resource_bindings){
+
+		double value;
+		if(binding.out.type == FMIVariableType::fmiTypeReal)
+			value = getRealOutput(binding.out);
+		else if(binding.out.type == FMIVariableType::fmiTypeInteger)
+			value = getIntegerOutput(binding.out);
+		else
+			value = getBooleanOutput(binding.out) ? 1 : 0;
+
+		if(binding.applied && value == binding.last_output)
+			continue;
+		binding.last_output = value;
+		binding.applied = true;
+		if(binding.mapping)
+			value = binding.mapping(value);
+
+		XBT_DEBUG("output %s of FMU %s changed to %f, updating its resource",binding.out.p.name.c_str(),binding.out.p.fmu.c_str(),value);
+
+		simgrid::s4u::Host* host = binding.host;
+		switch(binding.type){
+		case resource_binding_type::HOST_PSTATE:{
+			int pstate = std::max(0, std::min(host->get_pstate_count() - 1, (int) std::lround(value)));
+			if(pstate != host->get_pstate())
+				host->set_pstate(pstate);
+			break;
+		}
+		case resource_binding_type::HOST_SPEED_SCALE:{
+			double speed = value * host->get_pstate_speed(0);
+			int pstate = 0;
+			for(int i = 1; i < host->get_pstate_count(); i++){
+				if(std::abs(host->get_pstate_speed(i) - speed) < std::abs(host->get_pstate_speed(pstate) - speed))
+					pstate = i;
+			}
+			if(pstate != host->get_pstate())
+				host->set_pstate(pstate);
+			break;
+		}
+		case resource_binding_type::HOST_ON_OFF:
+			if(value != 0 && !host->is_on())
+				host->turn_on();
+			else if(value == 0 && host->is_on())
+				host->turn_off();
+			break;
+		case resource_binding_type::LINK_BANDWIDTH:
+			binding.link->set_bandwidth(value);
+			break;
+		}
+	}
+}
+
+void MasterFMI::addSnapshotPorts(std::vector<port> ports){
+
+	checkNotReadyForSimulation();
+	for(port p : ports){
+		if(snapshot_slots.find(p) != snapshot_slots.end())
+			continue;
+		checkPortValidity(p.fmu, p.name, FMIVariableType::fmiTypeUnknown, false);
+		FMIVariableType type = fmus[p.fmu]->getType(p.name);
+		if(type == FMIVariableType::fmiTypeString)
+			xbt_die("string output %s of FMU %s can not be published in the snapshot",p.name.c_str(),p.fmu.c_str());
+		snapshot_slots[p] = snapshot_ports.size();
+		snapshot_ports.push_back(getPortHandle(p.fmu, p.name, type));
+	}
+	snapshot_values[0].assign(snapshot_ports.size(), 0);
+	snapshot_values[1].assign(snapshot_ports.size(), 0);
+}
+
+bool MasterFMI::hasSnapshot(){
+	return !snapshot_ports.empty();
+}
+
+/**
+ * copy the published outputs in the buffer readers do not use, then switch the buffers
+ */
+void MasterFMI::publishOutputs(){
+
+	if(snapshot_ports.empty())
+		return;
+
+	unsigned long epoch = snapshot_epoch.load(std::memory_order_relaxed) + 1;
+	std::vector<double>& values = snapshot_values[epoch & 1];
+	for(std::size_t i = 0; i < snapshot_ports.size(); i++){
+		const port_handle& handle = snapshot_ports[i];
+		if(handle.type == FMIVariableType::fmiTypeReal)
+			values[i] = getRealOutput(handle);
+		else if(handle.type == FMIVariableType::fmiTypeInteger)
+			values[i] = getIntegerOutput(handle);
+		else
+			values[i] = getBooleanOutput(handle) ? 1 : 0;
+	}
+	snapshot_epoch.store(epoch, std::memory_order_release);
+}
+
+/**
+ * read a published output, retrying if a new snapshot was published meanwhile
+ * (return false if the port is not published)
+ */
+bool MasterFMI::readSnapshot(std::size_t slot, double* value){
+
+	if(slot >= snapshot_ports.size())
+		return false;
+
+	unsigned long epoch;
+	do{
+		epoch = snapshot_epoch.load(std::memory_order_acquire);
+		*value = snapshot_values[epoch & 1][slot];
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}while(snapshot_epoch.load(std::memory_order_relaxed) != epoch);
+	return true;
+}
+
+bool MasterFMI::readSnapshot(const std::string& fmi_name, const std::string& output_name, double* value){
 
+	if(snapshot_ports.empty())
+		return false;
 
-double MasterFMI::getRealOutput(std::string fmi_name, std::string output_name, bool checkPort){
+	port p = {fmi_name, output_name};
+	auto slot = snapshot_slots.find(p);
+	return slot != snapshot_slots.end() && readSnapshot(slot->second, value);
+}
+
+void MasterFMI::markHostPower(simgrid::s4u::Host* host){
+	auto it = host_group_members.find(host);
+	if(it == host_group_members.end())
+		return;
+	for(std::pair<std::size_t,std::size_t> member : it->second){
+		host_group_power& group = host_groups[member.first];
+		if(!group.dirty[member.second]){
+			group.dirty[member.second] = true;
+			group.dirty_hosts.push_back(member.second);
+		}
+	}
+}
+
+/**
+ * compute again the power of the hosts of the group which were signaled, and return true if the
+ * total power of the group changed. The loads of all the hosts are checked every 1000 updates,
+ * for the changes that are not signaled (e.g. an actor killed during an execution).
+ */
+bool MasterFMI::updateHostGroupPower(host_group_power& group){
+
+	double previous = group.total;
+	if(++group.visits >= 1000){
+		group.visits = 0;
+		for(std::size_t i = 0; i < group.hosts.size(); i++){
+			simgrid::s4u::Host* host = group.hosts[i];
+			if(!group.dirty[i] && (host->is_on() ? host->get_load() : 0) != group.loads[i]){
+				group.dirty[i] = true;
+				group.dirty_hosts.push_back(i);
+			}
+		}
+	}
+
+	for(std::size_t i : group.dirty_hosts){
+		simgrid::s4u::Host* host = group.hosts[i];
+		double power = sg_host_get_current_consumption(host);
+		group.total += power - group.powers[i];
+		group.powers[i] = power;
+		group.loads[i] = host->is_on() ? host->get_load() : 0;
+		group.dirty[i] = false;
+		group.updates++;
+	}
+	group.dirty_hosts.clear();
+
+	// the rounding errors of the incremental updates are dropped from time to time
+	if(group.updates >= 1000 * group.hosts.size()){
+		group.total = 0;
+		for(double power : group.powers)
+			group.total += power;
+		group.updates = 0;
+	}
+
+	return group.total != previous;
+}
+
+
+
+double MasterFMI::getRealOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort){
 
 	if(checkPort)
-		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeReal,false);
+		settle();
 
 	double out;
+	if(checkPort){
+		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeReal,false);
+		if(!histories.empty() && interpolate({fmi_name, output_name}, SIMIX_get_clock(), &out))
+			return out;
+	}
+
 	fmiStatus status = fmus[fmi_name]->getValue(output_name,out);
 	if(status != fmiOK)
 		xbt_die("FMI %s failed to return the value of variable %s",fmi_name.c_str(),output_name.c_str());
@@ -276,7 +941,10 @@ double MasterFMI::getRealOutput(std::string fmi_name, std::string output_name, b
 	return out;
 }
 
-bool MasterFMI::getBooleanOutput(std::string fmi_name, std::string output_name, bool checkPort){
+bool MasterFMI::getBooleanOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort){
+
+	if(checkPort)
+		settle();
 
 	if(checkPort)
 		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeBoolean,false);
@@ -289,7 +957,10 @@ bool MasterFMI::getBooleanOutput(std::string fmi_name, std::string output_name,
 	return out;
 }
 
-int MasterFMI::getIntegerOutput(std::string fmi_name, std::string output_name, bool checkPort){
+int MasterFMI::getIntegerOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort){
+
+	if(checkPort)
+		settle();
 
 	if(checkPort)
 		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeInteger,false);
@@ -302,125 +973,454 @@ int MasterFMI::getIntegerOutput(std::string fmi_name, std::string output_name, b
 	return out;
 }
 
-std::string MasterFMI::getStringOutput(std::string fmi_name, std::string output_name, bool checkPort){
+std::string MasterFMI::getStringOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort){
+
+	if(checkPort)
+		settle();
 
 	if(checkPort)
 		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeString,false);
 
 	std::string out;
-	fmiStatus status = fmus[fmi_name]->getValue(output_name,out);
-	if(status != fmiOK)
+	readStringOutput(fmi_name, output_name, out);
+	return out;
+}
+
+/**
+ * read a string output in out (whose buffer is reused by the coupling solver and the log)
+ */
+void MasterFMI::readStringOutput(const std::string& fmi_name, const std::string& output_name, std::string& out){
+	fmiStatus status = fmus[fmi_name]->getValue(output_name,out);
+	if(status != fmiOK)
 		xbt_die("FMI %s failed to return the value of variable %s",fmi_name.c_str(),output_name.c_str());
+}
+
+std::size_t MasterFMI::getArraySize(const std::string& fmi_name, const std::string& port_name){
+	FMU3CoSimulation* fmu3 = dynamic_cast<FMU3CoSimulation*>(fmus[fmi_name]);
+	if(fmu3 == nullptr || !fmu3->isArray(port_name))
+		return 0;
+	return fmu3->getArraySize(port_name);
+}
+
+std::vector<double> MasterFMI::getRealArrayOutput(const std::string& fmi_name, const std::string& output_name, bool checkPort){
+
+	if(checkPort)
+		settle();
+
+	if(checkPort)
+		checkPortValidity(fmi_name,output_name,FMIVariableType::fmiTypeReal,false);
 
+	std::vector<double> out;
+	readRealArrayOutput(fmi_name, output_name, out);
 	return out;
 }
 
-void MasterFMI::setRealInput(std::string fmi_name, std::string input_name, double value, bool simgrid_input){
+/**
+ * read an array output in out (whose buffer is reused by the coupling solver and the log)
+ */
+void MasterFMI::readRealArrayOutput(const std::string& fmi_name, const std::string& output_name, std::vector<double>& out){
+	FMU3CoSimulation* fmu3 = dynamic_cast<FMU3CoSimulation*>(fmus[fmi_name]);
+	if(fmu3 == nullptr || fmu3->getArray(output_name, out) != fmiOK)
+		xbt_die("FMI %s failed to return the values of array variable %s",fmi_name.c_str(),output_name.c_str());
+}
+
+void MasterFMI::setRealArrayInput(const std::string& fmi_name, const std::string& input_name, const std::vector<double>& values, bool simgrid_input){
 
 	if(simgrid_input){
+		settle();
 		checkPortValidity(fmi_name,input_name,FMIVariableType::fmiTypeReal,simgrid_input);
+		catchUp();
+		checkInputTime(fmi_name, input_name);
+	}
+
+	recordInput(fmi_name, input_name, values);
+	FMU3CoSimulation* fmu3 = dynamic_cast<FMU3CoSimulation*>(fmus[fmi_name]);
+	if(fmu3 == nullptr || fmu3->setArray(input_name, values) != fmiOK)
+		xbt_die("FMU %s failed to set its array port %s (%zu values)",fmi_name.c_str(),input_name.c_str(),values.size());
+
+	if(iterate_input[fmi_name]){
+		iterateInput(fmi_name);
 	}
 
+	if(simgrid_input && ready_for_simulation){
+		solveCouplings(false);
+		manageEventNotification();
+		publishOutputs();
+	}
+}
+
+void MasterFMI::setRealInput(const std::string& fmi_name, const std::string& input_name, double value, bool simgrid_input){
+
+	if(simgrid_input){
+		settle();
+		checkPortValidity(fmi_name,input_name,FMIVariableType::fmiTypeReal,simgrid_input);
+		catchUp();
+		checkInputTime(fmi_name, input_name);
+	}
+
+	recordInput(fmi_name, input_name, value);
 	fmiStatus status = fmus[fmi_name]->setValue(input_name,value);
 	if(status != fmiOK)
 		xbt_die("FMU %s failed to set its port %s to value %f",fmi_name.c_str(),input_name.c_str(),value);
 
 	if(iterate_input[fmi_name]){
-		status = fmus[fmi_name]->doStep(SIMIX_get_clock(), 0., fmiTrue );
-		if(status != fmiOK)
-			xbt_die("FMU %s failed to perform a doStep(dt=0) after setting an input (you should may be set iterateAfterInput=false when adding the FMU CS).",fmi_name.c_str());
+		iterateInput(fmi_name);
 	}
 
 	if(simgrid_input && ready_for_simulation){
 		solveCouplings(false);
 		manageEventNotification();
+		publishOutputs();
 	}
 }
 
-void MasterFMI::setBooleanInput(std::string fmi_name, std::string input_name, bool value, bool simgrid_input){
+void MasterFMI::setBooleanInput(const std::string& fmi_name, const std::string& input_name, bool value, bool simgrid_input){
 
 	if(simgrid_input){
+		settle();
 		checkPortValidity(fmi_name,input_name,FMIVariableType::fmiTypeBoolean,simgrid_input);
+		catchUp();
+		checkInputTime(fmi_name, input_name);
 	}
 
+	// booleans go through the integer overload (promotion), and are recorded as integers
+	recordInput(fmi_name, input_name, (int) value);
 	fmiStatus status = fmus[fmi_name]->setValue(input_name,value);
 	if(status != fmiOK)
 		xbt_die("FMU %s failed to set its port %s to value %i",fmi_name.c_str(),input_name.c_str(),value);
 
 	if(iterate_input[fmi_name]){
-		status = fmus[fmi_name]->doStep(SIMIX_get_clock(), 0., fmiTrue );
-		if(status != fmiOK)
-			xbt_die("FMU %s failed to perform a doStep(dt=0) after setting an input (you should may be set iterateAfterInput=false when adding the FMU CS).",fmi_name.c_str());
+		iterateInput(fmi_name);
 	}
 
 	if(simgrid_input && ready_for_simulation){
 		solveCouplings(false);
 		manageEventNotification();
+		publishOutputs();
 	}
 }
 
-void MasterFMI::setIntegerInput(std::string fmi_name, std::string input_name, int value, bool simgrid_input){
+void MasterFMI::setIntegerInput(const std::string& fmi_name, const std::string& input_name, int value, bool simgrid_input){
 
 	if(simgrid_input){
+		settle();
 		checkPortValidity(fmi_name,input_name,FMIVariableType::fmiTypeInteger,simgrid_input);
+		catchUp();
+		checkInputTime(fmi_name, input_name);
 	}
 
+	recordInput(fmi_name, input_name, value);
 	fmiStatus status = fmus[fmi_name]->setValue(input_name,value);
 	if(status != fmiOK)
 		xbt_die("FMU %s failed to set its port %s to value %i",fmi_name.c_str(),input_name.c_str(),value);
 
 	if(iterate_input[fmi_name]){
-		status = fmus[fmi_name]->doStep(SIMIX_get_clock(), 0., fmiTrue );
-		if(status != fmiOK)
-			xbt_die("FMU %s failed to perform a doStep(dt=0) after setting an input (you should may be set iterateAfterInput=false when adding the FMU CS).",fmi_name.c_str());
+		iterateInput(fmi_name);
 	}
 
 	if(simgrid_input && ready_for_simulation){
 		solveCouplings(false);
 		manageEventNotification();
+		publishOutputs();
 	}
 }
 
-void MasterFMI::setStringInput(std::string fmi_name, std::string input_name, std::string value, bool simgrid_input){
+void MasterFMI::setStringInput(const std::string& fmi_name, const std::string& input_name, const std::string& value, bool simgrid_input){
 
 	if(simgrid_input){
+		settle();
 		checkPortValidity(fmi_name,input_name, FMIVariableType::fmiTypeString, simgrid_input);
+		catchUp();
+		checkInputTime(fmi_name, input_name);
 	}
 
+	recordInput(fmi_name, input_name, value);
 	fmiStatus status = fmus[fmi_name]->setValue(input_name,value);
 	if(status != fmiOK)
 		xbt_die("FMU %s failed to set its port %s to value %s",fmi_name.c_str(),input_name.c_str(),value.c_str());
 
 	if(iterate_input[fmi_name]){
-		status = fmus[fmi_name]->doStep(SIMIX_get_clock(), 0., fmiTrue );
-		if(status != fmiOK)
-			xbt_die("FMU %s failed to perform a doStep(dt=0) after setting an input (you should may be set iterateAfterInput=false when adding the FMU CS).",fmi_name.c_str());
+		iterateInput(fmi_name);
 	}
 
 	if(simgrid_input && ready_for_simulation){
 		solveCouplings(false);
 		manageEventNotification();
+		publishOutputs();
+	}
+}
+
+/*
+ * PORT HANDLES
+ */
+
+port_handle MasterFMI::getPortHandle(std::string fmi_name, std::string port_name, FMIVariableType type){
+
+	checkPortValidity(fmi_name, port_name, type, false);
+
+	port_handle handle;
+	handle.fmu = fmu_indexes[fmi_name];
+	handle.valref = fmus[fmi_name]->getValueRef(port_name);
+	handle.type = type;
+	handle.coupled = isInputCoupled(fmi_name, port_name);
+	handle.p.fmu = fmi_name;
+	handle.p.name = port_name;
+	auto slot = snapshot_slots.find(handle.p);
+	if(slot != snapshot_slots.end())
+		handle.snapshot_slot = slot->second;
+	return handle;
+}
+
+FMUCoSimulationBase* MasterFMI::checkHandle(const port_handle& handle, FMIVariableType type, bool input){
+	if(handle.fmu >= fmu_table.size() || handle.type != type)
+		xbt_die("invalid handle for port %s of FMU %s",handle.p.name.c_str(),handle.p.fmu.c_str());
+	if(input && handle.coupled)
+		xbt_die("port %s of FMU %s is already coupled to a model",handle.p.name.c_str(),handle.p.fmu.c_str());
+	return fmu_table[handle.fmu];
+}
+
+void MasterFMI::inputChanged(const port_handle& handle){
+
+	if(fmu_table_iterate_input[handle.fmu]){
+		iterateInput(handle.fmu);
+	}
+
+	if(ready_for_simulation){
+		solveCouplings(false);
+		manageEventNotification();
+		publishOutputs();
+	}
+}
+
+/*
+ * values are passed to the FMUs in one call per FMU, in the order of the transaction (the handles
+ * have the given type; booleans are passed as integers, like in the other setters)
+ */
+template<typename T> void MasterFMI::setBatch(const std::vector<std::pair<port_handle,T>>& inputs, FMIVariableType type, std::vector<bool>& touched){
+
+	// the inputs are visited by FMU through their indexes, sorted by FMU then by rank
+	batch_order.resize(inputs.size());
+	for(std::size_t i = 0; i < inputs.size(); i++)
+		batch_order[i] = i;
+	std::sort(batch_order.begin(), batch_order.end(), [&inputs](std::size_t a, std::size_t b) {
+		return inputs[a].first.fmu < inputs[b].first.fmu || (inputs[a].first.fmu == inputs[b].first.fmu && a < b);
+	});
+
+	std::vector<fmiValueReference> valrefs;
+	std::vector<T> values;
+	std::size_t i = 0;
+	while(i < batch_order.size()){
+		std::size_t fmu = inputs[batch_order[i]].first.fmu;
+		FMUCoSimulationBase* model = nullptr;
+		valrefs.clear();
+		values.clear();
+		for(; i < batch_order.size() && inputs[batch_order[i]].first.fmu == fmu; i++){
+			const std::pair<port_handle,T>& input = inputs[batch_order[i]];
+			const port_handle& handle = input.first;
+			model = checkHandle(handle, type, true);
+			recordInput(handle.p.fmu, handle.p.name, input.second);
+			if(handle.valref == fmiValueReference(-1)){
+				// FMI 3.0 array elements are set one by one
+				if(model->setValue(handle.p.name, input.second) != fmiOK)
+					xbt_die("FMU %s failed to set its port %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+				continue;
+			}
+			valrefs.push_back(handle.valref);
+			values.push_back(input.second);
+		}
+		if(!valrefs.empty() && model->setValue(valrefs.data(), values.data(), valrefs.size()) != fmiOK)
+			xbt_die("FMU %s failed to set %zu of its inputs",fmu_table_names[fmu].c_str(),valrefs.size());
+		touched[fmu] = true;
+	}
+}
+
+void MasterFMI::commitInputs(const InputTransaction& transaction){
+
+	settle();
+	catchUp();
+	checkInputTime();
+
+	std::vector<bool> touched(fmu_table.size(), false);
+
+	setBatch(transaction.reals, FMIVariableType::fmiTypeReal, touched);
+	setBatch(transaction.integers, FMIVariableType::fmiTypeInteger, touched);
+	std::vector<std::pair<port_handle,fmiInteger>> booleans;
+	for(const std::pair<port_handle,bool>& input : transaction.booleans)
+		booleans.push_back(std::make_pair(input.first, (fmiInteger) input.second));
+	setBatch(booleans, FMIVariableType::fmiTypeBoolean, touched);
+	setBatch(transaction.strings, FMIVariableType::fmiTypeString, touched);
+
+	for(std::size_t fmu = 0; fmu < fmu_table.size(); fmu++){
+		if(touched[fmu] && fmu_table_iterate_input[fmu])
+			iterateInput(fmu);
+	}
+
+	if(ready_for_simulation){
+		solveCouplings(false);
+		manageEventNotification();
+		publishOutputs();
+	}
+}
+
+double MasterFMI::getRealOutput(const port_handle& handle){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeReal, false);
+	double out;
+	if(!histories.empty() && interpolate(handle.p, SIMIX_get_clock(), &out))
+		return out;
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, out) : model->getValue(handle.p.name, out);
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+	return out;
+}
+
+bool MasterFMI::getBooleanOutput(const port_handle& handle){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeBoolean, false);
+	fmi2Boolean out;
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, out) : model->getValue(handle.p.name, out);
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+	return out;
+}
+
+int MasterFMI::getIntegerOutput(const port_handle& handle){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeInteger, false);
+	int out;
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, out) : model->getValue(handle.p.name, out);
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+	return out;
+}
+
+std::string MasterFMI::getStringOutput(const port_handle& handle){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeString, false);
+	std::string out;
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, out) : model->getValue(handle.p.name, out);
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+	return out;
+}
+
+void MasterFMI::setRealInput(const port_handle& handle, double value){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeReal, true);
+	catchUp();
+	checkInputTime(handle.p.fmu, handle.p.name);
+	recordInput(handle.p.fmu, handle.p.name, value);
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->setValue(handle.valref, value) : model->setValue(handle.p.name, value);
+	if(status != fmiOK)
+		xbt_die("FMU %s failed to set its port %s to value %f",handle.p.fmu.c_str(),handle.p.name.c_str(),value);
+	inputChanged(handle);
+}
+
+void MasterFMI::setBooleanInput(const port_handle& handle, bool value){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeBoolean, true);
+	catchUp();
+	checkInputTime(handle.p.fmu, handle.p.name);
+	fmiInteger v = value;
+	recordInput(handle.p.fmu, handle.p.name, (int) v);
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->setValue(handle.valref, v) : model->setValue(handle.p.name, v);
+	if(status != fmiOK)
+		xbt_die("FMU %s failed to set its port %s to value %i",handle.p.fmu.c_str(),handle.p.name.c_str(),value);
+	inputChanged(handle);
+}
+
+void MasterFMI::setIntegerInput(const port_handle& handle, int value){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeInteger, true);
+	catchUp();
+	checkInputTime(handle.p.fmu, handle.p.name);
+	recordInput(handle.p.fmu, handle.p.name, value);
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->setValue(handle.valref, value) : model->setValue(handle.p.name, value);
+	if(status != fmiOK)
+		xbt_die("FMU %s failed to set its port %s to value %i",handle.p.fmu.c_str(),handle.p.name.c_str(),value);
+	inputChanged(handle);
+}
+
+void MasterFMI::setStringInput(const port_handle& handle, const std::string& value){
+	settle();
+	FMUCoSimulationBase* model = checkHandle(handle, FMIVariableType::fmiTypeString, true);
+	catchUp();
+	checkInputTime(handle.p.fmu, handle.p.name);
+	recordInput(handle.p.fmu, handle.p.name, value);
+	fmiStatus status = (handle.valref != fmiValueReference(-1)) ? model->setValue(handle.valref, value) : model->setValue(handle.p.name, value);
+	if(status != fmiOK)
+		xbt_die("FMU %s failed to set its port %s to value %s",handle.p.fmu.c_str(),handle.p.name.c_str(),value.c_str());
+	inputChanged(handle);
+}
+
+void MasterFMI::iterateInput(std::string fmi_name){
+	iterateInput(fmu_indexes[fmi_name]);
+}
+
+void MasterFMI::iterateInput(std::size_t fmu){
+
+	std::chrono::steady_clock::time_point start;
+	if(collect_statistics)
+		start = std::chrono::steady_clock::now();
+
+	recordIterate(fmu);
+	fmiStatus status = fmu_table[fmu]->doStep(current_time, 0., fmiTrue );
+	// nothing to retry for a zero-length step: the input is taken into account by the next step
+	if(status == fmiWarning || status == fmiDiscard)
+		XBT_WARN("FMU %s returned %s to the doStep(dt=0) following an input change at time %f",
+				fmu_table_names[fmu].c_str(), status == fmiWarning ? "a warning" : "a discard", current_time);
+	else if(status != fmiOK)
+		xbt_die("FMU %s failed to perform a doStep(dt=0) after setting an input (you should may be set iterateAfterInput=false when adding the FMU CS).",fmu_table_names[fmu].c_str());
+
+	if(collect_statistics){
+		fmu_statistics &fmu_stats = statistics.fmus[fmu_table_names[fmu]];
+		fmu_stats.zero_steps++;
+		if(status != fmiOK)
+			fmu_stats.warnings++;
+		fmu_stats.doStep_time += elapsedSince(start);
 	}
 }
 
 void MasterFMI::solveCouplings(bool firstIteration){
 
+	std::chrono::steady_clock::time_point start;
+	if(collect_statistics)
+		start = std::chrono::steady_clock::now();
+
+	recordCoupling(firstIteration);
+	bool paused = trace_paused;
+	trace_paused = true;
+
 	bool change = true;
 	int i = 0;
 	while(change){
 		change = false;
-		for(port in : in_coupled_input){
+		for(const port& in : in_coupled_input){
 			change = (solveCoupling(in, couplings[in],!firstIteration) || change);
 		}
+		for(const port& in : in_array_coupled_input){
+			change = (solveArrayCoupling(in, array_couplings[in],!firstIteration) || change);
+		}
+		for(std::size_t c = 0; c < transformed_couplings.size(); c++){
+			change = (solveTransformedCoupling(c, !firstIteration) || change);
+		}
 		if(firstIteration)
 			firstIteration = false;
 		i++;
 	}
+	trace_paused = paused;
+
+	if(collect_statistics){
+		statistics.coupling_solves++;
+		statistics.coupling_sweeps += i;
+		statistics.coupling_time += elapsedSince(start);
+	}
 
 	logOutput();
+	publishTelemetry();
 }
 
-bool MasterFMI::solveCoupling(port in, port out, bool checkChange){
+bool MasterFMI::solveCoupling(const port& in, const port& out, bool checkChange){
 
 	bool change = false;
 
@@ -458,10 +1458,11 @@ bool MasterFMI::solveCoupling(port in, port out, bool checkChange){
 		}
 		case FMIVariableType::fmiTypeString:
 		{
-			std::string s_out = getStringOutput(out.fmu, out.name);
-			if( !checkChange || s_out != last_string_outputs[out]){
-				setStringInput(in.fmu, in.name, s_out,false);
-				last_string_outputs[out] = s_out;
+			readStringOutput(out.fmu, out.name, string_buffer);
+			std::string& last = last_string_outputs[out];
+			if( !checkChange || string_buffer != last){
+				setStringInput(in.fmu, in.name, string_buffer,false);
+				last = string_buffer;
 				change = true;
 			}
 			break;
@@ -471,59 +1472,725 @@ bool MasterFMI::solveCoupling(port in, port out, bool checkChange){
 	return change;
 }
 
+bool MasterFMI::solveArrayCoupling(const port& in, const port& out, bool checkChange){
+
+	readRealArrayOutput(out.fmu, out.name, array_buffer);
+	std::vector<double>& last = last_array_outputs[out];
+	if( !checkChange || array_buffer != last){
+		setRealArrayInput(in.fmu, in.name, array_buffer, false);
+		last = array_buffer;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * value of a real, integer or boolean output, read directly from its FMU (neither settled nor interpolated)
+ */
+double MasterFMI::readNumericOutput(const port_handle& handle){
+
+	FMUCoSimulationBase* model = fmu_table[handle.fmu];
+	fmiStatus status;
+	double value;
+	if(handle.type == FMIVariableType::fmiTypeReal){
+		status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, value) : model->getValue(handle.p.name, value);
+	}else{
+		// booleans go through the integer overload
+		fmiInteger out;
+		status = (handle.valref != fmiValueReference(-1)) ? model->getValue(handle.valref, out) : model->getValue(handle.p.name, out);
+		value = (handle.type == FMIVariableType::fmiTypeBoolean) ? (out != 0) : out;
+	}
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",handle.p.fmu.c_str(),handle.p.name.c_str());
+	return value;
+}
+
+/**
+ * read the sources of a transformed coupling, aggregate them and send the transformed result to its input
+ */
+bool MasterFMI::solveTransformedCoupling(std::size_t i, bool checkChange){
+
+	const transformed_coupling& coupling = transformed_couplings[i];
+	double* values = transformed_values.data() + coupling.first;
+	for(std::size_t k = 0; k < coupling.count; k++)
+		values[k] = readNumericOutput(transformed_sources[coupling.first + k]);
+
+	double value = values[0];
+	switch(coupling.operation){
+		case fan_in_operation::SUM:
+		case fan_in_operation::MEAN:
+			for(std::size_t k = 1; k < coupling.count; k++)
+				value += values[k];
+			if(coupling.operation == fan_in_operation::MEAN)
+				value /= coupling.count;
+			break;
+		case fan_in_operation::MAX:
+			for(std::size_t k = 1; k < coupling.count; k++)
+				value = std::max(value, values[k]);
+			break;
+		case fan_in_operation::MIN:
+			for(std::size_t k = 1; k < coupling.count; k++)
+				value = std::min(value, values[k]);
+			break;
+	}
+	value = coupling.transform.apply(value);
+
+	if(checkChange && value == last_transformed_inputs[i])
+		return false;
+
+	const port_handle& in = coupling.in;
+	recordInput(in.p.fmu, in.p.name, value);
+	FMUCoSimulationBase* model = fmu_table[in.fmu];
+	fmiStatus status = (in.valref != fmiValueReference(-1)) ? model->setValue(in.valref, value) : model->setValue(in.p.name, value);
+	if(status != fmiOK)
+		xbt_die("FMU %s failed to set its port %s to value %f",in.p.fmu.c_str(),in.p.name.c_str(),value);
+	if(fmu_table_iterate_input[in.fmu])
+		iterateInput(in.fmu);
+	last_transformed_inputs[i] = value;
+	return true;
+}
+
 void MasterFMI::solveExternalCoupling(){
 
-	for(real_simgrid_fmu_connection coupling : real_ext_couplings){
+	std::chrono::steady_clock::time_point start;
+	if(collect_statistics)
+		start = std::chrono::steady_clock::now();
+
+	last_real_ext_inputs.clear();
+	for(const real_simgrid_fmu_connection& coupling : real_ext_couplings){
 		double input = coupling.generateInput(coupling.params);
 		setRealInput(coupling.in.fmu, coupling.in.name, input,false);
+		last_real_ext_inputs.push_back(input);
 	}
 
-	for(integer_simgrid_fmu_connection coupling : integer_ext_couplings){
+	last_int_ext_inputs.clear();
+	for(const integer_simgrid_fmu_connection& coupling : integer_ext_couplings){
 		int input = coupling.generateInput(coupling.params);
 		setIntegerInput(coupling.in.fmu, coupling.in.name, input,false);
+		last_int_ext_inputs.push_back(input);
 	}
 
-	for(boolean_simgrid_fmu_connection coupling : boolean_ext_couplings){
+	last_bool_ext_inputs.clear();
+	for(const boolean_simgrid_fmu_connection& coupling : boolean_ext_couplings){
 		bool input = coupling.generateInput(coupling.params);
 		setBooleanInput(coupling.in.fmu, coupling.in.name, input,false);
+		last_bool_ext_inputs.push_back(input);
 	}
 
-	for(string_simgrid_fmu_connection coupling : string_ext_couplings){
-		std::string input = coupling.generateInput(coupling.params);
-		setStringInput(coupling.in.fmu, coupling.in.name, input,false);
+	// the previous strings are overwritten in place, to reuse their buffers
+	last_string_ext_inputs.resize(string_ext_couplings.size());
+	for(std::size_t i = 0; i < string_ext_couplings.size(); i++){
+		const string_simgrid_fmu_connection& coupling = string_ext_couplings[i];
+		last_string_ext_inputs[i] = coupling.generateInput(coupling.params);
+		setStringInput(coupling.in.fmu, coupling.in.name, last_string_ext_inputs[i],false);
+	}
+
+	for(host_group_power& group : host_groups){
+		if(updateHostGroupPower(group) || !group.sent){
+			setRealInput(group.in.fmu, group.in.name, group.total, false);
+			group.sent = true;
+		}
+	}
+
+	if(collect_statistics){
+		statistics.external_coupling_solves++;
+		statistics.external_coupling_time += elapsedSince(start);
+	}
+}
+
+
+void MasterFMI::advance(double now, double step){
+
+	while(current_time < now){
+		stepFMUs(std::min(step, now - current_time));
+		if(current_time != now){
+			solveCouplings(true);
+		}
 	}
 }
 
+/**
+ * perform one step of every FMU, from current_time to current_time+dt
+ */
+void MasterFMI::stepFMUs(double dt){
+
+	XBT_DEBUG("current_time = %f perform doStep of %f ",current_time, dt);
+	recordStep(dt);
+	fmus_started = true;
+
+	// the workers and the parallel groups step in parallel while the local FMUs are stepped
+	for(auto& it : remote_fmus)
+		it.second->startStep(current_time, dt);
+	for(auto& it : fmu_groups){
+		if(it.second->isParallel())
+			it.second->startStep(current_time, dt);
+	}
+
+	step_states.resize(fmu_table.size(), nullptr);
+	for(std::size_t i = 0; i < fmu_table.size(); i++){
+		const std::string& name = fmu_table_names[i];
+		FMUCoSimulationBase* model = fmu_table[i];
+		std::chrono::steady_clock::time_point start;
+		if(collect_statistics)
+			start = std::chrono::steady_clock::now();
+
+		fmiStatus status;
+		bool saved = false;
+		auto remote = remote_fmus.find(name);
+		auto group = fmu_groups.empty() ? fmu_groups.end() : fmu_groups.find(name);
+		if(remote != remote_fmus.end()){
+			status = remote->second->finishStep();
+		}else if(group != fmu_groups.end() && group->second->isParallel()){
+			status = group->second->joinStep();
+		}else{
+			saved = saveStepState(model, &step_states[i]);
+			status = model->doStep(current_time, dt, fmiTrue );
+		}
+		if(status != fmiOK || saved)
+			status = retryStep(name, model, saved ? step_states[i] : nullptr, current_time, dt, status, 0);
+		if(status != fmiOK)
+			xbt_die("FMU %s failed to go from time %f to time %f during the co-simulation",name.c_str(),current_time,(current_time+dt));
+
+		if(collect_statistics){
+			fmu_statistics &fmu_stats = statistics.fmus[name];
+			fmu_stats.steps++;
+			fmu_stats.doStep_time += elapsedSince(start);
+		}
+	}
+	// the SimGrid side of the groups, once no group is stepping in a thread anymore
+	for(auto& it : fmu_groups)
+		it.second->finishStep();
+	current_time += dt;
+	if(collect_statistics)
+		statistics.steps++;
+	for(auto& it : histories)
+		recordHistory(it.first, it.second);
+	accumulateOutputs();
+}
 
 void MasterFMI::update_actions_state(double now, double delta){
 
 	XBT_DEBUG("updating the FMUs at time = %f, delta = %f",now,delta);
 
-	while(current_time < now){
-		double dt = std::min(commStep, now - current_time);
-		XBT_DEBUG("current_time = %f perform doStep of %f ",current_time, dt);
-		for(auto it : fmus){
-			fmiStatus status = it.second->doStep(current_time, dt, fmiTrue );
-			if(status != fmiOK)
-				xbt_die("FMU %s failed to go from time %f to time %f during the co-simulation",it.first.c_str(),current_time,(current_time+dt));
-		}
-		current_time += dt;
-		if(current_time != now){
+	// in lazy mode, the FMUs are left behind until they are observed, or until they reach a horizon
+	// where the events, waits, output log, telemetry, bindings and groups sample them (the snapshot is
+	// read without the master, so that it needs every update)
+	if(lazy && snapshot_ports.empty()){
+		bool sampled = hasObservers() && catchUpToHorizon(now);
+		bool changed = lazyExternalCoupling(now);
+		lazy_target = now;
+		if(changed){
 			solveCouplings(true);
+			manageEventNotification();
 		}
+		if(sampled || changed)
+			applyResourceBindings();
+		return;
 	}
 
+	double target = gridTime(now);
+	commitSpeculation(target);
+	advance(target, commStep);
+
 	solveExternalCoupling();
 	solveCouplings(true);
 	manageEventNotification();
+	applyResourceBindings();
+	publishOutputs();
+
+	startSpeculation();
+}
+
+/**
+ * save the state of an FMU before a step that may be retried, in *state (reused if not nullptr).
+ * Return false if retries are disabled or if the FMU can not save its state.
+ */
+bool MasterFMI::saveStepState(FMUCoSimulationBase* model, void** state){
+
+	if(step_retry_depth <= 0)
+		return false;
+
+	StatefulModel* stateful = dynamic_cast<StatefulModel*>(model);
+	return stateful != nullptr && stateful->canSaveState() && stateful->saveState(state) == fmiOK;
+}
+
+/**
+ * free the states saved before the steps of the FMUs (before they are deleted or replaced)
+ */
+void MasterFMI::freeStepStates(){
+	for(std::size_t i = 0; i < step_states.size(); i++){
+		if(step_states[i] != nullptr)
+			dynamic_cast<StatefulModel*>(fmu_table[i])->freeState(step_states[i]);
+	}
+	step_states.clear();
+}
+
+/**
+ * step an FMU from time to time+dt, retrying the step if it is discarded
+ */
+fmiStatus MasterFMI::subStep(const std::string& fmu_name, FMUCoSimulationBase* model, double time, double dt, int depth){
+	void* state = nullptr;
+	bool saved = saveStepState(model, &state);
+	fmiStatus status = model->doStep(time, dt, fmiTrue );
+	status = retryStep(fmu_name, model, saved ? state : nullptr, time, dt, status, depth);
+	if(state != nullptr)
+		dynamic_cast<StatefulModel*>(model)->freeState(state);
+	return status;
+}
+
+/**
+ * handle the status of a step of an FMU from time to time+dt (state is the state saved before it, if any,
+ * still owned by the caller): a warning is accepted, and a discarded step is resumed from the last successful
+ * time reported by the FMU, or rolled back and split in two halves, as long as depth is lower than step_retry_depth
+ */
+fmiStatus MasterFMI::retryStep(const std::string& fmu_name, FMUCoSimulationBase* model, void* state, double time, double dt, fmiStatus status, int depth){
+
+	if(status == fmiWarning){
+		XBT_WARN("FMU %s returned a warning while going from time %f to time %f",fmu_name.c_str(),time,(time+dt));
+		if(collect_statistics)
+			statistics.fmus[fmu_name].warnings++;
+		status = fmiOK;
+	}
+
+	if(status == fmiDiscard && depth < step_retry_depth){
+		// only FMI 3.0 FMUs report the last successful time of a discarded step (fmipp does not expose
+		// fmi2GetRealStatus, and the other models stay at the start of the step)
+		double reached = (dynamic_cast<FMU3CoSimulation*>(model) != nullptr) ? model->getTime() : time;
+		// (the tolerance ignores an FMU time that differs from the master time by rounding)
+		double tolerance = dt * 1e-6;
+		if(reached > time + tolerance && reached < time + dt - tolerance){
+			XBT_DEBUG("FMU %s stopped at time %f instead of %f, resuming",fmu_name.c_str(),reached,(time+dt));
+			if(collect_statistics)
+				statistics.fmus[fmu_name].retried_steps++;
+			status = subStep(fmu_name, model, reached, time + dt - reached, depth + 1);
+		}else if(state != nullptr){
+			XBT_DEBUG("FMU %s discarded its step from time %f to time %f, splitting it",fmu_name.c_str(),time,(time+dt));
+			if(dynamic_cast<StatefulModel*>(model)->restoreState(state) != fmiOK)
+				xbt_die("FMU %s failed to restore its state at time %f",fmu_name.c_str(),time);
+			if(collect_statistics)
+				statistics.fmus[fmu_name].retried_steps++;
+			double half = dt / 2;
+			status = subStep(fmu_name, model, time, half, depth + 1);
+			if(status == fmiOK)
+				status = subStep(fmu_name, model, time + half, dt - half, depth + 1);
+		}
+	}
+
+	return status;
+}
 
+void MasterFMI::setStepRetry(int max_depth){
+	step_retry_depth = std::max(0, max_depth);
+	updateStateRestores();
+	for(std::size_t i = 0; i < fmu_table.size(); i++)
+		checkStepRetry(i);
+}
+
+/**
+ * warn when the steps are retried but those of an FMU can not be: the FMI 1.0/2.0 FMUs loaded by fmipp
+ * and the FMU workers give no access to their state nor to the last successful time
+ */
+void MasterFMI::checkStepRetry(std::size_t fmu){
+	FMUCoSimulationBase* model = fmu_table[fmu];
+	if(step_retry_depth > 0 && dynamic_cast<FMU3CoSimulation*>(model) == nullptr
+			&& dynamic_cast<NativeModel*>(model) == nullptr && dynamic_cast<FMUGroup*>(model) == nullptr)
+		XBT_WARN("the discarded steps of FMU %s can not be retried: the simulation stops on its first discard",fmu_table_names[fmu].c_str());
+}
+
+/**
+ * tell the FMUs whether the master may restore a state saved before their current point
+ */
+void MasterFMI::updateStateRestores(){
+	for(FMUCoSimulationBase* model : fmu_table){
+		if(StatefulModel* stateful = dynamic_cast<StatefulModel*>(model))
+			stateful->allowStateRestores(speculative || step_retry_depth > 0);
+	}
+}
+
+/**
+ * save the state of every FMU and compute the next communication step in a background thread
+ */
+void MasterFMI::startSpeculation(){
+
+	if(!speculative || lazy || speculating)
+		return;
+
+	spec_time = current_time;
+	speculating = true;
+	speculation = std::thread([this](){
+		for(std::size_t i = 0; i < fmu_table.size(); i++){
+			spec_states[i] = nullptr;
+			spec_status[i] = dynamic_cast<StatefulModel*>(fmu_table[i])->saveState(&spec_states[i]);
+			if(spec_status[i] == fmiOK)
+				spec_status[i] = fmu_table[i]->doStep(spec_time, commStep, fmiTrue);
+		}
+	});
+}
+
+/**
+ * keep the speculative step if the FMUs have to go at least one full step ahead of the time it
+ * started from, roll it back otherwise. Return true if the step is kept.
+ */
+bool MasterFMI::commitSpeculation(double now){
+
+	if(!speculating)
+		return false;
+
+	// the tolerance absorbs the rounding of the SimGrid clock
+	if(current_time != spec_time || now - current_time < commStep * (1 - 1e-9)){
+		settle();
+		return false;
+	}
+
+	speculation.join();
+	for(std::size_t i = 0; i < fmu_table.size(); i++){
+		if(spec_status[i] != fmiOK){
+			XBT_DEBUG("speculative step of FMU %s failed",fmu_table_names[i].c_str());
+			settle();
+			return false;
+		}
+	}
+	speculating = false;
+
+	XBT_DEBUG("speculative step from time %f kept",current_time);
+	// replayed as a regular step, which gives the same result
+	recordStep(commStep);
+	for(std::size_t i = 0; i < fmu_table.size(); i++){
+		dynamic_cast<StatefulModel*>(fmu_table[i])->freeState(spec_states[i]);
+		spec_states[i] = nullptr;
+		if(collect_statistics)
+			statistics.fmus[fmu_table_names[i]].steps++;
+	}
+	current_time += commStep;
+	if(collect_statistics){
+		statistics.steps++;
+		statistics.speculation_hits++;
+	}
+	for(auto& it : histories)
+		recordHistory(it.first, it.second);
+	accumulateOutputs();
+	if(current_time != now){
+		solveCouplings(true);
+	}
+	return true;
+}
+
+/**
+ * wait for the running speculative step and roll the FMUs back to the state it started from
+ */
+void MasterFMI::settle(){
+
+	if(!speculating)
+		return;
+
+	if(speculation.joinable())
+		speculation.join();
+	speculating = false;
+
+	for(std::size_t i = 0; i < fmu_table.size(); i++){
+		if(spec_states[i] == nullptr)
+			continue;
+		StatefulModel* model = dynamic_cast<StatefulModel*>(fmu_table[i]);
+		if(model->restoreState(spec_states[i]) != fmiOK)
+			xbt_die("FMU %s failed to roll back its speculative step",fmu_table_names[i].c_str());
+		model->freeState(spec_states[i]);
+		spec_states[i] = nullptr;
+	}
+	XBT_DEBUG("speculative step from time %f rolled back",spec_time);
+	if(collect_statistics)
+		statistics.speculation_misses++;
+}
+
+void MasterFMI::enableSpeculation(bool enable){
+
+	settle();
+	if(enable){
+		if(!remote_fmus.empty())
+			xbt_die("FMUs running in a worker process can not be stepped speculatively");
+		for(std::size_t i = 0; i < fmu_table.size(); i++){
+			StatefulModel* model = dynamic_cast<StatefulModel*>(fmu_table[i]);
+			if(model == nullptr || !model->canSaveState())
+				xbt_die("FMU %s can not save its state: it can not be stepped speculatively",fmu_table_names[i].c_str());
+		}
+		spec_states.assign(fmu_table.size(), nullptr);
+		spec_status.assign(fmu_table.size(), fmiOK);
+	}
+	speculative = enable;
+	updateStateRestores();
+}
+
+/**
+ * true if the FMUs are ahead of the SimGrid clock, i.e. already stepped up to the next point of the
+ * communication grid to interpolate outputs
+ */
+bool MasterFMI::isAhead(){
+	return check_input_time && !histories.empty() && current_time > SIMIX_get_clock() + commStep * 1e-9;
+}
+
+/**
+ * an input set by an actor while the FMUs are ahead of the SimGrid clock is deferred to the grid point
+ * they reached, like the inputs coupled to the SimGrid models: it holds from there on. Any input set by
+ * an actor also marks the FMUs as started (see resetFMU).
+ */
+void MasterFMI::checkInputTime(const std::string& fmi_name, const std::string& input_name){
+	fmus_started = true;
+	if(!isAhead())
+		return;
+	XBT_DEBUG("input %s of FMU %s set at time %f is applied at time %f",input_name.c_str(),fmi_name.c_str(),SIMIX_get_clock(),current_time);
+	if(collect_statistics)
+		statistics.deferred_inputs++;
+}
+
+/**
+ * same for the inputs of a transaction, counted once
+ */
+void MasterFMI::checkInputTime(){
+	fmus_started = true;
+	if(!isAhead())
+		return;
+	XBT_DEBUG("inputs set at time %f are applied at time %f",SIMIX_get_clock(),current_time);
+	if(collect_statistics)
+		statistics.deferred_inputs++;
+}
+
+/**
+ * time up to which the FMUs are stepped to be at the given time: the time itself, or the next
+ * point of the communication grid when some outputs are interpolated
+ */
+double MasterFMI::gridTime(double time){
+	if(histories.empty())
+		return time;
+	double grid_time = std::ceil(time / commStep - 1e-9) * commStep;
+	return std::max(grid_time, time);
+}
+
+void MasterFMI::setInterpolation(std::string fmi_name, std::string output_name, int order){
+
+	settle();
+	checkPortValidity(fmi_name, output_name, FMIVariableType::fmiTypeReal, false);
+	port p = {fmi_name, output_name};
+
+	if(order <= 0){
+		histories.erase(p);
+		return;
+	}
+
+	port_history &history = histories[p];
+	history.order = order;
+	history.valref = fmus[fmi_name]->getValueRef(output_name);
+	history.times.clear();
+	history.values.clear();
+	recordHistory(p, history);
+}
+
+void MasterFMI::recordHistory(const port& p, port_history& history){
+
+	double value;
+	FMUCoSimulationBase* model = fmus[p.fmu];
+	fmiStatus status = (history.valref != fmiValueReference(-1)) ? model->getValue(history.valref, value) : model->getValue(p.name, value);
+	if(status != fmiOK)
+		xbt_die("FMI %s failed to return the value of variable %s",p.fmu.c_str(),p.name.c_str());
+
+	if(!history.times.empty() && history.times.back() >= current_time){
+		history.values.back() = value;
+		return;
+	}
+	if(history.times.size() > (std::size_t) history.order){
+		history.times.erase(history.times.begin());
+		history.values.erase(history.values.begin());
+	}
+	history.times.push_back(current_time);
+	history.values.push_back(value);
+}
+
+/**
+ * Lagrange interpolation of the recorded values of an output (false if it is not interpolated)
+ */
+bool MasterFMI::interpolate(const port& p, double time, double* value){
+
+	auto it = histories.find(p);
+	if(it == histories.end() || it->second.times.size() < 2)
+		return false;
+
+	const std::vector<double> &times = it->second.times;
+	const std::vector<double> &values = it->second.values;
+	double result = 0;
+	for(std::size_t i = 0; i < times.size(); i++){
+		double l = 1;
+		for(std::size_t j = 0; j < times.size(); j++){
+			if(j != i)
+				l *= (time - times[j]) / (times[i] - times[j]);
+		}
+		result += l * values[i];
+	}
+	*value = result;
+	return true;
+}
+
+bool MasterFMI::isLagging(){
+	return lazy && current_time < lazy_target;
+}
+
+void MasterFMI::catchUp(){
+	settle();
+	if(current_time >= lazy_target)
+		return;
+	XBT_DEBUG("catching up from time %f to time %f",current_time,lazy_target);
+	advance(gridTime(lazy_target), lazy_step);
+	solveCouplings(true);
+}
+
+/**
+ * true if actors wait on this master or on one of its groups (events or waits), which then needs every step
+ */
+bool MasterFMI::hasEvents(){
+	if(!event_handlers.empty() || !output_waits.empty() || !condition_waits.empty())
+		return true;
+	for(auto& it : fmu_groups){
+		if(it.second->getMaster()->hasEvents())
+			return true;
+	}
+	return false;
+}
+
+/**
+ * true if something samples the FMUs at every update: events, waits, output log, telemetry, resource
+ * bindings or groups (in lazy mode, they sample them at the horizons instead)
+ */
+bool MasterFMI::hasObservers(){
+	return hasEvents() || output.is_open() || telemetry != nullptr || !resource_bindings.empty() || !fmu_groups.empty();
+}
+
+/**
+ * last horizon of the lazy mode before time: the observers sample the FMUs at the multiples of lazy_step
+ */
+double MasterFMI::lazyHorizon(double time){
+	return std::floor(time / lazy_step + 1e-9) * lazy_step;
+}
+
+/**
+ * in lazy mode, advance the FMUs up to the last horizon before now if they are behind it, writing
+ * the output log at each step, then check the events and waits there. Return true if they moved.
+ */
+bool MasterFMI::catchUpToHorizon(double now){
+	double horizon = lazyHorizon(now);
+	if(horizon <= current_time)
+		return false;
+	XBT_DEBUG("catching up from time %f to the horizon %f",current_time,horizon);
+	advance(gridTime(horizon), lazy_step);
+	solveExternalCoupling();
+	solveCouplings(true);
+	manageEventNotification();
+	return true;
+}
+
+void MasterFMI::enableLazyMode(bool enable, double max_step){
+	settle();
+	catchUp();
+	lazy = enable;
+	lazy_step = (max_step > 0) ? max_step : commStep;
+	lazy_target = current_time;
+}
+
+/*
+ * the SimGrid side is sampled at each update: when an input changes, the FMUs first
+ * catch up with the old value (which held until now), then the new value is applied
+ */
+bool MasterFMI::lazyExternalCoupling(double now){
+
+	bool changed = false;
+	std::size_t i = 0;
+
+	for(const real_simgrid_fmu_connection& coupling : real_ext_couplings){
+		double input = coupling.generateInput(coupling.params);
+		if(i >= last_real_ext_inputs.size() || last_real_ext_inputs[i] != input){
+			if(!changed)
+				advance(now, lazy_step);
+			changed = true;
+			setRealInput(coupling.in.fmu, coupling.in.name, input,false);
+			if(i < last_real_ext_inputs.size())
+				last_real_ext_inputs[i] = input;
+			else
+				last_real_ext_inputs.push_back(input);
+		}
+		i++;
+	}
+
+	i = 0;
+	for(const integer_simgrid_fmu_connection& coupling : integer_ext_couplings){
+		int input = coupling.generateInput(coupling.params);
+		if(i >= last_int_ext_inputs.size() || last_int_ext_inputs[i] != input){
+			if(!changed)
+				advance(now, lazy_step);
+			changed = true;
+			setIntegerInput(coupling.in.fmu, coupling.in.name, input,false);
+			if(i < last_int_ext_inputs.size())
+				last_int_ext_inputs[i] = input;
+			else
+				last_int_ext_inputs.push_back(input);
+		}
+		i++;
+	}
+
+	i = 0;
+	for(const boolean_simgrid_fmu_connection& coupling : boolean_ext_couplings){
+		bool input = coupling.generateInput(coupling.params);
+		if(i >= last_bool_ext_inputs.size() || last_bool_ext_inputs[i] != input){
+			if(!changed)
+				advance(now, lazy_step);
+			changed = true;
+			setBooleanInput(coupling.in.fmu, coupling.in.name, input,false);
+			if(i < last_bool_ext_inputs.size())
+				last_bool_ext_inputs[i] = input;
+			else
+				last_bool_ext_inputs.push_back(input);
+		}
+		i++;
+	}
+
+	i = 0;
+	for(const string_simgrid_fmu_connection& coupling : string_ext_couplings){
+		std::string input = coupling.generateInput(coupling.params);
+		if(i >= last_string_ext_inputs.size() || last_string_ext_inputs[i] != input){
+			if(!changed)
+				advance(now, lazy_step);
+			changed = true;
+			setStringInput(coupling.in.fmu, coupling.in.name, input,false);
+			if(i < last_string_ext_inputs.size())
+				last_string_ext_inputs[i] = input;
+			else
+				last_string_ext_inputs.push_back(input);
+		}
+		i++;
+	}
+
+	for(host_group_power& group : host_groups){
+		if(updateHostGroupPower(group) || !group.sent){
+			if(!changed)
+				advance(now, lazy_step);
+			changed = true;
+			setRealInput(group.in.fmu, group.in.name, group.total, false);
+			group.sent = true;
+		}
+	}
+
+	return changed;
 }
 
 void MasterFMI::initCouplings(){
+	// the groups are ready first, as the couplings of this master read their outputs
+	for(auto& it : fmu_groups){
+		if(!it.second->getMaster()->ready_for_simulation)
+			it.second->getMaster()->initCouplings();
+	}
+	recordReady();
 	ready_for_simulation = true;
 	solveExternalCoupling();
 	solveCouplings(true);
+	accumulateOutputs();
 	manageEventNotification();
+	applyResourceBindings();
+	publishOutputs();
 }
 
 double MasterFMI::next_occuring_event(double now){
@@ -531,19 +2198,29 @@ double MasterFMI::next_occuring_event(double now){
 	if(firstEvent){
 		firstEvent = false;
 		return 0;
-	}else if(event_handlers.size()==0){
+	}else if(!hasEvents()){
 		return -1;
+	}else if(lazy && snapshot_ports.empty()){
+		// the events and waits are checked at the next horizon
+		return lazyHorizon(now) + lazy_step - now;
 	}else{
 		return commStep;
 	}
 }
 
 
-void MasterFMI::registerEvent(bool (*condition)(std::vector<std::string>),
-	void (*handleEvent)(std::vector<std::string>),
+void MasterFMI::registerEvent(std::function<bool(const std::vector<std::string>&)> condition,
+	std::function<void(const std::vector<std::string>&)> handleEvent,
 	std::vector<std::string> handlerParam){
 
+	catchUp();
+
+	if(collect_statistics)
+		statistics.event_conditions_evaluated++;
+
 	if(condition(handlerParam)){
+		if(collect_statistics)
+			statistics.events_fired++;
 		handleEvent(handlerParam);
 	}else{
 		event_handlers.push_back(handleEvent);
@@ -553,22 +2230,176 @@ void MasterFMI::registerEvent(bool (*condition)(std::vector<std::string>),
 }
 
 void MasterFMI::manageEventNotification(){
+
+	std::chrono::steady_clock::time_point start;
+	if(collect_statistics){
+		start = std::chrono::steady_clock::now();
+		statistics.event_conditions_evaluated += event_handlers.size();
+	}
+
 	int size = event_handlers.size();
 	for(int i = 0;i<event_handlers.size();i++){
 
-		bool isEvent = (*event_conditions[i])(event_params[i]);
+		bool isEvent = event_conditions[i](event_params[i]);
 		if(isEvent){
 
+			if(collect_statistics)
+				statistics.events_fired++;
+
 			event_conditions.erase(event_conditions.begin()+i);
-			void (*handleEvent)(std::vector<std::string>) = event_handlers[i];
+			std::function<void(const std::vector<std::string>&)> handleEvent = std::move(event_handlers[i]);
 			event_handlers.erase(event_handlers.begin()+i);
-			std::vector<std::string> handlerParam = event_params[i];
+			std::vector<std::string> handlerParam = std::move(event_params[i]);
 			event_params.erase(event_params.begin()+i);
 			i--;
 
-			(*handleEvent)(handlerParam);
+			handleEvent(handlerParam);
 		}
 	}
+
+	notifyWaits();
+
+	if(collect_statistics)
+		statistics.event_time += elapsedSince(start);
+}
+
+/**
+ * true if parameters has a value for a port of the FMU fmu_name
+ */
+static bool hasParameters(const std::string& fmu_name, const fmu_parameters& parameters){
+	for(auto& it : parameters.reals){
+		if(it.first.fmu == fmu_name)
+			return true;
+	}
+	for(auto& it : parameters.integers){
+		if(it.first.fmu == fmu_name)
+			return true;
+	}
+	for(auto& it : parameters.booleans){
+		if(it.first.fmu == fmu_name)
+			return true;
+	}
+	for(auto& it : parameters.strings){
+		if(it.first.fmu == fmu_name)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * reset the FMU fmu_name with the given parameters. If keep_unchanged, the FMUs are still in the state
+ * of their initialization at start_time, and those without parameters are kept as they are (native
+ * models are still reset, so that start() is called again, and groups reset their own FMUs)
+ */
+void MasterFMI::resetFMU(std::string fmu_name, double start_time, const fmu_parameters &parameters, bool keep_unchanged){
+
+	FMUCoSimulationBase* model = fmus[fmu_name];
+	fmiStatus status = fmiOK;
+
+	if(keep_unchanged && dynamic_cast<NativeModel*>(model) == nullptr && dynamic_cast<FMUGroup*>(model) == nullptr
+			&& !hasParameters(fmu_name, parameters)){
+		XBT_DEBUG("FMU %s is kept in the state of its initialization",fmu_name.c_str());
+		return;
+	}
+
+	if(FMU3CoSimulation* fmu3 = dynamic_cast<FMU3CoSimulation*>(model)){
+		status = fmu3->reset();
+	}else if(RemoteFMU* remote = dynamic_cast<RemoteFMU*>(model)){
+		status = remote->reset();
+	}else if(FMUGroup* group = dynamic_cast<FMUGroup*>(model)){
+		// the FMUs of a group are reset by its own master, with their parameters
+		group->reset(fmu_name, parameters);
+		return;
+	}else if(fmu_uris.find(fmu_name) != fmu_uris.end()){
+		// the binaries and the model description are kept by the ModelManager
+		delete model;
+		model = loadFMU(fmu_uris[fmu_name], fmu_name);
+		if(model == nullptr)
+			xbt_die("can not reload FMU %s",fmu_name.c_str());
+		fmus[fmu_name] = model;
+		fmu_table[fmu_indexes[fmu_name]] = model;
+		status = model->instantiate(fmu_name, 0, fmiFalse, fmiFalse);
+	}else if(NativeModel* native = dynamic_cast<NativeModel*>(model)){
+		// the ports get back their start values, then NativeModel::start is called again by initialize
+		native->reset();
+	}
+
+	if(status != fmiOK)
+		xbt_die("can not reset FMU %s",fmu_name.c_str());
+
+	for(auto it : parameters.reals){
+		if(it.first.fmu == fmu_name && model->setValue(it.first.name, it.second) != fmiOK)
+			xbt_die("can not set parameter %s of FMU %s",it.first.name.c_str(),fmu_name.c_str());
+	}
+	for(auto it : parameters.integers){
+		if(it.first.fmu == fmu_name && model->setValue(it.first.name, (fmiInteger) it.second) != fmiOK)
+			xbt_die("can not set parameter %s of FMU %s",it.first.name.c_str(),fmu_name.c_str());
+	}
+	for(auto it : parameters.booleans){
+		fmiInteger value = it.second;
+		if(it.first.fmu == fmu_name && model->setValue(it.first.name, value) != fmiOK)
+			xbt_die("can not set parameter %s of FMU %s",it.first.name.c_str(),fmu_name.c_str());
+	}
+	for(auto it : parameters.strings){
+		if(it.first.fmu == fmu_name && model->setValue(it.first.name, it.second) != fmiOK)
+			xbt_die("can not set parameter %s of FMU %s",it.first.name.c_str(),fmu_name.c_str());
+	}
+
+	if(model->initialize(start_time, false, -1) != fmiOK)
+		xbt_die("can not initialize FMU %s again",fmu_name.c_str());
+}
+
+void MasterFMI::resetSimulation(fmu_parameters parameters, std::string output_file_path){
+
+	settle();
+	if(trace.is_open()){
+		XBT_WARN("the recording of the inputs stops at the reset of the simulation");
+		stopRecording();
+	}
+	for(auto it : parameters.reals)
+		checkPortValidity(it.first.fmu, it.first.name, FMIVariableType::fmiTypeReal, false);
+	for(auto it : parameters.integers)
+		checkPortValidity(it.first.fmu, it.first.name, FMIVariableType::fmiTypeInteger, false);
+	for(auto it : parameters.booleans)
+		checkPortValidity(it.first.fmu, it.first.name, FMIVariableType::fmiTypeBoolean, false);
+	for(auto it : parameters.strings)
+		checkPortValidity(it.first.fmu, it.first.name, FMIVariableType::fmiTypeString, false);
+
+	const double start_time = SIMIX_get_clock();
+	XBT_DEBUG("reset of the co-simulation at time %f",start_time);
+
+	freeStepStates();
+	const bool keep_unchanged = !fmus_started && start_time == current_time;
+	for(auto it : fmus)
+		resetFMU(it.first, start_time, parameters, keep_unchanged);
+	updateStateRestores();
+	fmus_started = false;
+
+	current_time = start_time;
+	lazy_target = start_time;
+	for(auto& it : histories){
+		it.second.times.clear();
+		it.second.values.clear();
+		recordHistory(it.first, it.second);
+	}
+	last_real_outputs.clear();
+	last_int_outputs.clear();
+	last_bool_outputs.clear();
+	last_string_outputs.clear();
+	last_array_outputs.clear();
+	for(port_accumulator& accumulator : accumulators)
+		accumulator.clear();
+	for(host_group_power& group : host_groups)
+		group.sent = false;
+	for(resource_binding& binding : resource_bindings)
+		binding.applied = false;
+	deleteEvents();
+	cancelWaits();
+
+	if(!output_file_path.empty())
+		configureOutputLog(output_file_path, monitored_ports);
+
+	initCouplings();
 }
 
 void MasterFMI::deleteEvents(){
@@ -582,10 +2413,13 @@ bool MasterFMI::isInputCoupled(std::string fmu, std::string input_name){
 	input.fmu = fmu;
 	input.name = input_name;
 	return std::find(in_coupled_input.begin(), in_coupled_input.end(), input) != in_coupled_input.end()
-			|| std::find(ext_coupled_input.begin(), ext_coupled_input.end(), input) != ext_coupled_input.end();
+			|| std::find(in_array_coupled_input.begin(), in_array_coupled_input.end(), input) != in_array_coupled_input.end()
+			|| std::find(ext_coupled_input.begin(), ext_coupled_input.end(), input) != ext_coupled_input.end()
+			|| std::find_if(transformed_couplings.begin(), transformed_couplings.end(),
+					[&](const transformed_coupling& coupling){ return coupling.in.p == input; }) != transformed_couplings.end();
 }
 
-void MasterFMI::checkPortValidity(std::string fmu_name, std::string port_name, FMIVariableType type, bool check_already_coupled){
+void MasterFMI::checkPortValidity(const std::string& fmu_name, const std::string& port_name, FMIVariableType type, bool check_already_coupled){
 
 	if(fmus.find(fmu_name)==fmus.end())
 		xbt_die("unknown FMU %s",fmu_name.c_str());
@@ -608,7 +2442,58 @@ void MasterFMI::checkNotReadyForSimulation(){
 }
 
 
+void MasterFMI::enableStatistics(bool enable){
+	collect_statistics = enable;
+}
+
+fmi_statistics MasterFMI::getStatistics(){
+	for(auto it : remote_fmus){
+		fmu_statistics &fmu_stats = statistics.fmus[it.first];
+		fmu_stats.round_trips = it.second->getRoundTrips();
+		fmu_stats.round_trip_time = it.second->getRoundTripTime();
+		fmu_stats.restarts = it.second->getRestarts();
+	}
+	return statistics;
+}
+
+void MasterFMI::resetStatistics(){
+	statistics = fmi_statistics();
+	for(auto it : remote_fmus)
+		it.second->resetCounters();
+}
+
+void MasterFMI::printStatistics(){
+	getStatistics();
+	XBT_INFO("co-simulation statistics at time %f:",current_time);
+	XBT_INFO("  %llu macro steps",statistics.steps);
+	for(auto it : statistics.fmus){
+		fmu_statistics &fmu_stats = it.second;
+		XBT_INFO("  FMU %s: %llu doSteps and %llu zero-length doSteps in %f s (%f us per doStep)",
+				it.first.c_str(), fmu_stats.steps, fmu_stats.zero_steps, fmu_stats.doStep_time,
+				fmu_stats.doStep_time * 1e6 / std::max(1ULL, fmu_stats.steps + fmu_stats.zero_steps));
+		if(fmu_stats.retried_steps > 0 || fmu_stats.warnings > 0)
+			XBT_INFO("  FMU %s: %llu discarded steps retried, %llu warnings",it.first.c_str(),fmu_stats.retried_steps,fmu_stats.warnings);
+		if(remote_fmus.find(it.first) != remote_fmus.end())
+			XBT_INFO("  FMU %s: %llu round trips to its worker in %f s (%f us per round trip), %llu restarts",
+					it.first.c_str(), fmu_stats.round_trips, fmu_stats.round_trip_time,
+					fmu_stats.round_trip_time * 1e6 / std::max(1ULL, fmu_stats.round_trips), fmu_stats.restarts);
+	}
+	XBT_INFO("  couplings: %llu solves, %llu sweeps (%f sweeps per solve) in %f s",
+			statistics.coupling_solves, statistics.coupling_sweeps,
+			(double) statistics.coupling_sweeps / std::max(1ULL, statistics.coupling_solves), statistics.coupling_time);
+	XBT_INFO("  external couplings: %llu solves in %f s",statistics.external_coupling_solves, statistics.external_coupling_time);
+	XBT_INFO("  events: %llu conditions evaluated, %llu fired in %f s",
+			statistics.event_conditions_evaluated, statistics.events_fired, statistics.event_time);
+	XBT_INFO("  logging: %llu bytes in %f s",statistics.bytes_logged, statistics.log_time);
+	if(speculative)
+		XBT_INFO("  speculative steps: %llu kept, %llu rolled back",statistics.speculation_hits, statistics.speculation_misses);
+	if(!histories.empty())
+		XBT_INFO("  interpolation: %llu inputs deferred to the next grid point",statistics.deferred_inputs);
+}
+
 void MasterFMI::configureOutputLog(std::string output_file_path, std::vector<port> ports_to_monitor){
+	if(output.is_open())
+		output.close();
 	output.open(output_file_path, std::ios::out);
 	monitored_ports = ports_to_monitor;
 	for(port p : monitored_ports){
@@ -616,13 +2501,38 @@ void MasterFMI::configureOutputLog(std::string output_file_path, std::vector<por
 	}
 }
 
+void MasterFMI::closeOutputLog(){
+	if(output.is_open())
+		output.close();
+}
+
+bool MasterFMI::hasRemoteFMUs(){
+	return !remote_fmus.empty();
+}
+
 void MasterFMI::logOutput(){
+
+	std::chrono::steady_clock::time_point start;
+	std::streampos start_pos;
+	if(collect_statistics){
+		start = std::chrono::steady_clock::now();
+		start_pos = output.tellp();
+	}
+
 	output << current_time;
 
-	for(port p : monitored_ports){
+	for(const port& p : monitored_ports){
 		switch(fmus[p.fmu]->getType(p.name)){
 			case FMIVariableType::fmiTypeReal:
-				output << ";" << getRealOutput(p.fmu, p.name);
+				if(getArraySize(p.fmu, p.name) > 0){
+					// arrays are logged as one column with space-separated elements
+					readRealArrayOutput(p.fmu, p.name, array_buffer);
+					output << ";";
+					for(std::size_t i = 0; i < array_buffer.size(); i++)
+						output << (i == 0 ? "" : " ") << array_buffer[i];
+				}else{
+					output << ";" << getRealOutput(p.fmu, p.name);
+				}
 				break;
 			case FMIVariableType::fmiTypeInteger:
 				output << ";" << getIntegerOutput(p.fmu, p.name);
@@ -631,12 +2541,19 @@ void MasterFMI::logOutput(){
 				output << ";" << getBooleanOutput(p.fmu, p.name);
 				break;
 			case FMIVariableType::fmiTypeString:
-				output << ";" << getStringOutput(p.fmu, p.name);
+				readStringOutput(p.fmu, p.name, string_buffer);
+				output << ";" << string_buffer;
 				break;
 		}
 	}
 
 	output << "\n";
+
+	if(collect_statistics){
+		statistics.log_time += elapsedSince(start);
+		if(output.good())
+			statistics.bytes_logged += output.tellp() - start_pos;
+	}
 }
 
 
@@ -0,0 +1,308 @@
+#include "fmu_cache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_cache, surf, "Logging specific to the FMU cache of the SURF FMI plugin");
+
+extern char** environ;
+
+namespace simgrid{
+namespace fmi{
+
+#define INDEX_MAGIC "SGFMIIDX"
+#define INDEX_FORMAT 1
+
+std::string uriToPath(std::string fmu_uri){
+	if(fmu_uri.compare(0, 7, "file://") == 0)
+		return fmu_uri.substr(7);
+	return fmu_uri;
+}
+
+/**
+ * read-only mapping of a whole file
+ */
+struct mapped_file{
+	const char* data = nullptr;
+	std::size_t size = 0;
+
+	bool open(const std::string& path){
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size == 0){
+			close(fd);
+			return false;
+		}
+		void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED)
+			return false;
+		data = static_cast<const char*>(map);
+		size = st.st_size;
+		return true;
+	}
+
+	~mapped_file(){
+		if(data != nullptr)
+			munmap(const_cast<char*>(data), size);
+	}
+};
+
+/**
+ * sequential reader of an index, failing instead of reading past its end
+ */
+struct index_reader{
+	const char* pos;
+	const char* end;
+
+	bool read(void* value, std::size_t size){
+		if((std::size_t) (end - pos) < size)
+			return false;
+		std::memcpy(value, pos, size);
+		pos += size;
+		return true;
+	}
+
+	bool readString(std::string& value){
+		uint32_t length;
+		if(!read(&length, sizeof(length)) || (std::size_t) (end - pos) < length)
+			return false;
+		value.assign(pos, length);
+		pos += length;
+		return true;
+	}
+};
+
+static void write(std::string& out, const void* value, std::size_t size){
+	out.append(static_cast<const char*>(value), size);
+}
+
+static void writeString(std::string& out, const std::string& value){
+	uint32_t length = value.size();
+	write(out, &length, sizeof(length));
+	out.append(value);
+}
+
+/**
+ * FNV-1a hash of the content of a file (empty if it can not be read)
+ */
+static std::string hashFile(const std::string& path){
+	mapped_file file;
+	if(!file.open(path))
+		return "";
+	uint64_t hash = 14695981039346656037ULL;
+	for(std::size_t i = 0; i < file.size; i++){
+		hash ^= (unsigned char) file.data[i];
+		hash *= 1099511628211ULL;
+	}
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+	return hex;
+}
+
+/**
+ * run a command and return its exit status
+ */
+static int run(std::vector<std::string> arguments){
+	std::vector<char*> argv;
+	for(std::string& argument : arguments)
+		argv.push_back(&argument[0]);
+	argv.push_back(nullptr);
+
+	pid_t child;
+	if(posix_spawnp(&child, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+		return -1;
+	int status;
+	if(waitpid(child, &status, 0) < 0 || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+static bool makeDirectories(const std::string& path){
+	for(std::size_t i = 1; i <= path.size(); i++){
+		if(i < path.size() && path[i] != '/')
+			continue;
+		if(mkdir(path.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST)
+			return false;
+	}
+	return true;
+}
+
+
+/**
+ * FMUCache
+ */
+
+std::string FMUCache::directory;
+std::unordered_map<std::string,std::string> FMUCache::keys;
+
+void FMUCache::setDirectory(std::string directory){
+	if(!directory.empty() && !makeDirectories(directory))
+		xbt_die("can not create the FMU cache directory %s: %s",directory.c_str(),strerror(errno));
+	FMUCache::directory = directory;
+}
+
+std::string FMUCache::key(const std::string& path){
+	auto it = keys.find(path);
+	if(it != keys.end())
+		return it->second;
+	std::string hash = hashFile(path);
+	if(!hash.empty())
+		keys[path] = hash;
+	return hash;
+}
+
+std::string FMUCache::unpack(std::string fmu_uri){
+
+	std::string archive = uriToPath(fmu_uri);
+	struct stat st;
+	if(stat(archive.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		return fmu_uri;
+
+	if(directory.empty())
+		xbt_die("FMU %s is an archive: set a cache directory (FMIPlugin::setCacheDirectory) to unpack it",archive.c_str());
+
+	std::string hash = key(archive);
+	if(hash.empty())
+		xbt_die("can not read the FMU archive %s",archive.c_str());
+	std::string target = directory + "/" + hash;
+	if(stat((target + "/modelDescription.xml").c_str(), &st) == 0){
+		XBT_DEBUG("FMU %s found unpacked in %s",archive.c_str(),target.c_str());
+		return "file://" + target;
+	}
+
+	// unpacked aside then renamed, so that concurrent simulations never see a partial directory
+	std::string tmp = target + ".tmp" + std::to_string(getpid());
+	XBT_INFO("unpacking FMU %s in %s",archive.c_str(),target.c_str());
+	if(run({"unzip", "-q", "-o", archive, "-d", tmp}) != 0){
+		run({"rm", "-rf", tmp});
+		xbt_die("can not unpack the FMU archive %s (is unzip available?)",archive.c_str());
+	}
+	if(rename(tmp.c_str(), target.c_str()) != 0)
+		run({"rm", "-rf", tmp}); // unpacked by someone else in the meantime
+	return "file://" + target;
+}
+
+bool FMUCache::loadDescription(const std::string& description_path, int* fmi_version, fmi3_description* description){
+
+	if(directory.empty())
+		return false;
+	std::string hash = key(description_path);
+	if(hash.empty())
+		return false;
+
+	mapped_file file;
+	if(!file.open(directory + "/" + hash + ".idx"))
+		return false;
+
+	index_reader in = {file.data, file.data + file.size};
+	char magic[8];
+	uint32_t format, version, has_description;
+	if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+			|| !in.read(&format, sizeof(format)) || format != INDEX_FORMAT
+			|| !in.read(&version, sizeof(version)) || !in.read(&has_description, sizeof(has_description)))
+		return false;
+
+	*fmi_version = version;
+	if(description == nullptr)
+		return true;
+	if(!has_description)
+		return false;
+
+	uint8_t has_event_mode, can_save_state;
+	uint64_t nb_variables;
+	if(!in.readString(description->model_identifier) || !in.readString(description->instantiation_token)
+			|| !in.read(&has_event_mode, sizeof(has_event_mode)) || !in.read(&can_save_state, sizeof(can_save_state))
+			|| !in.read(&nb_variables, sizeof(nb_variables)))
+		return false;
+	description->has_event_mode = has_event_mode;
+	description->can_save_state = can_save_state;
+
+	description->variables.clear();
+	description->variables.reserve(std::min<uint64_t>(nb_variables, file.size));
+	for(uint64_t i = 0; i < nb_variables; i++){
+		fmi3_variable var;
+		int32_t type;
+		uint8_t clock, input;
+		uint64_t size;
+		if(!in.readString(var.name) || !in.read(&var.vr, sizeof(var.vr)) || !in.read(&type, sizeof(type))
+				|| !in.read(&clock, sizeof(clock)) || !in.read(&input, sizeof(input)) || !in.read(&size, sizeof(size)))
+			return false;
+		var.type = static_cast<FMIVariableType>(type);
+		var.clock = clock;
+		var.input = input;
+		var.size = size;
+		description->variables.push_back(var);
+	}
+
+	XBT_DEBUG("model description %s read from the cache",description_path.c_str());
+	return true;
+}
+
+void FMUCache::storeDescription(const std::string& description_path, int fmi_version, const fmi3_description* description){
+
+	if(directory.empty())
+		return;
+	std::string hash = key(description_path);
+	if(hash.empty())
+		return;
+
+	std::string out(INDEX_MAGIC);
+	uint32_t format = INDEX_FORMAT;
+	uint32_t version = fmi_version;
+	uint32_t has_description = description != nullptr;
+	write(out, &format, sizeof(format));
+	write(out, &version, sizeof(version));
+	write(out, &has_description, sizeof(has_description));
+
+	if(description != nullptr){
+		uint8_t has_event_mode = description->has_event_mode;
+		uint8_t can_save_state = description->can_save_state;
+		uint64_t nb_variables = description->variables.size();
+		writeString(out, description->model_identifier);
+		writeString(out, description->instantiation_token);
+		write(out, &has_event_mode, sizeof(has_event_mode));
+		write(out, &can_save_state, sizeof(can_save_state));
+		write(out, &nb_variables, sizeof(nb_variables));
+		for(const fmi3_variable& var : description->variables){
+			int32_t type = static_cast<int32_t>(var.type);
+			uint8_t clock = var.clock;
+			uint8_t input = var.input;
+			uint64_t size = var.size;
+			writeString(out, var.name);
+			write(out, &var.vr, sizeof(var.vr));
+			write(out, &type, sizeof(type));
+			write(out, &clock, sizeof(clock));
+			write(out, &input, sizeof(input));
+			write(out, &size, sizeof(size));
+		}
+	}
+
+	// written aside then renamed, so that readers never map a partial index
+	std::string path = directory + "/" + hash + ".idx";
+	std::string tmp = path + ".tmp" + std::to_string(getpid());
+	FILE* file = std::fopen(tmp.c_str(), "wb");
+	if(file == nullptr){
+		XBT_WARN("can not write the index of %s in the FMU cache: %s",description_path.c_str(),strerror(errno));
+		return;
+	}
+	bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+	written = (std::fclose(file) == 0) && written;
+	if(!written || rename(tmp.c_str(), path.c_str()) != 0){
+		XBT_WARN("can not write the index of %s in the FMU cache",description_path.c_str());
+		unlink(tmp.c_str());
+	}
+}
+
+}
+}
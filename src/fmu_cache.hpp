@@ -0,0 +1,57 @@
+#ifndef SRC_FMU_CACHE_HPP_
+#define SRC_FMU_CACHE_HPP_
+
+#include "fmi3_model.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * path of the FMU designated by fmu_uri (file:// URI or plain path)
+ */
+std::string uriToPath(std::string fmu_uri);
+
+/**
+ * On-disk cache shared by the simulations run with the same cache directory.
+ *
+ * FMU archives (.fmu files) are unpacked once in a directory named after the hash of the archive.
+ * Model descriptions are indexed by the hash of their content: the index holds the FMI version and,
+ * for FMI 3.0 FMUs, the variables, so that a later simulation maps a compact binary file instead of
+ * parsing the XML. FMI 1.0 and 2.0 descriptions are still parsed by fmipp when the FMU is loaded.
+ * Nothing is cached until a directory is set.
+ */
+class FMUCache{
+
+public:
+	static void setDirectory(std::string directory);
+
+	/**
+	 * URI of the unpacked FMU: fmu_uri itself for a directory, the cache entry for an archive
+	 */
+	static std::string unpack(std::string fmu_uri);
+
+	/**
+	 * read the index of the model description at description_path; description (may be nullptr)
+	 * is only filled for FMI 3.0 indexes, and false is returned if the index is missing or unusable
+	 */
+	static bool loadDescription(const std::string& description_path, int* fmi_version, fmi3_description* description);
+	static void storeDescription(const std::string& description_path, int fmi_version, const fmi3_description* description);
+
+private:
+	static std::string directory;
+
+	/**
+	 * hash of the files already read by this process, by path
+	 */
+	static std::unordered_map<std::string,std::string> keys;
+
+	static std::string key(const std::string& path);
+};
+
+}
+}
+
+#endif /* SRC_FMU_CACHE_HPP_ */
@@ -0,0 +1,432 @@
+#include "fmu_group.hpp"
+#include <simgrid/s4u/NetZone.hpp>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_group, surf, "Logging specific to the FMU groups of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+FMUGroup::FMUGroup(double communication_step, bool parallel)
+: master(new MasterFMI(communication_step)), parallel(parallel), last_status(fmiOK), step_pending(false), stopping(false), step_target(0){
+	// the inputs of the group are set by the top-level master, at its own time
+	master->check_input_time = false;
+}
+
+FMUGroup::~FMUGroup(){
+	if(worker.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(step_mutex);
+			stopping = true;
+		}
+		step_cond.notify_all();
+		worker.join();
+	}
+	delete master;
+}
+
+MasterFMI* FMUGroup::getMaster(){
+	return master;
+}
+
+bool FMUGroup::isParallel() const{
+	return parallel;
+}
+
+void FMUGroup::reset(const std::string& group_name, const fmu_parameters& parameters){
+
+	fmu_parameters group_parameters;
+	port p;
+	for(auto it : parameters.reals){
+		if(it.first.fmu == group_name && splitName(it.first.name, &p))
+			group_parameters.reals[p] = it.second;
+	}
+	for(auto it : parameters.integers){
+		if(it.first.fmu == group_name && splitName(it.first.name, &p))
+			group_parameters.integers[p] = it.second;
+	}
+	for(auto it : parameters.booleans){
+		if(it.first.fmu == group_name && splitName(it.first.name, &p))
+			group_parameters.booleans[p] = it.second;
+	}
+	for(auto it : parameters.strings){
+		if(it.first.fmu == group_name && splitName(it.first.name, &p))
+			group_parameters.strings[p] = it.second;
+	}
+	master->resetSimulation(group_parameters, "");
+}
+
+/**
+ * advance the FMUs of the group up to currentCommunicationPoint + communicationStepSize, with the
+ * communication step of the group (in a thread if the group is stepped in parallel)
+ */
+void FMUGroup::startStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize){
+
+	const double target = currentCommunicationPoint + communicationStepSize;
+	if(parallel){
+		// the worker is started with the first step, then woken at each step
+		if(!worker.joinable())
+			worker = std::thread(&FMUGroup::workerLoop, this);
+		{
+			std::lock_guard<std::mutex> lock(step_mutex);
+			step_target = target;
+			step_pending = true;
+		}
+		step_cond.notify_all();
+	}else{
+		master->advance(target, master->commStep);
+	}
+}
+
+/**
+ * wait for the step of the group
+ */
+fmiStatus FMUGroup::joinStep(){
+	if(parallel){
+		std::unique_lock<std::mutex> lock(step_mutex);
+		step_cond.wait(lock, [this](){ return !step_pending; });
+	}
+	return last_status = fmiOK;
+}
+
+/**
+ * main loop of the worker of a parallel group: execute the steps posted by startStep until the group is deleted
+ */
+void FMUGroup::workerLoop(){
+	std::unique_lock<std::mutex> lock(step_mutex);
+	while(true){
+		step_cond.wait(lock, [this](){ return step_pending || stopping; });
+		if(!step_pending)
+			return;
+		const double target = step_target;
+		lock.unlock();
+		master->advance(target, master->commStep);
+		lock.lock();
+		step_pending = false;
+		step_cond.notify_all();
+	}
+}
+
+/**
+ * handle the SimGrid side of the group (in maestro) as in MasterFMI::update_actions_state, once the
+ * steps of all the groups are joined
+ */
+fmiStatus FMUGroup::finishStep(){
+
+	master->solveExternalCoupling();
+	master->solveCouplings(true);
+	master->manageEventNotification();
+	master->applyResourceBindings();
+	master->publishOutputs();
+	return last_status = fmiOK;
+}
+
+/**
+ * split a port name of the group ("fmu.port") into a port of its master. The FMU is the longest
+ * prefix (before a dot) that names an FMU of the group, since port names may also contain dots.
+ */
+bool FMUGroup::splitName(const std::string& name, port* p) const{
+
+	for(std::size_t dot = name.rfind('.'); dot != std::string::npos && dot > 0; dot = name.rfind('.', dot - 1)){
+		if(master->fmus.find(name.substr(0, dot)) != master->fmus.end()){
+			p->fmu = name.substr(0, dot);
+			p->name = name.substr(dot + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+const port_handle* FMUGroup::getPort(fmiValueReference valref, FMIVariableType type){
+	if(valref >= ports.size() || (type != FMIVariableType::fmiTypeUnknown && ports[valref].type != type)){
+		last_status = fmiError;
+		return nullptr;
+	}
+	return &ports[valref];
+}
+
+fmiStatus FMUGroup::instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive){
+	return last_status = fmiOK;
+}
+
+/**
+ * the FMUs of the group are initialized by its master when they are added
+ */
+fmiStatus FMUGroup::initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime){
+	return last_status = fmiOK;
+}
+
+fmiReal FMUGroup::getTime() const{
+	return master->current_time;
+}
+
+fmiStatus FMUGroup::doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep){
+	if(communicationStepSize <= 0)
+		return last_status = fmiOK;
+	// the SimGrid side is handled by the top-level master after all its FMUs are stepped (see finishStep)
+	startStep(currentCommunicationPoint, communicationStepSize);
+	return joinStep();
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference valref, const fmiReal& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeReal);
+	if(handle == nullptr)
+		return last_status;
+	master->setRealInput(*handle, val);
+	return last_status = fmiOK;
+}
+
+/**
+ * the master sets the booleans as integers
+ */
+fmiStatus FMUGroup::setValue(fmiValueReference valref, const fmiInteger& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeUnknown);
+	if(handle == nullptr)
+		return last_status;
+	if(handle->type == FMIVariableType::fmiTypeBoolean)
+		master->setBooleanInput(*handle, val != 0);
+	else if(handle->type == FMIVariableType::fmiTypeInteger)
+		master->setIntegerInput(*handle, val);
+	else
+		return last_status = fmiError;
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference valref, const fmiBoolean& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeBoolean);
+	if(handle == nullptr)
+		return last_status;
+	master->setBooleanInput(*handle, val != 0);
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference valref, const std::string& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeString);
+	if(handle == nullptr)
+		return last_status;
+	master->setStringInput(*handle, val);
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(fmiValueReference* valref, const std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::setValue(const std::string& name, const fmiReal& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::setValue(const std::string& name, const fmiInteger& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::setValue(const std::string& name, const fmiBoolean& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::setValue(const std::string& name, const std::string& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference valref, fmiReal& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeReal);
+	if(handle == nullptr)
+		return last_status;
+	val = master->getRealOutput(*handle);
+	return last_status = fmiOK;
+}
+
+/**
+ * the master reads the booleans as integers (fmi2Boolean)
+ */
+fmiStatus FMUGroup::getValue(fmiValueReference valref, fmiInteger& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeUnknown);
+	if(handle == nullptr)
+		return last_status;
+	if(handle->type == FMIVariableType::fmiTypeBoolean)
+		val = master->getBooleanOutput(*handle);
+	else if(handle->type == FMIVariableType::fmiTypeInteger)
+		val = master->getIntegerOutput(*handle);
+	else
+		return last_status = fmiError;
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference valref, fmiBoolean& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeBoolean);
+	if(handle == nullptr)
+		return last_status;
+	val = master->getBooleanOutput(*handle);
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference valref, std::string& val){
+	const port_handle* handle = getPort(valref, FMIVariableType::fmiTypeString);
+	if(handle == nullptr)
+		return last_status;
+	val = master->getStringOutput(*handle);
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(fmiValueReference* valref, std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus FMUGroup::getValue(const std::string& name, fmiReal& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::getValue(const std::string& name, fmiInteger& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::getValue(const std::string& name, fmiBoolean& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus FMUGroup::getValue(const std::string& name, std::string& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiValueReference FMUGroup::getValueRef(const std::string& name) const{
+
+	auto it = refs.find(name);
+	if(it != refs.end())
+		return it->second;
+
+	port p;
+	FMIVariableType type = getType(name);
+	if(type == FMIVariableType::fmiTypeUnknown || !splitName(name, &p))
+		return fmiValueReference(-1);
+	fmiValueReference valref = ports.size();
+	ports.push_back(master->getPortHandle(p.fmu, p.name, type));
+	refs[name] = valref;
+	return valref;
+}
+
+FMIVariableType FMUGroup::getType(const std::string& variableName) const{
+	port p;
+	if(!splitName(variableName, &p))
+		return FMIVariableType::fmiTypeUnknown;
+	return master->fmus[p.fmu]->getType(p.name);
+}
+
+fmiStatus FMUGroup::getLastStatus() const{
+	return last_status;
+}
+
+std::size_t FMUGroup::nStates() const{
+	return 0;
+}
+
+std::size_t FMUGroup::nEventInds() const{
+	return 0;
+}
+
+std::size_t FMUGroup::nValueRefs() const{
+	return ports.size();
+}
+
+const ModelDescription* FMUGroup::getModelDescription() const{
+	return nullptr;
+}
+
+void FMUGroup::sendDebugMessage(const std::string& msg) const{
+	XBT_DEBUG("%s",msg.c_str());
+}
+
+void FMUGroup::logger(fmiStatus status, const std::string& category, const std::string& msg) const{
+	XBT_DEBUG("[%s] %s",category.c_str(),msg.c_str());
+}
+
+
+/**
+ * FMIPlugin
+ */
+
+MasterFMI* FMIPlugin::addFMUGroup(std::string group_name, double communication_step, bool parallel){
+	return master->addFMUGroup(group_name, communication_step, parallel);
+}
+
+MasterFMI* FMIPlugin::addFMUGroup(simgrid::s4u::NetZone* netzone, double communication_step, bool parallel){
+	return master->addFMUGroup(netzone->get_name(), communication_step, parallel);
+}
+
+
+/**
+ * MasterFMI
+ */
+
+MasterFMI* MasterFMI::addFMUGroup(std::string group_name, double communication_step, bool parallel){
+
+	checkNotReadyForSimulation();
+	if(fmus.find(group_name) != fmus.end())
+		xbt_die("can not add the FMU group %s: an FMU of this name already exists",group_name.c_str());
+	if(communication_step <= 0)
+		xbt_die("the communication step of the FMU group %s must be positive",group_name.c_str());
+
+	FMUGroup* group = new FMUGroup(communication_step, parallel);
+	addFMUCS(group, group_name, false);
+	fmu_groups[group_name] = group;
+	XBT_INFO("FMU group %s added (communication step %f, %s)",group_name.c_str(),communication_step,parallel ? "parallel" : "sequential");
+	return group->getMaster();
+}
+
+}
+}
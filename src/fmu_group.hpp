@@ -0,0 +1,116 @@
+#ifndef SRC_FMU_GROUP_HPP_
+#define SRC_FMU_GROUP_HPP_
+
+#include "simgrid-fmi.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * Group of FMUs co-simulated by their own master (sub-master), seen by the top-level master as
+ * a single FMU (see FMIPlugin::addFMUGroup).
+ *
+ * The ports of the group are those of its FMUs, named "fmu.port". A step of the top-level master
+ * advances the sub-master with its own communication step, its couplings being solved between
+ * two of its steps. The SimGrid side of the group (inputs from the SimGrid models, events, waits
+ * and resource bindings) is handled in maestro at the end of the step: startStep() can wake the
+ * worker thread of the group to step its FMUs while the top-level master steps its other FMUs and
+ * groups, joinStep() waits for it, and finishStep() is called once every group is joined.
+ */
+class FMUGroup : public FMUCoSimulationBase{
+
+public:
+	FMUGroup(double communication_step, bool parallel);
+	~FMUGroup();
+
+	MasterFMI* getMaster();
+	bool isParallel() const;
+
+	/**
+	 * reset the FMUs of the group, with the parameters of the group named group_name ("fmu.port")
+	 */
+	void reset(const std::string& group_name, const fmu_parameters& parameters);
+
+	void startStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize);
+	fmiStatus joinStep();
+	fmiStatus finishStep();
+
+	fmiStatus instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive) override;
+	fmiStatus initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime) override;
+	fmiReal getTime() const override;
+	fmiStatus doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep) override;
+
+	fmiStatus setValue(fmiValueReference valref, const fmiReal& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiInteger& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiBoolean& val) override;
+	fmiStatus setValue(fmiValueReference valref, const std::string& val) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const std::string* val, std::size_t ival) override;
+	fmiStatus setValue(const std::string& name, const fmiReal& val) override;
+	fmiStatus setValue(const std::string& name, const fmiInteger& val) override;
+	fmiStatus setValue(const std::string& name, const fmiBoolean& val) override;
+	fmiStatus setValue(const std::string& name, const std::string& val) override;
+
+	fmiStatus getValue(fmiValueReference valref, fmiReal& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiInteger& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiBoolean& val) override;
+	fmiStatus getValue(fmiValueReference valref, std::string& val) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, std::string* val, std::size_t ival) override;
+	fmiStatus getValue(const std::string& name, fmiReal& val) override;
+	fmiStatus getValue(const std::string& name, fmiInteger& val) override;
+	fmiStatus getValue(const std::string& name, fmiBoolean& val) override;
+	fmiStatus getValue(const std::string& name, std::string& val) override;
+
+	fmiValueReference getValueRef(const std::string& name) const override;
+	FMIVariableType getType(const std::string& variableName) const override;
+	fmiStatus getLastStatus() const override;
+	std::size_t nStates() const override;
+	std::size_t nEventInds() const override;
+	std::size_t nValueRefs() const override;
+	const ModelDescription* getModelDescription() const override;
+	void sendDebugMessage(const std::string& msg) const override;
+	void logger(fmiStatus status, const std::string& category, const std::string& msg) const override;
+
+private:
+	MasterFMI* master;
+	bool parallel;
+	fmiStatus last_status;
+
+	/**
+	 * worker of a parallel group, started with its first step: startStep() sets step_target and
+	 * step_pending, and the worker clears step_pending once the step is done (both under step_mutex)
+	 */
+	std::thread worker;
+	std::mutex step_mutex;
+	std::condition_variable step_cond;
+	bool step_pending;
+	bool stopping;
+	double step_target;
+
+	/**
+	 * ports of the FMUs of the group, resolved on first use: the value reference of a port is its
+	 * rank in ports (mutable since getValueRef is const)
+	 */
+	mutable std::vector<port_handle> ports;
+	mutable std::unordered_map<std::string,fmiValueReference> refs;
+
+	void workerLoop();
+	bool splitName(const std::string& name, port* p) const;
+	const port_handle* getPort(fmiValueReference valref, FMIVariableType type);
+};
+
+}
+}
+
+#endif /* SRC_FMU_GROUP_HPP_ */
@@ -0,0 +1,488 @@
+#include "simgrid-fmi.hpp"
+#include <cstring>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_native, surf, "Logging specific to the native models of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * saved state of a native model: its time and the value of its ports
+ */
+struct native_state{
+	double time;
+	std::vector<double> reals;
+	std::vector<int> integers;
+	std::vector<bool> booleans;
+	std::vector<std::string> strings;
+};
+
+/**
+ * NativeModel
+ */
+
+NativeModel::NativeModel()
+: FMUCoSimulationBase(false){
+	time = 0;
+	last_status = fmiOK;
+	start_values = nullptr;
+}
+
+NativeModel::~NativeModel(){
+	delete start_values;
+}
+
+void NativeModel::addRealPort(std::string name, double* value){
+	addPort(name, FMIVariableType::fmiTypeReal, value);
+}
+
+void NativeModel::addIntegerPort(std::string name, int* value){
+	addPort(name, FMIVariableType::fmiTypeInteger, value);
+}
+
+void NativeModel::addBooleanPort(std::string name, bool* value){
+	addPort(name, FMIVariableType::fmiTypeBoolean, value);
+}
+
+void NativeModel::addStringPort(std::string name, std::string* value){
+	addPort(name, FMIVariableType::fmiTypeString, value);
+}
+
+void NativeModel::addPort(std::string name, FMIVariableType type, void* value){
+	if(port_refs.find(name) != port_refs.end())
+		xbt_die("port %s of native model is declared twice",name.c_str());
+
+	native_port p;
+	p.name = name;
+	p.type = type;
+	p.value = value;
+	port_refs[name] = ports.size();
+	ports.push_back(p);
+}
+
+native_port* NativeModel::getPort(fmiValueReference valref, fmiStatus* status){
+	if(valref >= ports.size()){
+		*status = fmiError;
+		return nullptr;
+	}
+	*status = fmiOK;
+	return &ports[valref];
+}
+
+fmiStatus NativeModel::instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive){
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime){
+	if(start_values == nullptr){
+		start_values = new native_state();
+		savePorts(start_values);
+	}
+	time = startTime;
+	start(startTime);
+	return last_status = fmiOK;
+}
+
+/**
+ * give back to the ports the values they had at the first initialization, before the model is
+ * initialized again (and start() called again) at the reset of the simulation
+ */
+void NativeModel::reset(){
+	if(start_values != nullptr)
+		restorePorts(start_values);
+}
+
+fmiReal NativeModel::getTime() const{
+	return time;
+}
+
+fmiStatus NativeModel::doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep){
+	step(currentCommunicationPoint, communicationStepSize);
+	time = currentCommunicationPoint + communicationStepSize;
+	return last_status = fmiOK;
+}
+
+/*
+ * SETTERS: booleans are also accepted as integers since fmiBoolean and fmi2Boolean are not the same type
+ */
+
+fmiStatus NativeModel::setValue(fmiValueReference valref, const fmiReal& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeReal)
+		return last_status = fmiError;
+	*static_cast<double*>(p->value) = val;
+	return last_status;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference valref, const fmiInteger& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr)
+		return last_status;
+	if(p->type == FMIVariableType::fmiTypeInteger)
+		*static_cast<int*>(p->value) = val;
+	else if(p->type == FMIVariableType::fmiTypeBoolean)
+		*static_cast<bool*>(p->value) = (val != 0);
+	else
+		last_status = fmiError;
+	return last_status;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference valref, const fmiBoolean& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeBoolean)
+		return last_status = fmiError;
+	*static_cast<bool*>(p->value) = (val != fmiFalse);
+	return last_status;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference valref, const std::string& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeString)
+		return last_status = fmiError;
+	*static_cast<std::string*>(p->value) = val;
+	return last_status;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::setValue(fmiValueReference* valref, const std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(setValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::setValue(const std::string& name, const fmiReal& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::setValue(const std::string& name, const fmiInteger& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::setValue(const std::string& name, const fmiBoolean& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::setValue(const std::string& name, const std::string& val){
+	return setValue(getValueRef(name), val);
+}
+
+/*
+ * GETTERS
+ */
+
+fmiStatus NativeModel::getValue(fmiValueReference valref, fmiReal& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeReal)
+		return last_status = fmiError;
+	val = *static_cast<double*>(p->value);
+	return last_status;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference valref, fmiInteger& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr)
+		return last_status;
+	if(p->type == FMIVariableType::fmiTypeInteger)
+		val = *static_cast<int*>(p->value);
+	else if(p->type == FMIVariableType::fmiTypeBoolean)
+		val = *static_cast<bool*>(p->value) ? 1 : 0;
+	else
+		last_status = fmiError;
+	return last_status;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference valref, fmiBoolean& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeBoolean)
+		return last_status = fmiError;
+	val = *static_cast<bool*>(p->value) ? fmiTrue : fmiFalse;
+	return last_status;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference valref, std::string& val){
+	native_port* p = getPort(valref, &last_status);
+	if(p == nullptr || p->type != FMIVariableType::fmiTypeString)
+		return last_status = fmiError;
+	val = *static_cast<std::string*>(p->value);
+	return last_status;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::getValue(fmiValueReference* valref, std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++){
+		if(getValue(valref[i], val[i]) != fmiOK)
+			return last_status;
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::getValue(const std::string& name, fmiReal& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::getValue(const std::string& name, fmiInteger& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::getValue(const std::string& name, fmiBoolean& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus NativeModel::getValue(const std::string& name, std::string& val){
+	return getValue(getValueRef(name), val);
+}
+
+/*
+ * MODEL DESCRIPTION
+ */
+
+fmiValueReference NativeModel::getValueRef(const std::string& name) const{
+	std::unordered_map<std::string,fmiValueReference>::const_iterator it = port_refs.find(name);
+	if(it == port_refs.end())
+		return fmiValueReference(-1);
+	return it->second;
+}
+
+FMIVariableType NativeModel::getType(const std::string& variableName) const{
+	std::unordered_map<std::string,fmiValueReference>::const_iterator it = port_refs.find(variableName);
+	if(it == port_refs.end())
+		return FMIVariableType::fmiTypeUnknown;
+	return ports[it->second].type;
+}
+
+fmiStatus NativeModel::getLastStatus() const{
+	return last_status;
+}
+
+std::size_t NativeModel::nStates() const{
+	return 0;
+}
+
+std::size_t NativeModel::nEventInds() const{
+	return 0;
+}
+
+std::size_t NativeModel::nValueRefs() const{
+	return ports.size();
+}
+
+const ModelDescription* NativeModel::getModelDescription() const{
+	return nullptr;
+}
+
+/*
+ * STATE
+ */
+
+bool NativeModel::canSaveState() const{
+	return false;
+}
+
+fmiStatus NativeModel::saveState(void** state){
+	if(*state == nullptr)
+		*state = new native_state();
+	savePorts(static_cast<native_state*>(*state));
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::restoreState(void* state){
+	restorePorts(static_cast<native_state*>(state));
+	return last_status = fmiOK;
+}
+
+void NativeModel::freeState(void* state){
+	delete static_cast<native_state*>(state);
+}
+
+/*
+ * a serialized state holds the time, then the number and the values of the ports of each type
+ * (a string being its length followed by its characters)
+ */
+
+template<typename T>
+static void appendBytes(std::vector<char>& data, const T& value){
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+static bool readBytes(const char** data, const char* end, T* value){
+	if(end - *data < (long) sizeof(T))
+		return false;
+	std::memcpy(value, *data, sizeof(T));
+	*data += sizeof(T);
+	return true;
+}
+
+fmiStatus NativeModel::serializeState(void* state, std::vector<char>& data){
+	const native_state* saved = static_cast<native_state*>(state);
+	data.clear();
+	appendBytes(data, saved->time);
+	appendBytes(data, (uint64_t) saved->reals.size());
+	for(double r : saved->reals)
+		appendBytes(data, r);
+	appendBytes(data, (uint64_t) saved->integers.size());
+	for(int i : saved->integers)
+		appendBytes(data, i);
+	appendBytes(data, (uint64_t) saved->booleans.size());
+	for(bool b : saved->booleans)
+		appendBytes(data, (char) b);
+	appendBytes(data, (uint64_t) saved->strings.size());
+	for(const std::string& s : saved->strings){
+		appendBytes(data, (uint64_t) s.size());
+		data.insert(data.end(), s.begin(), s.end());
+	}
+	return last_status = fmiOK;
+}
+
+fmiStatus NativeModel::deserializeState(const char* data, std::size_t size, void** state){
+	if(*state == nullptr)
+		*state = new native_state();
+	native_state* saved = static_cast<native_state*>(*state);
+	const char* end = data + size;
+	uint64_t n;
+
+	if(!readBytes(&data, end, &saved->time) || !readBytes(&data, end, &n))
+		return last_status = fmiError;
+	saved->reals.resize(n);
+	for(double& r : saved->reals){
+		if(!readBytes(&data, end, &r))
+			return last_status = fmiError;
+	}
+	if(!readBytes(&data, end, &n))
+		return last_status = fmiError;
+	saved->integers.resize(n);
+	for(int& i : saved->integers){
+		if(!readBytes(&data, end, &i))
+			return last_status = fmiError;
+	}
+	if(!readBytes(&data, end, &n))
+		return last_status = fmiError;
+	saved->booleans.resize(n);
+	for(std::size_t b = 0; b < n; b++){
+		char value;
+		if(!readBytes(&data, end, &value))
+			return last_status = fmiError;
+		saved->booleans[b] = value != 0;
+	}
+	if(!readBytes(&data, end, &n))
+		return last_status = fmiError;
+	saved->strings.resize(n);
+	for(std::string& s : saved->strings){
+		uint64_t length;
+		if(!readBytes(&data, end, &length) || (uint64_t) (end - data) < length)
+			return last_status = fmiError;
+		s.assign(data, length);
+		data += length;
+	}
+	return last_status = fmiOK;
+}
+
+void NativeModel::savePorts(native_state* saved) const{
+	saved->time = time;
+	saved->reals.clear();
+	saved->integers.clear();
+	saved->booleans.clear();
+	saved->strings.clear();
+	for(const native_port& p : ports){
+		switch(p.type){
+			case FMIVariableType::fmiTypeReal:
+				saved->reals.push_back(*static_cast<double*>(p.value));
+				break;
+			case FMIVariableType::fmiTypeInteger:
+				saved->integers.push_back(*static_cast<int*>(p.value));
+				break;
+			case FMIVariableType::fmiTypeBoolean:
+				saved->booleans.push_back(*static_cast<bool*>(p.value));
+				break;
+			case FMIVariableType::fmiTypeString:
+				saved->strings.push_back(*static_cast<std::string*>(p.value));
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void NativeModel::restorePorts(const native_state* saved){
+	time = saved->time;
+	std::size_t r = 0, i = 0, b = 0, s = 0;
+	for(native_port& p : ports){
+		switch(p.type){
+			case FMIVariableType::fmiTypeReal:
+				*static_cast<double*>(p.value) = saved->reals[r++];
+				break;
+			case FMIVariableType::fmiTypeInteger:
+				*static_cast<int*>(p.value) = saved->integers[i++];
+				break;
+			case FMIVariableType::fmiTypeBoolean:
+				*static_cast<bool*>(p.value) = saved->booleans[b++];
+				break;
+			case FMIVariableType::fmiTypeString:
+				*static_cast<std::string*>(p.value) = saved->strings[s++];
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void NativeModel::sendDebugMessage(const std::string& msg) const{
+	XBT_DEBUG("%s",msg.c_str());
+}
+
+void NativeModel::logger(fmiStatus status, const std::string& category, const std::string& msg) const{
+	XBT_DEBUG("[%s] %s",category.c_str(),msg.c_str());
+}
+
+}
+}
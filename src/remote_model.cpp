@@ -0,0 +1,768 @@
+#include "remote_model.hpp"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <vector>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_remote, surf, "Logging specific to the FMU workers of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/*
+ * number of polling iterations before sleeping on the futex: a doStep or a getter usually
+ * answers within a few microseconds, so spinning first keeps the round trip latency low
+ */
+static const int spin_iterations = 20000;
+
+static void futexWait(std::atomic<uint32_t>* word, uint32_t expected, long timeout_ns){
+	struct timespec timeout;
+	timeout.tv_sec = timeout_ns / 1000000000L;
+	timeout.tv_nsec = timeout_ns % 1000000000L;
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout_ns > 0 ? &timeout : nullptr, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>* word){
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+static std::string readString(remote_channel* channel, remote_command& c){
+	return std::string(channel->strings + c.str_offset, c.str_length);
+}
+
+static void writeString(remote_channel* channel, remote_command& c, const std::string& value){
+	if(channel->string_used + value.size() > REMOTE_STRING_AREA){
+		c.status = fmiError;
+		return;
+	}
+	std::memcpy(channel->strings + channel->string_used, value.data(), value.size());
+	c.str_offset = channel->string_used;
+	c.str_length = value.size();
+	channel->string_used += value.size();
+}
+
+/**
+ * save the state of the model after a step at time in the next checkpoint of the channel. Return false
+ * if the model can not serialize its state, or if it does not fit in a checkpoint.
+ */
+static bool saveCheckpoint(remote_channel* channel, StatefulModel* model, void** state, std::vector<char>& data, int* slot, double time){
+	if(model->saveState(state) > fmiWarning || model->serializeState(*state, data) != fmiOK || data.size() > REMOTE_STATE_AREA)
+		return false;
+	remote_checkpoint& checkpoint = channel->checkpoints[*slot];
+	checkpoint.size.store(0, std::memory_order_release);
+	std::memcpy(checkpoint.data, data.data(), data.size());
+	checkpoint.time = time;
+	checkpoint.size.store(data.size(), std::memory_order_release);
+	*slot = 1 - *slot;
+	return true;
+}
+
+/**
+ * restore the state of the model from the checkpoint of the step that ended at time
+ */
+static fmiStatus restoreCheckpoint(remote_channel* channel, StatefulModel* model, void** state, double time){
+	for(remote_checkpoint& checkpoint : channel->checkpoints){
+		uint32_t size = checkpoint.size.load(std::memory_order_acquire);
+		if(size > 0 && checkpoint.time == time){
+			if(model->deserializeState(checkpoint.data, size, state) != fmiOK)
+				return fmiError;
+			return model->restoreState(*state);
+		}
+	}
+	return fmiError;
+}
+
+/**
+ * main loop of a worker: execute the batches posted by the master until TERMINATE
+ */
+static void workerLoop(remote_channel* channel, FMUCoSimulationBase* model){
+
+	uint32_t done = channel->response_seq.load();
+
+	// checkpoints of the state of the model after each step, as long as it can serialize it
+	StatefulModel* stateful = dynamic_cast<StatefulModel*>(model);
+	bool checkpoints = stateful != nullptr && stateful->canSaveState();
+	void* state = nullptr;
+	std::vector<char> state_data;
+	int slot = 0;
+
+	while(true){
+		int spin = 0;
+		while(channel->request_seq.load(std::memory_order_acquire) == done){
+			if(++spin > spin_iterations)
+				futexWait(&channel->request_seq, done, 0);
+		}
+		uint32_t request = channel->request_seq.load(std::memory_order_acquire);
+
+		bool terminate = false;
+		for(uint32_t i = 0; i < channel->nb_commands; i++){
+			remote_command& c = channel->commands[i];
+			fmiStatus status = fmiOK;
+			switch(c.op){
+				case remote_op::INSTANTIATE:
+					status = model->instantiate(readString(channel, c), 0, fmiFalse, fmiFalse);
+					break;
+				case remote_op::INITIALIZE:
+					status = model->initialize(c.real, c.integer != 0, c.real2);
+					break;
+				case remote_op::DO_STEP:
+					status = model->doStep(c.real, c.real2, fmiTrue);
+					if(checkpoints && status <= fmiWarning)
+						checkpoints = saveCheckpoint(channel, stateful, &state, state_data, &slot, c.real + c.real2);
+					break;
+				case remote_op::RESTORE_STATE:
+					status = stateful == nullptr ? fmiError : restoreCheckpoint(channel, stateful, &state, c.real);
+					break;
+				case remote_op::VALUE_REF:
+					c.valref = model->getValueRef(readString(channel, c));
+					break;
+				case remote_op::TYPE:
+					c.integer = model->getType(readString(channel, c));
+					break;
+				case remote_op::SET_REAL:
+					status = model->setValue(c.valref, c.real);
+					break;
+				case remote_op::SET_INTEGER:
+					status = model->setValue(c.valref, (fmiInteger) c.integer);
+					break;
+				case remote_op::SET_BOOLEAN:
+				{
+					fmiBoolean b = (fmiBoolean) c.integer;
+					status = model->setValue(c.valref, b);
+					break;
+				}
+				case remote_op::SET_STRING:
+					status = model->setValue(c.valref, readString(channel, c));
+					break;
+				case remote_op::GET_REAL:
+					status = model->getValue(c.valref, c.real);
+					break;
+				case remote_op::GET_INTEGER:
+				{
+					fmiInteger v = 0;
+					status = model->getValue(c.valref, v);
+					c.integer = v;
+					break;
+				}
+				case remote_op::GET_BOOLEAN:
+				{
+					fmiBoolean v = fmiFalse;
+					status = model->getValue(c.valref, v);
+					c.integer = v;
+					break;
+				}
+				case remote_op::GET_STRING:
+				{
+					std::string v;
+					status = model->getValue(c.valref, v);
+					writeString(channel, c, v);
+					break;
+				}
+				case remote_op::TERMINATE:
+					terminate = true;
+					break;
+			}
+			if(c.status == fmiOK)
+				c.status = status;
+		}
+
+		done = request;
+		channel->response_seq.store(request, std::memory_order_release);
+		futexWake(&channel->response_seq);
+
+		if(terminate)
+			_exit(0);
+	}
+}
+
+
+/**
+ * RemoteFMU
+ */
+
+RemoteFMU::RemoteFMU(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name)
+: FMUCoSimulationBase(false){
+
+	this->factory = factory;
+	this->fmu_name = fmu_name;
+	instance_name = fmu_name;
+	step_pending = false;
+	time = 0;
+	start_time = 0;
+	last_status = fmiOK;
+	round_trips = 0;
+	round_trip_time = 0;
+	restarts = 0;
+	worker = -1;
+
+	void* shared = mmap(nullptr, sizeof(remote_channel), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED)
+		xbt_die("can not allocate the shared memory of the worker of FMU %s",fmu_name.c_str());
+	// the anonymous mapping is already zeroed, and the checkpoints are only touched when written
+	channel = new (shared) remote_channel;
+	channel->request_seq = 0;
+	channel->response_seq = 0;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	clearCheckpoints();
+
+	spawnWorker();
+}
+
+RemoteFMU::~RemoteFMU(){
+	if(step_pending)
+		finishStep();
+	push(remote_op::TERMINATE, 0);
+	post();
+	waitpid(worker, nullptr, 0);
+	channel->~remote_channel();
+	munmap(channel, sizeof(remote_channel));
+}
+
+void RemoteFMU::spawnWorker(){
+
+	pid_t parent = getpid();
+	worker = fork();
+	if(worker < 0)
+		xbt_die("can not fork the worker of FMU %s",fmu_name.c_str());
+
+	if(worker == 0){
+		// the worker must not survive the simulation
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		if(getppid() != parent)
+			_exit(1);
+		FMUCoSimulationBase* model = factory();
+		if(model == nullptr)
+			_exit(1);
+		workerLoop(channel, model);
+	}
+
+	XBT_DEBUG("worker %d started for FMU %s",(int) worker,fmu_name.c_str());
+}
+
+void RemoteFMU::clearCheckpoints(){
+	for(remote_checkpoint& checkpoint : channel->checkpoints)
+		checkpoint.size.store(0);
+}
+
+void RemoteFMU::restartWorker(){
+
+	// the worker restarts from the checkpoint of the last successful step if it wrote one
+	bool checkpoint = false;
+	for(remote_checkpoint& saved : channel->checkpoints)
+		checkpoint = checkpoint || (saved.size.load(std::memory_order_acquire) > 0 && saved.time == time);
+	if(checkpoint)
+		XBT_WARN("the worker of FMU %s died at time %f, restarting it from its last step",fmu_name.c_str(),time);
+	else
+		XBT_WARN("the worker of FMU %s died at time %f, restarting it (the internal state of the FMU is reset to its initial values)",fmu_name.c_str(),time);
+	waitpid(worker, nullptr, WNOHANG);
+	restarts++;
+
+	// save the interrupted batch
+	std::vector<remote_command> batch(channel->commands, channel->commands + channel->nb_commands);
+	std::vector<char> batch_strings(channel->strings, channel->strings + channel->string_used);
+	for(remote_command& c : batch)
+		c.status = fmiOK;
+
+	channel->response_seq.store(channel->request_seq.load());
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	spawnWorker();
+
+	// instantiate the model again at the time of the last successful step
+	pushString(remote_op::INSTANTIATE, 0, instance_name);
+	remote_command* c = push(remote_op::INITIALIZE, 0);
+	c->real = time;
+	c->integer = 0;
+	remote_command* restore = nullptr;
+	if(checkpoint){
+		restore = push(remote_op::RESTORE_STATE, 0);
+		restore->real = time;
+	}
+	for(auto& input : last_real_inputs)
+		push(remote_op::SET_REAL, input.first)->real = input.second;
+	for(auto& input : last_integer_inputs)
+		push(remote_op::SET_INTEGER, input.first)->integer = input.second;
+	for(auto& input : last_boolean_inputs)
+		push(remote_op::SET_BOOLEAN, input.first)->integer = input.second;
+	for(auto& input : last_string_inputs)
+		pushString(remote_op::SET_STRING, input.first, input.second);
+	post();
+	if(!wait())
+		xbt_die("the worker of FMU %s died again while restarting",fmu_name.c_str());
+	if(restore != nullptr && restore->status > fmiWarning)
+		XBT_WARN("can not restore the state of FMU %s from its last step (the internal state of the FMU is reset to its initial values)",fmu_name.c_str());
+
+	// replay the interrupted batch
+	std::copy(batch.begin(), batch.end(), channel->commands);
+	std::copy(batch_strings.begin(), batch_strings.end(), channel->strings);
+	channel->nb_commands = batch.size();
+	channel->string_used = batch_strings.size();
+	post();
+	if(!wait())
+		xbt_die("the worker of FMU %s died again while replaying its last commands",fmu_name.c_str());
+}
+
+remote_command* RemoteFMU::push(remote_op op, fmiValueReference valref){
+	if(step_pending)
+		finishStep();
+	if(channel->nb_commands == REMOTE_MAX_COMMANDS)
+		flush();
+	remote_command* c = &channel->commands[channel->nb_commands++];
+	c->op = op;
+	c->status = fmiOK;
+	c->valref = valref;
+	return c;
+}
+
+remote_command* RemoteFMU::pushString(remote_op op, fmiValueReference valref, const std::string& value){
+	if(value.size() > REMOTE_STRING_AREA)
+		xbt_die("string of %zu characters too long for the worker of FMU %s",value.size(),fmu_name.c_str());
+	if(step_pending)
+		finishStep();
+	if(channel->string_used + value.size() > REMOTE_STRING_AREA)
+		flush();
+	remote_command* c = push(op, valref);
+	c->str_offset = channel->string_used;
+	c->str_length = value.size();
+	std::memcpy(channel->strings + channel->string_used, value.data(), value.size());
+	channel->string_used += value.size();
+	return c;
+}
+
+void RemoteFMU::post(){
+	uint32_t request = channel->request_seq.load() + 1;
+	channel->request_seq.store(request, std::memory_order_release);
+	futexWake(&channel->request_seq);
+}
+
+bool RemoteFMU::wait(){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint32_t request = channel->request_seq.load();
+	int spin = 0;
+	while(channel->response_seq.load(std::memory_order_acquire) != request){
+		if(++spin > spin_iterations){
+			// sleep on the futex, and check regularly that the worker is still alive
+			futexWait(&channel->response_seq, channel->response_seq.load(), 50000000L);
+			if(channel->response_seq.load(std::memory_order_acquire) != request && waitpid(worker, nullptr, WNOHANG) != 0)
+				return false;
+		}
+	}
+	round_trips++;
+	round_trip_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+void RemoteFMU::flush(){
+	if(step_pending){
+		finishStep();
+		return;
+	}
+	if(channel->nb_commands == 0)
+		return;
+	post();
+	if(!wait())
+		restartWorker();
+	// results of the batch are read by the caller before the next push
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+}
+
+void RemoteFMU::startStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize){
+	remote_command* c = push(remote_op::DO_STEP, 0);
+	c->real = currentCommunicationPoint;
+	c->real2 = communicationStepSize;
+	post();
+	step_pending = true;
+}
+
+fmiStatus RemoteFMU::finishStep(){
+	step_pending = false;
+	if(!wait())
+		restartWorker();
+
+	// the doStep is the last command of the batch, after the pending setters
+	last_status = fmiOK;
+	for(uint32_t i = 0; i < channel->nb_commands && last_status == fmiOK; i++)
+		last_status = (fmiStatus) channel->commands[i].status;
+	if(last_status == fmiOK){
+		remote_command& c = channel->commands[channel->nb_commands - 1];
+		time = c.real + c.real2;
+	}
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status;
+}
+
+unsigned long long RemoteFMU::getRoundTrips(){
+	return round_trips;
+}
+
+double RemoteFMU::getRoundTripTime(){
+	return round_trip_time;
+}
+
+unsigned long long RemoteFMU::getRestarts(){
+	return restarts;
+}
+
+void RemoteFMU::resetCounters(){
+	round_trips = 0;
+	round_trip_time = 0;
+	restarts = 0;
+}
+
+fmiStatus RemoteFMU::reset(){
+	if(step_pending)
+		finishStep();
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	push(remote_op::TERMINATE, 0);
+	post();
+	waitpid(worker, nullptr, 0);
+	channel->response_seq.store(channel->request_seq.load());
+	channel->nb_commands = 0;
+
+	last_real_inputs.clear();
+	last_integer_inputs.clear();
+	last_boolean_inputs.clear();
+	last_string_inputs.clear();
+	time = 0;
+	clearCheckpoints();
+
+	spawnWorker();
+	return instantiate(instance_name, 0, fmiFalse, fmiFalse);
+}
+
+fmiStatus RemoteFMU::instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive){
+	instance_name = instanceName;
+	pushString(remote_op::INSTANTIATE, 0, instanceName);
+	post();
+	if(!wait())
+		xbt_die("the worker of FMU %s died during the instantiation",fmu_name.c_str());
+	fmiStatus status = (fmiStatus) channel->commands[channel->nb_commands - 1].status;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status = status;
+}
+
+fmiStatus RemoteFMU::initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime){
+	remote_command* c = push(remote_op::INITIALIZE, 0);
+	c->real = startTime;
+	c->integer = stopTimeDefined;
+	c->real2 = stopTime;
+	time = startTime;
+	start_time = startTime;
+	flush();
+	return last_status;
+}
+
+fmiReal RemoteFMU::getTime() const{
+	return time;
+}
+
+fmiStatus RemoteFMU::doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep){
+	startStep(currentCommunicationPoint, communicationStepSize);
+	return finishStep();
+}
+
+/*
+ * SETTERS: batched until the next getter or doStep
+ */
+
+fmiStatus RemoteFMU::setValue(fmiValueReference valref, const fmiReal& val){
+	push(remote_op::SET_REAL, valref)->real = val;
+	last_real_inputs[valref] = val;
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference valref, const fmiInteger& val){
+	push(remote_op::SET_INTEGER, valref)->integer = val;
+	last_integer_inputs[valref] = val;
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference valref, const fmiBoolean& val){
+	push(remote_op::SET_BOOLEAN, valref)->integer = val;
+	last_boolean_inputs[valref] = val;
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference valref, const std::string& val){
+	pushString(remote_op::SET_STRING, valref, val);
+	last_string_inputs[valref] = val;
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++)
+		setValue(valref[i], val[i]);
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++)
+		setValue(valref[i], val[i]);
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++)
+		setValue(valref[i], val[i]);
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(fmiValueReference* valref, const std::string* val, std::size_t ival){
+	for(std::size_t i = 0; i < ival; i++)
+		setValue(valref[i], val[i]);
+	return last_status = fmiOK;
+}
+
+fmiStatus RemoteFMU::setValue(const std::string& name, const fmiReal& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::setValue(const std::string& name, const fmiInteger& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::setValue(const std::string& name, const fmiBoolean& val){
+	return setValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::setValue(const std::string& name, const std::string& val){
+	return setValue(getValueRef(name), val);
+}
+
+/*
+ * GETTERS: flush the pending setters with the request
+ */
+
+fmiStatus RemoteFMU::getValue(fmiValueReference valref, fmiReal& val){
+	push(remote_op::GET_REAL, valref);
+	uint32_t i = channel->nb_commands - 1;
+	post();
+	if(!wait())
+		restartWorker();
+	val = channel->commands[i].real;
+	last_status = (fmiStatus) channel->commands[i].status;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference valref, fmiInteger& val){
+	push(remote_op::GET_INTEGER, valref);
+	uint32_t i = channel->nb_commands - 1;
+	post();
+	if(!wait())
+		restartWorker();
+	val = channel->commands[i].integer;
+	last_status = (fmiStatus) channel->commands[i].status;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference valref, fmiBoolean& val){
+	push(remote_op::GET_BOOLEAN, valref);
+	uint32_t i = channel->nb_commands - 1;
+	post();
+	if(!wait())
+		restartWorker();
+	val = (fmiBoolean) channel->commands[i].integer;
+	last_status = (fmiStatus) channel->commands[i].status;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference valref, std::string& val){
+	push(remote_op::GET_STRING, valref);
+	uint32_t i = channel->nb_commands - 1;
+	post();
+	if(!wait())
+		restartWorker();
+	val = readString(channel, channel->commands[i]);
+	last_status = (fmiStatus) channel->commands[i].status;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+	return last_status;
+}
+
+/**
+ * push the getters of valref that fit in the batch (after the pending setters), post it and wait
+ * for it: return the number of getters sent, which are the last commands of the batch
+ */
+std::size_t RemoteFMU::postGetters(remote_op op, fmiValueReference* valref, std::size_t ival){
+	std::size_t n = 0;
+	do{
+		push(op, valref[n++]);
+	}while(n < ival && channel->nb_commands < REMOTE_MAX_COMMANDS);
+	post();
+	if(!wait())
+		restartWorker();
+	return n;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival){
+	last_status = fmiOK;
+	for(std::size_t i = 0; i < ival && last_status == fmiOK; ){
+		std::size_t n = postGetters(remote_op::GET_REAL, valref + i, ival - i);
+		remote_command* c = channel->commands + channel->nb_commands - n;
+		for(std::size_t j = 0; j < n; j++, i++){
+			val[i] = c[j].real;
+			if(last_status == fmiOK)
+				last_status = (fmiStatus) c[j].status;
+		}
+		channel->nb_commands = 0;
+		channel->string_used = 0;
+	}
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival){
+	last_status = fmiOK;
+	for(std::size_t i = 0; i < ival && last_status == fmiOK; ){
+		std::size_t n = postGetters(remote_op::GET_INTEGER, valref + i, ival - i);
+		remote_command* c = channel->commands + channel->nb_commands - n;
+		for(std::size_t j = 0; j < n; j++, i++){
+			val[i] = c[j].integer;
+			if(last_status == fmiOK)
+				last_status = (fmiStatus) c[j].status;
+		}
+		channel->nb_commands = 0;
+		channel->string_used = 0;
+	}
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival){
+	last_status = fmiOK;
+	for(std::size_t i = 0; i < ival && last_status == fmiOK; ){
+		std::size_t n = postGetters(remote_op::GET_BOOLEAN, valref + i, ival - i);
+		remote_command* c = channel->commands + channel->nb_commands - n;
+		for(std::size_t j = 0; j < n; j++, i++){
+			val[i] = (fmiBoolean) c[j].integer;
+			if(last_status == fmiOK)
+				last_status = (fmiStatus) c[j].status;
+		}
+		channel->nb_commands = 0;
+		channel->string_used = 0;
+	}
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(fmiValueReference* valref, std::string* val, std::size_t ival){
+	// the strings read by the worker share the string area of the batch: a string that does not fit
+	// fails with fmiError, as for a single getter
+	last_status = fmiOK;
+	for(std::size_t i = 0; i < ival && last_status == fmiOK; ){
+		std::size_t n = postGetters(remote_op::GET_STRING, valref + i, ival - i);
+		remote_command* c = channel->commands + channel->nb_commands - n;
+		for(std::size_t j = 0; j < n; j++, i++){
+			val[i] = readString(channel, c[j]);
+			if(last_status == fmiOK)
+				last_status = (fmiStatus) c[j].status;
+		}
+		channel->nb_commands = 0;
+		channel->string_used = 0;
+	}
+	return last_status;
+}
+
+fmiStatus RemoteFMU::getValue(const std::string& name, fmiReal& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::getValue(const std::string& name, fmiInteger& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::getValue(const std::string& name, fmiBoolean& val){
+	return getValue(getValueRef(name), val);
+}
+
+fmiStatus RemoteFMU::getValue(const std::string& name, std::string& val){
+	return getValue(getValueRef(name), val);
+}
+
+/*
+ * MODEL DESCRIPTION: resolved once by the worker, then cached
+ */
+
+fmiValueReference RemoteFMU::getValueRef(const std::string& name) const{
+	std::unordered_map<std::string,fmiValueReference>::const_iterator it = refs.find(name);
+	if(it != refs.end())
+		return it->second;
+
+	RemoteFMU* self = const_cast<RemoteFMU*>(this);
+	self->pushString(remote_op::VALUE_REF, 0, name);
+	uint32_t i = channel->nb_commands - 1;
+	self->post();
+	if(!self->wait())
+		self->restartWorker();
+	fmiValueReference valref = channel->commands[i].valref;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+
+	refs[name] = valref;
+	return valref;
+}
+
+FMIVariableType RemoteFMU::getType(const std::string& variableName) const{
+	std::unordered_map<std::string,FMIVariableType>::const_iterator it = types.find(variableName);
+	if(it != types.end())
+		return it->second;
+
+	RemoteFMU* self = const_cast<RemoteFMU*>(this);
+	self->pushString(remote_op::TYPE, 0, variableName);
+	uint32_t i = channel->nb_commands - 1;
+	self->post();
+	if(!self->wait())
+		self->restartWorker();
+	FMIVariableType type = (FMIVariableType) channel->commands[i].integer;
+	channel->nb_commands = 0;
+	channel->string_used = 0;
+
+	types[variableName] = type;
+	return type;
+}
+
+fmiStatus RemoteFMU::getLastStatus() const{
+	return last_status;
+}
+
+std::size_t RemoteFMU::nStates() const{
+	return 0;
+}
+
+std::size_t RemoteFMU::nEventInds() const{
+	return 0;
+}
+
+std::size_t RemoteFMU::nValueRefs() const{
+	return 0;
+}
+
+const ModelDescription* RemoteFMU::getModelDescription() const{
+	return nullptr;
+}
+
+void RemoteFMU::sendDebugMessage(const std::string& msg) const{
+	XBT_DEBUG("%s",msg.c_str());
+}
+
+void RemoteFMU::logger(fmiStatus status, const std::string& category, const std::string& msg) const{
+	XBT_DEBUG("[%s] %s",category.c_str(),msg.c_str());
+}
+
+}
+}
@@ -0,0 +1,185 @@
+#ifndef SRC_REMOTE_MODEL_HPP_
+#define SRC_REMOTE_MODEL_HPP_
+
+#include "simgrid-fmi.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * operations carried from the master to an FMU worker
+ */
+enum class remote_op : uint32_t { INSTANTIATE, INITIALIZE, DO_STEP, VALUE_REF, TYPE,
+	SET_REAL, SET_INTEGER, SET_BOOLEAN, SET_STRING, GET_REAL, GET_INTEGER, GET_BOOLEAN, GET_STRING, RESTORE_STATE, TERMINATE };
+
+/**
+ * one command of a batch (strings are stored in the string area of the channel)
+ */
+struct remote_command{
+	remote_op op;
+	int32_t status;
+	uint32_t valref;
+	int32_t integer;
+	double real;
+	double real2;
+	uint32_t str_offset;
+	uint32_t str_length;
+};
+
+#define REMOTE_MAX_COMMANDS 1024
+#define REMOTE_STRING_AREA (64*1024)
+#define REMOTE_STATE_AREA (512*1024)
+
+/**
+ * serialized state of the model after a step at time, written by the worker (size is 0 while it is
+ * written, or when the model can not serialize its state)
+ */
+struct remote_checkpoint{
+	std::atomic<uint32_t> size;
+	double time;
+	char data[REMOTE_STATE_AREA];
+};
+
+/**
+ * shared memory between the master and a worker. The master fills a batch of commands and
+ * increments request_seq; the worker executes them in order, writes their results in place
+ * and sets response_seq to request_seq. Both counters are also used as futex words.
+ */
+struct remote_channel{
+	std::atomic<uint32_t> request_seq;
+	std::atomic<uint32_t> response_seq;
+	uint32_t nb_commands;
+	uint32_t string_used;
+	remote_command commands[REMOTE_MAX_COMMANDS];
+	char strings[REMOTE_STRING_AREA];
+	remote_checkpoint checkpoints[2]; // written alternately, so that one is complete if the worker dies
+};
+
+/**
+ * Proxy of a co-simulation model running in a worker process.
+ *
+ * The worker is forked by the master and builds its model with the given factory, so a crash
+ * of the FMU only kills the worker. Setters are batched in shared memory and sent with the next
+ * getter or doStep, and the getters of an array are sent in the same batch. startStep() posts a doStep without waiting for it, which lets the master
+ * step all its workers in parallel before collecting them with finishStep().
+ * After each step, a worker whose model can serialize its state (FMI 3.0 FMUs, native models)
+ * writes it in a checkpoint of the shared memory. When the worker dies, it is forked again, the
+ * model is instantiated and initialized at the time of the last successful step, its state is
+ * restored from the checkpoint of that step, the last value set on each input is applied again and
+ * the interrupted batch is replayed. Without a checkpoint (fmipp FMUs), the internal state of the
+ * FMU is not recovered.
+ */
+class RemoteFMU : public FMUCoSimulationBase{
+
+public:
+	RemoteFMU(std::function<FMUCoSimulationBase*()> factory, std::string fmu_name);
+	~RemoteFMU();
+
+	/**
+	 * replace the worker by a new one and instantiate the model again
+	 */
+	fmiStatus reset();
+
+	void startStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize);
+	fmiStatus finishStep();
+
+	/**
+	 * number of round trips to the worker and total time spent waiting for them (in seconds)
+	 */
+	unsigned long long getRoundTrips();
+	double getRoundTripTime();
+	unsigned long long getRestarts();
+	void resetCounters();
+
+	fmiStatus instantiate(const std::string& instanceName, const fmiReal timeout, const fmiBoolean visible, const fmiBoolean interactive) override;
+	fmiStatus initialize(const fmiReal startTime, const fmiBoolean stopTimeDefined, const fmiReal stopTime) override;
+	fmiReal getTime() const override;
+	fmiStatus doStep(fmiReal currentCommunicationPoint, fmiReal communicationStepSize, fmiBoolean newStep) override;
+
+	fmiStatus setValue(fmiValueReference valref, const fmiReal& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiInteger& val) override;
+	fmiStatus setValue(fmiValueReference valref, const fmiBoolean& val) override;
+	fmiStatus setValue(fmiValueReference valref, const std::string& val) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiReal* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiInteger* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const fmiBoolean* val, std::size_t ival) override;
+	fmiStatus setValue(fmiValueReference* valref, const std::string* val, std::size_t ival) override;
+	fmiStatus setValue(const std::string& name, const fmiReal& val) override;
+	fmiStatus setValue(const std::string& name, const fmiInteger& val) override;
+	fmiStatus setValue(const std::string& name, const fmiBoolean& val) override;
+	fmiStatus setValue(const std::string& name, const std::string& val) override;
+
+	fmiStatus getValue(fmiValueReference valref, fmiReal& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiInteger& val) override;
+	fmiStatus getValue(fmiValueReference valref, fmiBoolean& val) override;
+	fmiStatus getValue(fmiValueReference valref, std::string& val) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiReal* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiInteger* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, fmiBoolean* val, std::size_t ival) override;
+	fmiStatus getValue(fmiValueReference* valref, std::string* val, std::size_t ival) override;
+	fmiStatus getValue(const std::string& name, fmiReal& val) override;
+	fmiStatus getValue(const std::string& name, fmiInteger& val) override;
+	fmiStatus getValue(const std::string& name, fmiBoolean& val) override;
+	fmiStatus getValue(const std::string& name, std::string& val) override;
+
+	fmiValueReference getValueRef(const std::string& name) const override;
+	FMIVariableType getType(const std::string& variableName) const override;
+	fmiStatus getLastStatus() const override;
+	std::size_t nStates() const override;
+	std::size_t nEventInds() const override;
+	std::size_t nValueRefs() const override;
+	const ModelDescription* getModelDescription() const override;
+	void sendDebugMessage(const std::string& msg) const override;
+	void logger(fmiStatus status, const std::string& category, const std::string& msg) const override;
+
+private:
+	std::function<FMUCoSimulationBase*()> factory;
+	std::string fmu_name;
+	std::string instance_name;
+	remote_channel* channel;
+	pid_t worker;
+	bool step_pending;
+
+	double time;
+	double start_time;
+	fmiStatus last_status;
+
+	/**
+	 * name resolution done once by the worker (mutable since getValueRef and getType are const)
+	 */
+	mutable std::unordered_map<std::string,fmiValueReference> refs;
+	mutable std::unordered_map<std::string,FMIVariableType> types;
+
+	/**
+	 * last value set on each input, applied again when the worker is restarted
+	 */
+	std::unordered_map<fmiValueReference,double> last_real_inputs;
+	std::unordered_map<fmiValueReference,int> last_integer_inputs;
+	std::unordered_map<fmiValueReference,fmiBoolean> last_boolean_inputs;
+	std::unordered_map<fmiValueReference,std::string> last_string_inputs;
+
+	unsigned long long round_trips;
+	double round_trip_time;
+	unsigned long long restarts;
+
+	void spawnWorker();
+	void restartWorker();
+	void clearCheckpoints();
+	remote_command* push(remote_op op, fmiValueReference valref);
+	remote_command* pushString(remote_op op, fmiValueReference valref, const std::string& value);
+	void post();
+	bool wait();
+	std::size_t postGetters(remote_op op, fmiValueReference* valref, std::size_t ival);
+	void flush();
+};
+
+}
+}
+
+#endif /* SRC_REMOTE_MODEL_HPP_ */
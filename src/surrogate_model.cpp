@@ -0,0 +1,566 @@
+#include "simgrid-fmi.hpp"
+#include <simgrid/simix.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_surrogate, surf, "Logging specific to the surrogate models of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * a recorded value of the inputs and outputs of an FMU
+ */
+struct surrogate_sample{
+	double time;
+	std::vector<double> inputs;
+	std::vector<double> outputs;
+};
+
+/**
+ * solve m.x = r in place (r holds nb_rhs right-hand sides per row) by Gaussian elimination with
+ * partial pivoting, return false if m is singular
+ */
+static bool solve(std::vector<double>& m, std::vector<double>& r, std::size_t n, std::size_t nb_rhs){
+	for(std::size_t col = 0; col < n; col++){
+		std::size_t pivot = col;
+		for(std::size_t row = col + 1; row < n; row++){
+			if(std::fabs(m[row*n + col]) > std::fabs(m[pivot*n + col]))
+				pivot = row;
+		}
+		if(m[pivot*n + col] == 0)
+			return false;
+		if(pivot != col){
+			for(std::size_t k = 0; k < n; k++)
+				std::swap(m[col*n + k], m[pivot*n + k]);
+			for(std::size_t k = 0; k < nb_rhs; k++)
+				std::swap(r[col*nb_rhs + k], r[pivot*nb_rhs + k]);
+		}
+		for(std::size_t row = 0; row < n; row++){
+			if(row == col || m[row*n + col] == 0)
+				continue;
+			double factor = m[row*n + col] / m[col*n + col];
+			for(std::size_t k = col; k < n; k++)
+				m[row*n + k] -= factor * m[col*n + k];
+			for(std::size_t k = 0; k < nb_rhs; k++)
+				r[row*nb_rhs + k] -= factor * r[col*nb_rhs + k];
+		}
+	}
+	for(std::size_t row = 0; row < n; row++){
+		for(std::size_t k = 0; k < nb_rhs; k++)
+			r[row*nb_rhs + k] /= m[row*n + row];
+	}
+	return true;
+}
+
+/**
+ * read the rows of an output log of the master (time;port;port...), keeping the last row of each time
+ */
+static std::vector<surrogate_sample> readLog(const std::string& log_file, const std::vector<std::size_t>& input_columns,
+		const std::vector<std::size_t>& output_columns){
+
+	std::ifstream log(log_file);
+	if(!log.is_open())
+		xbt_die("can not open the output log %s",log_file.c_str());
+
+	std::vector<surrogate_sample> samples;
+	std::vector<double> columns;
+	std::string line, field;
+	while(std::getline(log, line)){
+		columns.clear();
+		std::istringstream fields(line);
+		while(std::getline(fields, field, ';'))
+			columns.push_back(std::strtod(field.c_str(), nullptr));
+		if(columns.empty())
+			continue;
+
+		surrogate_sample sample;
+		sample.time = columns[0];
+		for(std::size_t column : input_columns){
+			if(column >= columns.size())
+				xbt_die("the output log %s has less columns than monitored ports",log_file.c_str());
+			sample.inputs.push_back(columns[column]);
+		}
+		for(std::size_t column : output_columns){
+			if(column >= columns.size())
+				xbt_die("the output log %s has less columns than monitored ports",log_file.c_str());
+			sample.outputs.push_back(columns[column]);
+		}
+		if(!samples.empty() && samples.back().time == sample.time)
+			samples.back() = sample;
+		else
+			samples.push_back(sample);
+	}
+	return samples;
+}
+
+static std::size_t logColumn(const std::vector<port>& monitored_ports, const std::string& fmu_name, const std::string& port_name){
+	for(std::size_t i = 0; i < monitored_ports.size(); i++){
+		if(monitored_ports[i].fmu == fmu_name && monitored_ports[i].name == port_name)
+			return i + 1; // after the time
+	}
+	xbt_die("port %s of FMU %s is not monitored in the output logs",port_name.c_str(),fmu_name.c_str());
+}
+
+
+/**
+ * SurrogateModel
+ */
+
+SurrogateModel::SurrogateModel(const std::vector<std::string>& inputs, const std::vector<std::string>& outputs){
+	tabulated = false;
+	output_names = outputs;
+	out_of_envelope = 0;
+	fit_step = 0;
+	// sized once, as the ports point to their elements
+	this->inputs.assign(inputs.size(), 0);
+	this->outputs.assign(outputs.size(), 0);
+	errors.assign(outputs.size(), 0);
+	clamped.assign(inputs.size(), 0);
+	fractions.assign(inputs.size(), 0);
+	derivatives.assign(outputs.size(), 0);
+	for(std::size_t i = 0; i < inputs.size(); i++)
+		addRealPort(inputs[i], &this->inputs[i]);
+	for(std::size_t i = 0; i < outputs.size(); i++)
+		addRealPort(outputs[i], &this->outputs[i]);
+}
+
+SurrogateModel* SurrogateModel::tabulate(FMUCoSimulationBase* model, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs,
+		double settle_time, double step_size){
+
+	StatefulModel* stateful = dynamic_cast<StatefulModel*>(model);
+	if(stateful == nullptr || !stateful->canSaveState())
+		xbt_die("the FMU can not save its state: it can not be tabulated");
+	if(inputs.empty() || outputs.empty())
+		xbt_die("a surrogate model needs at least one input and one output");
+	if(!(settle_time > 0) || !(step_size > 0))
+		xbt_die("the settle time and the step of a tabulation must be positive");
+
+	std::vector<std::string> input_names;
+	for(const surrogate_axis& axis : inputs){
+		if(axis.points < 2 || !(axis.max > axis.min))
+			xbt_die("input %s of a surrogate model needs at least 2 points over a non-empty range",axis.name.c_str());
+		if(model->getType(axis.name) != FMIVariableType::fmiTypeReal)
+			xbt_die("input %s of a surrogate model is not a real port of the FMU",axis.name.c_str());
+		input_names.push_back(axis.name);
+	}
+	for(const std::string& output : outputs){
+		if(model->getType(output) != FMIVariableType::fmiTypeReal)
+			xbt_die("output %s of a surrogate model is not a real port of the FMU",output.c_str());
+	}
+
+	SurrogateModel* surrogate = new SurrogateModel(input_names, outputs);
+	surrogate->tabulated = true;
+	surrogate->axes = inputs;
+	surrogate->strides.assign(inputs.size(), 1);
+	for(std::size_t i = inputs.size() - 1; i > 0; i--)
+		surrogate->strides[i-1] = surrogate->strides[i] * inputs[i].points;
+	std::size_t nb_points = surrogate->strides[0] * inputs[0].points;
+	for(std::size_t i = 0; i < inputs.size(); i++){
+		surrogate->input_min.push_back(inputs[i].min);
+		surrogate->input_max.push_back(inputs[i].max);
+		// the surrogate starts with the current inputs of the FMU
+		if(model->getValue(input_names[i], surrogate->inputs[i]) != fmiOK)
+			xbt_die("can not read the input %s of the FMU to tabulate",input_names[i].c_str());
+	}
+
+	void* state = nullptr;
+	stateful->allowStateRestores(true);
+	if(stateful->saveState(&state) != fmiOK)
+		xbt_die("the FMU failed to save its state before being tabulated");
+	const double time = model->getTime();
+	const int nb_steps = std::max(1, (int) std::ceil(settle_time / step_size - 1e-9));
+	const double dt = settle_time / nb_steps;
+
+	// outputs of the FMU after settling from the saved state with the inputs of a point
+	auto sample = [&](const std::vector<double>& point, double* values){
+		if(stateful->restoreState(state) != fmiOK)
+			xbt_die("the FMU failed to restore its state during the tabulation");
+		for(std::size_t i = 0; i < point.size(); i++){
+			if(model->setValue(input_names[i], point[i]) != fmiOK)
+				xbt_die("the FMU failed to set its input %s to %f during the tabulation",input_names[i].c_str(),point[i]);
+		}
+		for(int k = 0; k < nb_steps; k++){
+			if(model->doStep(time + k * dt, dt, fmiTrue) != fmiOK)
+				xbt_die("the FMU failed to step during the tabulation");
+		}
+		for(std::size_t o = 0; o < outputs.size(); o++){
+			if(model->getValue(outputs[o], values[o]) != fmiOK)
+				xbt_die("the FMU failed to return its output %s during the tabulation",outputs[o].c_str());
+		}
+	};
+
+	std::vector<double> point(inputs.size());
+	surrogate->table.resize(nb_points * outputs.size());
+	for(std::size_t p = 0; p < nb_points; p++){
+		for(std::size_t i = 0; i < inputs.size(); i++){
+			std::size_t k = (p / surrogate->strides[i]) % inputs[i].points;
+			point[i] = inputs[i].min + k * (inputs[i].max - inputs[i].min) / (inputs[i].points - 1);
+		}
+		sample(point, &surrogate->table[p * outputs.size()]);
+	}
+
+	// error bound: largest difference with the FMU at the center of the cells, where the interpolation is the farthest from the table
+	std::size_t nb_cells = 1;
+	for(const surrogate_axis& axis : inputs)
+		nb_cells *= axis.points - 1;
+	std::vector<double> exact(outputs.size()), approximation(outputs.size());
+	for(std::size_t cell = 0; cell < nb_cells; cell++){
+		std::size_t rest = cell;
+		for(std::size_t i = inputs.size(); i-- > 0;){
+			std::size_t k = rest % (inputs[i].points - 1);
+			rest /= inputs[i].points - 1;
+			point[i] = inputs[i].min + (k + 0.5) * (inputs[i].max - inputs[i].min) / (inputs[i].points - 1);
+		}
+		sample(point, exact.data());
+		surrogate->interpolate(point.data(), approximation.data());
+		for(std::size_t o = 0; o < outputs.size(); o++)
+			surrogate->errors[o] = std::max(surrogate->errors[o], std::fabs(exact[o] - approximation[o]));
+	}
+
+	if(stateful->restoreState(state) != fmiOK)
+		xbt_die("the FMU failed to restore its state after the tabulation");
+	stateful->freeState(state);
+
+	XBT_INFO("FMU tabulated on %zu points (%zu cells checked)",nb_points,nb_cells);
+	for(std::size_t o = 0; o < outputs.size(); o++)
+		XBT_INFO("  output %s: error bound %g",outputs[o].c_str(),surrogate->errors[o]);
+	return surrogate;
+}
+
+SurrogateModel* SurrogateModel::fit(std::vector<std::string> log_files, std::vector<port> monitored_ports, std::string fmu_name,
+		std::vector<std::string> inputs, std::vector<std::string> outputs){
+
+	if(outputs.empty())
+		xbt_die("a surrogate model needs at least one output");
+
+	std::vector<std::size_t> input_columns, output_columns;
+	for(const std::string& input : inputs)
+		input_columns.push_back(logColumn(monitored_ports, fmu_name, input));
+	for(const std::string& output : outputs)
+		output_columns.push_back(logColumn(monitored_ports, fmu_name, output));
+
+	const std::size_t nu = inputs.size();
+	const std::size_t ny = outputs.size();
+	const std::size_t n = ny + nu + 1; // regressors: outputs, inputs, constant
+
+	SurrogateModel* surrogate = new SurrogateModel(inputs, outputs);
+	surrogate->input_min.assign(nu, HUGE_VAL);
+	surrogate->input_max.assign(nu, -HUGE_VAL);
+	surrogate->fit_step = HUGE_VAL;
+
+	// normal equations of the least squares on (y(k+1) - y(k)) / dt = A.y(k) + B.u(k) + c
+	std::vector<double> m(n * n, 0), r(n * ny, 0), z(n);
+	std::vector<std::vector<surrogate_sample>> runs;
+	std::size_t nb_samples = 0;
+	for(const std::string& log_file : log_files){
+		runs.push_back(readLog(log_file, input_columns, output_columns));
+		const std::vector<surrogate_sample>& run = runs.back();
+		for(std::size_t k = 0; k + 1 < run.size(); k++){
+			double dt = run[k+1].time - run[k].time;
+			if(!(dt > 0))
+				continue;
+			std::copy(run[k].outputs.begin(), run[k].outputs.end(), z.begin());
+			std::copy(run[k].inputs.begin(), run[k].inputs.end(), z.begin() + ny);
+			z[n-1] = 1;
+			for(std::size_t i = 0; i < n; i++){
+				for(std::size_t j = 0; j < n; j++)
+					m[i*n + j] += z[i] * z[j];
+				for(std::size_t o = 0; o < ny; o++)
+					r[i*ny + o] += z[i] * (run[k+1].outputs[o] - run[k].outputs[o]) / dt;
+			}
+			for(std::size_t i = 0; i < nu; i++){
+				surrogate->input_min[i] = std::min(surrogate->input_min[i], run[k].inputs[i]);
+				surrogate->input_max[i] = std::max(surrogate->input_max[i], run[k].inputs[i]);
+			}
+			surrogate->fit_step = std::min(surrogate->fit_step, dt);
+			nb_samples++;
+		}
+	}
+	if(nb_samples < n)
+		xbt_die("not enough samples to fit a surrogate of FMU %s (%zu, at least %zu needed)",fmu_name.c_str(),nb_samples,n);
+
+	// a small ridge keeps the system solvable when an input did not vary in the runs
+	double trace = 0;
+	for(std::size_t i = 0; i < n; i++)
+		trace += m[i*n + i];
+	for(std::size_t i = 0; i < n; i++)
+		m[i*n + i] += 1e-12 * trace / n;
+	if(!solve(m, r, n, ny))
+		xbt_die("can not fit a surrogate of FMU %s on these runs",fmu_name.c_str());
+
+	surrogate->a.resize(ny * ny);
+	surrogate->b.resize(ny * nu);
+	surrogate->c.resize(ny);
+	for(std::size_t o = 0; o < ny; o++){
+		for(std::size_t j = 0; j < ny; j++)
+			surrogate->a[o*ny + j] = r[j*ny + o];
+		for(std::size_t k = 0; k < nu; k++)
+			surrogate->b[o*nu + k] = r[(ny + k)*ny + o];
+		surrogate->c[o] = r[(n - 1)*ny + o];
+	}
+
+	// error bound: largest one-step prediction error on the samples
+	std::vector<double> dy(ny);
+	for(const std::vector<surrogate_sample>& run : runs){
+		for(std::size_t k = 0; k + 1 < run.size(); k++){
+			double dt = run[k+1].time - run[k].time;
+			if(!(dt > 0))
+				continue;
+			surrogate->derive(run[k].outputs.data(), run[k].inputs.data(), dy.data());
+			for(std::size_t o = 0; o < ny; o++)
+				surrogate->errors[o] = std::max(surrogate->errors[o], std::fabs(run[k].outputs[o] + dt * dy[o] - run[k+1].outputs[o]));
+		}
+	}
+
+	for(const std::vector<surrogate_sample>& run : runs){
+		if(!run.empty()){
+			surrogate->start_inputs = run.front().inputs;
+			surrogate->start_outputs = run.front().outputs;
+			break;
+		}
+	}
+	surrogate->inputs = surrogate->start_inputs;
+	surrogate->outputs = surrogate->start_outputs;
+
+	XBT_INFO("surrogate of FMU %s fitted on %zu samples",fmu_name.c_str(),nb_samples);
+	for(std::size_t o = 0; o < ny; o++)
+		XBT_INFO("  output %s: error bound %g (one step)",outputs[o].c_str(),surrogate->errors[o]);
+	return surrogate;
+}
+
+double SurrogateModel::getErrorBound(std::string output) const{
+	for(std::size_t o = 0; o < output_names.size(); o++){
+		if(output_names[o] == output)
+			return errors[o];
+	}
+	xbt_die("the surrogate model has no output %s",output.c_str());
+}
+
+unsigned long long SurrogateModel::getOutOfEnvelopeSteps() const{
+	return out_of_envelope;
+}
+
+void SurrogateModel::start(double start_time){
+	if(!tabulated){
+		std::copy(start_inputs.begin(), start_inputs.end(), inputs.begin());
+		std::copy(start_outputs.begin(), start_outputs.end(), outputs.begin());
+		return;
+	}
+	clampInputs();
+	interpolate(clamped.data(), outputs.data());
+}
+
+void SurrogateModel::step(double current_time, double step_size){
+
+	clampInputs();
+
+	if(tabulated){
+		interpolate(clamped.data(), outputs.data());
+		return;
+	}
+
+	if(!(step_size > 0))
+		return;
+	// explicit Euler with steps no longer than those of the runs the model was fitted on
+	int nb_steps = std::max(1, (int) std::ceil(step_size / fit_step - 1e-9));
+	double dt = step_size / nb_steps;
+	for(int k = 0; k < nb_steps; k++){
+		derive(outputs.data(), clamped.data(), derivatives.data());
+		for(std::size_t o = 0; o < outputs.size(); o++)
+			outputs[o] += dt * derivatives[o];
+	}
+}
+
+/**
+ * the inputs and outputs are ports, the rest of the model is constant while it runs
+ */
+bool SurrogateModel::canSaveState() const{
+	return true;
+}
+
+void SurrogateModel::clampInputs(){
+	bool out = false;
+	for(std::size_t i = 0; i < inputs.size(); i++){
+		clamped[i] = std::min(std::max(inputs[i], input_min[i]), input_max[i]);
+		out = out || clamped[i] != inputs[i];
+	}
+	if(out && out_of_envelope++ == 0)
+		XBT_WARN("the inputs of a surrogate model left the envelope it was built on: they are clamped");
+}
+
+/**
+ * multilinear interpolation of the table. The outputs of a grid point are contiguous, so that the
+ * weighted sum over the corners of the cell is a loop over contiguous values, vectorized by the compiler
+ * (at -O3 with gcc).
+ */
+void SurrogateModel::interpolate(const double* point, double* values){
+
+	const std::size_t nb_outputs = output_names.size();
+	std::size_t base = 0;
+	for(std::size_t i = 0; i < axes.size(); i++){
+		double x = (point[i] - axes[i].min) / (axes[i].max - axes[i].min) * (axes[i].points - 1);
+		long k = std::min(std::max((long) std::floor(x), 0L), (long) axes[i].points - 2);
+		fractions[i] = x - k;
+		base += k * strides[i];
+	}
+
+	for(std::size_t o = 0; o < nb_outputs; o++)
+		values[o] = 0;
+	for(std::size_t corner = 0; corner < (std::size_t(1) << axes.size()); corner++){
+		double weight = 1;
+		std::size_t offset = base;
+		for(std::size_t i = 0; i < axes.size(); i++){
+			if(corner & (std::size_t(1) << i)){
+				weight *= fractions[i];
+				offset += strides[i];
+			}else{
+				weight *= 1 - fractions[i];
+			}
+		}
+		if(weight == 0)
+			continue;
+		const double* row = &table[offset * nb_outputs];
+		for(std::size_t o = 0; o < nb_outputs; o++)
+			values[o] += weight * row[o];
+	}
+}
+
+/**
+ * dy = A.y + B.u + c
+ */
+void SurrogateModel::derive(const double* y, const double* u, double* dy) const{
+	const std::size_t ny = output_names.size();
+	const std::size_t nu = inputs.size();
+	for(std::size_t o = 0; o < ny; o++){
+		double d = c[o];
+		for(std::size_t j = 0; j < ny; j++)
+			d += a[o*ny + j] * y[j];
+		for(std::size_t k = 0; k < nu; k++)
+			d += b[o*nu + k] * u[k];
+		dy[o] = d;
+	}
+}
+
+
+/**
+ * FMIPlugin
+ */
+
+SurrogateModel* FMIPlugin::tabulateFMU(std::string fmu_name, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs, double settle_time){
+	return master->tabulateFMU(fmu_name, inputs, outputs, settle_time);
+}
+
+void FMIPlugin::replaceFMU(std::string fmu_name, FMUCoSimulationBase* model){
+	master->replaceFMU(fmu_name, model);
+}
+
+
+/**
+ * MasterFMI
+ */
+
+SurrogateModel* MasterFMI::tabulateFMU(std::string fmu_name, std::vector<surrogate_axis> inputs, std::vector<std::string> outputs, double settle_time){
+	settle();
+	if(fmus.find(fmu_name) == fmus.end())
+		xbt_die("can not tabulate FMU %s: it does not exist",fmu_name.c_str());
+	XBT_INFO("tabulating FMU %s",fmu_name.c_str());
+	SurrogateModel* surrogate = SurrogateModel::tabulate(fmus[fmu_name], inputs, outputs, settle_time, commStep);
+	updateStateRestores();
+	return surrogate;
+}
+
+void MasterFMI::replaceFMU(std::string fmu_name, FMUCoSimulationBase* model){
+
+	checkNotReadyForSimulation();
+	if(trace.is_open())
+		xbt_die("FMU %s replaced while the inputs are recorded: replace it before FMIPlugin::recordInputs",fmu_name.c_str());
+	if(fmus.find(fmu_name) == fmus.end())
+		xbt_die("can not replace FMU %s: it does not exist",fmu_name.c_str());
+	if(remote_fmus.find(fmu_name) != remote_fmus.end())
+		xbt_die("FMU %s runs in a worker process: it can not be replaced",fmu_name.c_str());
+
+	FMUCoSimulationBase* original = fmus[fmu_name];
+	auto check = [&](const port& p){
+		if(p.fmu == fmu_name && model->getType(p.name) != original->getType(p.name))
+			xbt_die("the model replacing FMU %s has no port %s of the same type",fmu_name.c_str(),p.name.c_str());
+	};
+	for(auto it : couplings){
+		check(it.first);
+		check(it.second);
+	}
+	for(auto it : array_couplings){
+		check(it.first);
+		check(it.second);
+	}
+	for(const transformed_coupling& coupling : transformed_couplings)
+		check(coupling.in.p);
+	for(const port_handle& source : transformed_sources)
+		check(source.p);
+	for(const port_handle& handle : accumulated_ports)
+		check(handle.p);
+	for(const real_simgrid_fmu_connection& coupling : real_ext_couplings)
+		check(coupling.in);
+	for(const integer_simgrid_fmu_connection& coupling : integer_ext_couplings)
+		check(coupling.in);
+	for(const boolean_simgrid_fmu_connection& coupling : boolean_ext_couplings)
+		check(coupling.in);
+	for(const string_simgrid_fmu_connection& coupling : string_ext_couplings)
+		check(coupling.in);
+	for(const host_group_power& group : host_groups)
+		check(group.in);
+	for(const port& p : monitored_ports)
+		check(p);
+	for(const resource_binding& binding : resource_bindings)
+		check(binding.out.p);
+	for(const port_handle& handle : snapshot_ports)
+		check(handle.p);
+	for(auto it : histories)
+		check(it.first);
+
+	model->instantiate(fmu_name, 0, fmiFalse, fmiFalse);
+	if(model->initialize(SIMIX_get_clock(), false, -1) != fmiOK)
+		xbt_die("the model replacing FMU %s failed to initialize",fmu_name.c_str());
+
+	// the value references of the original FMU are resolved again on the new model
+	for(resource_binding& binding : resource_bindings){
+		if(binding.out.p.fmu == fmu_name)
+			binding.out.valref = model->getValueRef(binding.out.p.name);
+	}
+	for(port_handle& handle : snapshot_ports){
+		if(handle.p.fmu == fmu_name)
+			handle.valref = model->getValueRef(handle.p.name);
+	}
+	for(transformed_coupling& coupling : transformed_couplings){
+		if(coupling.in.p.fmu == fmu_name)
+			coupling.in.valref = model->getValueRef(coupling.in.p.name);
+	}
+	for(port_handle& source : transformed_sources){
+		if(source.p.fmu == fmu_name)
+			source.valref = model->getValueRef(source.p.name);
+	}
+	for(port_handle& handle : accumulated_ports){
+		if(handle.p.fmu == fmu_name)
+			handle.valref = model->getValueRef(handle.p.name);
+	}
+	for(auto& it : histories){
+		if(it.first.fmu == fmu_name)
+			it.second.valref = model->getValueRef(it.first.name);
+	}
+
+	freeStepStates();
+	fmus[fmu_name] = model;
+	fmu_table[fmu_indexes[fmu_name]] = model;
+	updateStateRestores();
+	if(fmu_uris.find(fmu_name) != fmu_uris.end()){
+		fmu_uris.erase(fmu_name);
+		delete original;
+	}
+	XBT_INFO("FMU %s replaced",fmu_name.c_str());
+}
+
+}
+}
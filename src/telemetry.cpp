@@ -0,0 +1,167 @@
+#include "simgrid-fmi.hpp"
+#include "simgrid-fmi-telemetry.hpp"
+#include <simgrid/simix.hpp>
+#include <simgrid/s4u/Engine.hpp>
+#include <cerrno>
+#include <new>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_telemetry, surf, "Logging specific to the telemetry of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+/**
+ * single writer of a telemetry file (see simgrid-fmi-telemetry.hpp): the values of a row are
+ * written in place in the mapping, between beginRow and endRow
+ */
+class TelemetryWriter{
+
+public:
+	TelemetryWriter(const std::string& file_path, const std::vector<std::string>& names, std::size_t capacity){
+
+		std::size_t names_size = 0;
+		for(const std::string& name : names)
+			names_size += name.size() + 1;
+		const uint64_t names_offset = sizeof(telemetry_header);
+		const uint64_t rows_offset = (names_offset + names_size + 63) / 64 * 64;
+		const uint64_t row_size = (sizeof(telemetry_row) + names.size() * sizeof(double) + 7) / 8 * 8;
+		size = rows_offset + capacity * row_size;
+
+		int fd = ::open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0 || ftruncate(fd, size) != 0)
+			xbt_die("can not create the telemetry file %s: %s",file_path.c_str(),strerror(errno));
+		void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED)
+			xbt_die("can not map the telemetry file %s: %s",file_path.c_str(),strerror(errno));
+		data = static_cast<char*>(map);
+
+		// the file is zeroed by ftruncate: the magic is written last, so that readers never see a partial header
+		header = new (data) telemetry_header;
+		header->format = TELEMETRY_FORMAT;
+		header->nb_ports = names.size();
+		header->capacity = capacity;
+		header->names_offset = names_offset;
+		header->rows_offset = rows_offset;
+		header->row_size = row_size;
+		header->rows.store(0, std::memory_order_relaxed);
+		header->finished.store(0, std::memory_order_relaxed);
+		char* name = data + names_offset;
+		for(const std::string& n : names){
+			std::memcpy(name, n.c_str(), n.size() + 1);
+			name += n.size() + 1;
+		}
+		for(std::size_t i = 0; i < capacity; i++)
+			new (data + rows_offset + i * row_size) telemetry_row();
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(header->magic, TELEMETRY_MAGIC, sizeof(header->magic));
+		next = 0;
+	}
+
+	~TelemetryWriter(){
+		header->finished.store(1, std::memory_order_release);
+		munmap(data, size);
+	}
+
+	/**
+	 * start row number next: return where its values are to be written
+	 */
+	double* beginRow(double time){
+		row = reinterpret_cast<telemetry_row*>(data + header->rows_offset + (next % header->capacity) * header->row_size);
+		row->sequence.store(2 * next + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		row->time = time;
+		return reinterpret_cast<double*>(reinterpret_cast<char*>(row) + sizeof(telemetry_row));
+	}
+
+	void endRow(){
+		row->sequence.store(2 * next + 2, std::memory_order_release);
+		next++;
+		header->rows.store(next, std::memory_order_release);
+	}
+
+private:
+	char* data;
+	std::size_t size;
+	telemetry_header* header;
+	telemetry_row* row;
+	uint64_t next;
+};
+
+
+/**
+ * FMIPlugin
+ */
+
+void FMIPlugin::enableTelemetry(std::string file_path, std::vector<port> ports, std::size_t capacity){
+	simgrid::simix::simcall([file_path,ports,capacity]() {
+		master->enableTelemetry(file_path, ports, capacity);
+	});
+	static bool stop_connected = false;
+	if(!stop_connected){
+		stop_connected = true;
+		simgrid::s4u::on_simulation_end.connect([]() {
+			master->disableTelemetry();
+		});
+	}
+}
+
+void FMIPlugin::disableTelemetry(){
+	simgrid::simix::simcall([]() {
+		master->disableTelemetry();
+	});
+}
+
+
+/**
+ * MasterFMI
+ */
+
+void MasterFMI::enableTelemetry(std::string file_path, std::vector<port> ports, std::size_t capacity){
+
+	settle();
+	disableTelemetry();
+	if(capacity == 0)
+		xbt_die("the telemetry needs a capacity of at least one row");
+
+	std::vector<std::string> names;
+	for(const port& p : ports){
+		checkPortValidity(p.fmu, p.name, FMIVariableType::fmiTypeUnknown, false);
+		FMIVariableType type = fmus[p.fmu]->getType(p.name);
+		if(type == FMIVariableType::fmiTypeString || getArraySize(p.fmu, p.name) > 0)
+			xbt_die("port %s of FMU %s can not be published in the telemetry: it is neither a real, an integer nor a boolean",p.name.c_str(),p.fmu.c_str());
+		telemetry_ports.push_back(getPortHandle(p.fmu, p.name, type));
+		names.push_back(p.fmu + "." + p.name);
+	}
+
+	telemetry = new TelemetryWriter(file_path, names, capacity);
+	XBT_INFO("telemetry of %zu ports published in %s",ports.size(),file_path.c_str());
+	if(ready_for_simulation){
+		catchUp();
+		publishTelemetry();
+	}
+}
+
+void MasterFMI::disableTelemetry(){
+	delete telemetry;
+	telemetry = nullptr;
+	telemetry_ports.clear();
+}
+
+/**
+ * publish the current value of the telemetry ports (after each coupling solve, like the output log)
+ */
+void MasterFMI::publishTelemetry(){
+
+	if(telemetry == nullptr)
+		return;
+
+	double* values = telemetry->beginRow(current_time);
+	for(std::size_t i = 0; i < telemetry_ports.size(); i++)
+		values[i] = readNumericOutput(telemetry_ports[i]);
+	telemetry->endRow();
+}
+
+}
+}
@@ -0,0 +1,393 @@
+#include "simgrid-fmi.hpp"
+#include "fmi3_model.hpp"
+#include <simgrid/s4u/Engine.hpp>
+#include <cstdint>
+#include <cstring>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_trace, surf, "Logging specific to the input traces of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+#define TRACE_MAGIC "SGFMITRC"
+#define TRACE_FORMAT 1
+
+/*
+ * A trace starts with the communication step and the FMUs (name, URI if loaded by the plugin,
+ * iterateAfterInput), followed by the operations below. FMUs are designated by their rank in the
+ * header, ports by their name.
+ */
+enum trace_op : uint8_t{
+	TRACE_READY = 1,	// retry depth, couplings and monitored ports (readyForSimulation)
+	TRACE_STEP,		// time, dt: one step of every FMU
+	TRACE_COUPLING,		// firstIteration: solve of the couplings (and line of the output log)
+	TRACE_ITERATE,		// fmu: doStep(0) after an input change
+	TRACE_REAL,		// fmu, port, value
+	TRACE_INTEGER,		// fmu, port, value (booleans included)
+	TRACE_STRING,		// fmu, port, value
+	TRACE_REAL_ARRAY	// fmu, port, number of values, values
+};
+
+template<typename T> static void put(std::ofstream& out, const T& value){
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void putString(std::ofstream& out, const std::string& value){
+	uint32_t length = value.size();
+	put(out, length);
+	out.write(value.data(), length);
+}
+
+static void putPort(std::ofstream& out, const port& p){
+	putString(out, p.fmu);
+	putString(out, p.name);
+}
+
+/**
+ * sequential reader of a trace, failing instead of reading past its end
+ */
+struct trace_reader{
+	std::ifstream in;
+
+	template<typename T> bool get(T& value){
+		return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	bool getString(std::string& value){
+		uint32_t length;
+		if(!get(length))
+			return false;
+		value.resize(length);
+		return length == 0 || static_cast<bool>(in.read(&value[0], length));
+	}
+
+	bool getPort(port& p){
+		return getString(p.fmu) && getString(p.name);
+	}
+};
+
+
+/**
+ * FMIPlugin
+ */
+
+void FMIPlugin::recordInputs(std::string trace_path){
+	master->startRecording(trace_path);
+	static bool stop_connected = false;
+	if(!stop_connected){
+		stop_connected = true;
+		simgrid::s4u::on_simulation_end.connect([]() {
+			master->stopRecording();
+		});
+	}
+}
+
+void FMIPlugin::replayInputs(std::string trace_path, std::string output_file_path){
+	// the communication step is read from the trace
+	if(master == 0)
+		master = new MasterFMI(0);
+	master->replay(trace_path, output_file_path);
+}
+
+
+/**
+ * MasterFMI
+ */
+
+void MasterFMI::startRecording(std::string trace_path){
+
+	checkNotReadyForSimulation();
+	stopRecording();
+
+	trace.open(trace_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!trace.is_open())
+		xbt_die("can not open the trace file %s",trace_path.c_str());
+	this->trace_path = trace_path;
+
+	uint32_t format = TRACE_FORMAT;
+	uint32_t nb_fmus = fmu_table.size();
+	trace.write(TRACE_MAGIC, std::strlen(TRACE_MAGIC));
+	put(trace, format);
+	put(trace, commStep);
+	put(trace, nb_fmus);
+	for(std::size_t i = 0; i < fmu_table.size(); i++){
+		auto uri = fmu_uris.find(fmu_table_names[i]);
+		uint8_t iterate = fmu_table_iterate_input[i];
+		putString(trace, fmu_table_names[i]);
+		putString(trace, uri != fmu_uris.end() ? uri->second : "");
+		put(trace, iterate);
+	}
+	XBT_DEBUG("recording the inputs of %u FMUs in %s",nb_fmus,trace_path.c_str());
+}
+
+void MasterFMI::stopRecording(){
+
+	if(!trace.is_open())
+		return;
+
+	bool written = trace.good();
+	trace.close();
+	if(!written || trace.fail())
+		XBT_WARN("the trace %s could not be written entirely",trace_path.c_str());
+	else
+		XBT_DEBUG("inputs recorded in %s",trace_path.c_str());
+}
+
+void MasterFMI::recordReady(){
+
+	if(!trace.is_open())
+		return;
+	if(!transformed_couplings.empty())
+		XBT_WARN("the transformed couplings are not recorded: replay the trace with FMIPlugin::replayInputs after creating them again");
+
+	int32_t depth = step_retry_depth;
+	uint32_t nb_couplings = in_coupled_input.size() + in_array_coupled_input.size();
+	uint32_t nb_ports = monitored_ports.size();
+	put(trace, TRACE_READY);
+	put(trace, depth);
+	put(trace, nb_couplings);
+	for(const port& in : in_coupled_input){
+		putPort(trace, couplings[in]);
+		putPort(trace, in);
+	}
+	for(const port& in : in_array_coupled_input){
+		putPort(trace, array_couplings[in]);
+		putPort(trace, in);
+	}
+	put(trace, nb_ports);
+	for(const port& p : monitored_ports)
+		putPort(trace, p);
+}
+
+void MasterFMI::recordStep(double dt){
+	if(!trace.is_open() || trace_paused)
+		return;
+	put(trace, TRACE_STEP);
+	put(trace, current_time);
+	put(trace, dt);
+}
+
+void MasterFMI::recordCoupling(bool firstIteration){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint8_t first = firstIteration;
+	put(trace, TRACE_COUPLING);
+	put(trace, first);
+}
+
+void MasterFMI::recordIterate(std::size_t fmu){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint32_t index = fmu;
+	put(trace, TRACE_ITERATE);
+	put(trace, index);
+}
+
+void MasterFMI::recordInput(const std::string& fmi_name, const std::string& input_name, double value){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint32_t index = fmu_indexes[fmi_name];
+	put(trace, TRACE_REAL);
+	put(trace, index);
+	putString(trace, input_name);
+	put(trace, value);
+}
+
+void MasterFMI::recordInput(const std::string& fmi_name, const std::string& input_name, int value){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint32_t index = fmu_indexes[fmi_name];
+	int32_t v = value;
+	put(trace, TRACE_INTEGER);
+	put(trace, index);
+	putString(trace, input_name);
+	put(trace, v);
+}
+
+void MasterFMI::recordInput(const std::string& fmi_name, const std::string& input_name, const std::string& value){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint32_t index = fmu_indexes[fmi_name];
+	put(trace, TRACE_STRING);
+	put(trace, index);
+	putString(trace, input_name);
+	putString(trace, value);
+}
+
+void MasterFMI::recordInput(const std::string& fmi_name, const std::string& input_name, const std::vector<double>& values){
+	if(!trace.is_open() || trace_paused)
+		return;
+	uint32_t index = fmu_indexes[fmi_name];
+	uint32_t nb_values = values.size();
+	put(trace, TRACE_REAL_ARRAY);
+	put(trace, index);
+	putString(trace, input_name);
+	put(trace, nb_values);
+	trace.write(reinterpret_cast<const char*>(values.data()), nb_values * sizeof(double));
+}
+
+/**
+ * perform again the operations of a trace on the FMUs: the inputs are set directly on the FMUs,
+ * and the steps, iterations and coupling solves go through the same code as during the recording
+ */
+void MasterFMI::replay(std::string trace_path, std::string output_file_path){
+
+	checkNotReadyForSimulation();
+	if(trace.is_open())
+		xbt_die("can not replay the trace %s while recording the inputs",trace_path.c_str());
+
+	trace_reader reader;
+	reader.in.open(trace_path, std::ios::in | std::ios::binary);
+	if(!reader.in.is_open())
+		xbt_die("can not open the trace file %s",trace_path.c_str());
+
+	char magic[sizeof(TRACE_MAGIC) - 1];
+	uint32_t format, nb_fmus;
+	double step;
+	if(!reader.get(magic) || std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+			|| !reader.get(format) || format != TRACE_FORMAT || !reader.get(step) || !reader.get(nb_fmus))
+		xbt_die("%s is not a trace of the FMI plugin (or has another format)",trace_path.c_str());
+	commStep = step;
+
+	// rank of the FMUs of the trace in fmu_table
+	std::vector<std::size_t> local;
+	for(uint32_t i = 0; i < nb_fmus; i++){
+		std::string name, uri;
+		uint8_t iterate;
+		if(!reader.getString(name) || !reader.getString(uri) || !reader.get(iterate))
+			xbt_die("the header of the trace %s is truncated",trace_path.c_str());
+		if(fmus.find(name) == fmus.end()){
+			if(uri.empty())
+				xbt_die("FMU %s is an in-memory model: add it before replaying the trace %s",name.c_str(),trace_path.c_str());
+			addFMUCS(uri, name, iterate);
+			if(fmus.find(name) == fmus.end())
+				xbt_die("can not load FMU %s from %s to replay the trace",name.c_str(),uri.c_str());
+		}
+		local.push_back(fmu_indexes[name]);
+	}
+
+	unsigned long long nb_steps = 0;
+	uint8_t op;
+	while(reader.get(op)){
+		bool complete = true;
+		uint32_t index = 0;
+		std::string name;
+
+		if(op >= TRACE_ITERATE){
+			complete = reader.get(index) && (op == TRACE_ITERATE || reader.getString(name));
+			if(complete && index >= local.size())
+				xbt_die("the trace %s is corrupted (FMU #%u)",trace_path.c_str(),index);
+		}
+
+		switch(op){
+			case TRACE_READY:
+			{
+				int32_t depth;
+				uint32_t nb_couplings, nb_ports;
+				complete = reader.get(depth) && reader.get(nb_couplings);
+				for(uint32_t i = 0; complete && i < nb_couplings; i++){
+					port out, in;
+					complete = reader.getPort(out) && reader.getPort(in);
+					if(!complete)
+						break;
+					bool connected = (couplings.count(in) > 0 && couplings[in] == out)
+							|| (array_couplings.count(in) > 0 && array_couplings[in] == out);
+					if(!connected)
+						connectFMU(out.fmu, out.name, in.fmu, in.name);
+				}
+				std::vector<port> ports;
+				complete = complete && reader.get(nb_ports);
+				for(uint32_t i = 0; complete && i < nb_ports; i++){
+					port p;
+					complete = reader.getPort(p);
+					ports.push_back(p);
+				}
+				if(!complete)
+					break;
+				if(!output_file_path.empty())
+					configureOutputLog(output_file_path, ports);
+				setStepRetry(depth);
+				ready_for_simulation = true;
+				break;
+			}
+			case TRACE_STEP:
+			{
+				double time, dt;
+				complete = reader.get(time) && reader.get(dt);
+				if(!complete)
+					break;
+				current_time = time;
+				stepFMUs(dt);
+				nb_steps++;
+				break;
+			}
+			case TRACE_COUPLING:
+			{
+				uint8_t first;
+				complete = reader.get(first);
+				if(complete)
+					solveCouplings(first);
+				break;
+			}
+			case TRACE_ITERATE:
+				if(complete)
+					iterateInput(local[index]);
+				break;
+			case TRACE_REAL:
+			{
+				double value;
+				complete = complete && reader.get(value);
+				if(complete && fmu_table[local[index]]->setValue(name, value) != fmiOK)
+					xbt_die("FMU %s failed to set its port %s to value %f",fmu_table_names[local[index]].c_str(),name.c_str(),value);
+				break;
+			}
+			case TRACE_INTEGER:
+			{
+				int32_t value;
+				complete = complete && reader.get(value);
+				fmiInteger v = value;
+				if(complete && fmu_table[local[index]]->setValue(name, v) != fmiOK)
+					xbt_die("FMU %s failed to set its port %s to value %i",fmu_table_names[local[index]].c_str(),name.c_str(),value);
+				break;
+			}
+			case TRACE_STRING:
+			{
+				std::string value;
+				complete = complete && reader.getString(value);
+				if(complete && fmu_table[local[index]]->setValue(name, value) != fmiOK)
+					xbt_die("FMU %s failed to set its port %s to value %s",fmu_table_names[local[index]].c_str(),name.c_str(),value.c_str());
+				break;
+			}
+			case TRACE_REAL_ARRAY:
+			{
+				uint32_t nb_values;
+				complete = complete && reader.get(nb_values);
+				std::vector<double> values;
+				// bounded by what is left, so that a corrupted size does not allocate blindly
+				for(uint32_t i = 0; complete && i < nb_values; i++){
+					double value;
+					complete = reader.get(value);
+					values.push_back(value);
+				}
+				FMU3CoSimulation* fmu3 = dynamic_cast<FMU3CoSimulation*>(fmu_table[local[index]]);
+				if(complete && (fmu3 == nullptr || fmu3->setArray(name, values) != fmiOK))
+					xbt_die("FMU %s failed to set its array port %s (%zu values)",fmu_table_names[local[index]].c_str(),name.c_str(),values.size());
+				break;
+			}
+			default:
+				xbt_die("the trace %s is corrupted (operation %u)",trace_path.c_str(),(unsigned) op);
+		}
+
+		if(!complete){
+			XBT_WARN("the trace %s is truncated: replay stopped at time %f",trace_path.c_str(),current_time);
+			break;
+		}
+	}
+
+	XBT_INFO("%llu steps replayed from %s, up to time %f",nb_steps,trace_path.c_str(),current_time);
+	closeOutputLog();
+}
+
+}
+}
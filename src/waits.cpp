@@ -0,0 +1,221 @@
+#include "simgrid-fmi.hpp"
+#include <simgrid/simix.hpp>
+#include <simgrid/s4u/Engine.hpp>
+#include <simgrid/s4u/ConditionVariable.hpp>
+#include <simgrid/s4u/Mutex.hpp>
+#include <mutex>
+
+XBT_LOG_NEW_DEFAULT_SUBCATEGORY(surf_fmi_waits, surf, "Logging specific to the waits of the SURF FMI plugin");
+
+
+namespace simgrid{
+namespace fmi{
+
+static bool compare(double output, port_comparison comparison, double value){
+	switch(comparison){
+	case port_comparison::LESS:
+		return output < value;
+	case port_comparison::LESS_OR_EQUAL:
+		return output <= value;
+	case port_comparison::GREATER:
+		return output > value;
+	case port_comparison::GREATER_OR_EQUAL:
+		return output >= value;
+	case port_comparison::EQUAL:
+		return output == value;
+	case port_comparison::NOT_EQUAL:
+		return output != value;
+	}
+	return false;
+}
+
+static std::shared_ptr<fmu_wait> newWait(){
+	std::shared_ptr<fmu_wait> wait = std::make_shared<fmu_wait>();
+	wait->mutex = simgrid::s4u::Mutex::create();
+	wait->cv = simgrid::s4u::ConditionVariable::create();
+	wait->waiters = 1;
+	return wait;
+}
+
+
+/**
+ * FMIPlugin
+ */
+
+bool FMIPlugin::waitUntil(std::function<bool()> condition, double timeout){
+	return block(simgrid::simix::simcall([&condition]() {
+		return master->addWait(condition);
+	}), timeout);
+}
+
+bool FMIPlugin::waitFor(std::string fmi_name, std::string output_name, port_comparison comparison, double value, double timeout){
+	return block(simgrid::simix::simcall([&fmi_name,&output_name,comparison,value]() {
+		return master->addWait(fmi_name, output_name, comparison, value);
+	}), timeout);
+}
+
+/**
+ * block the calling actor until the master satisfies the wait (nullptr if the condition already holds)
+ */
+bool FMIPlugin::block(std::shared_ptr<fmu_wait> wait, double timeout){
+
+	if(wait == nullptr)
+		return true;
+
+	const double deadline = simgrid::s4u::Engine::get_clock() + timeout;
+	std::unique_lock<simgrid::s4u::Mutex> lock(*wait->mutex);
+	while(!wait->satisfied && !wait->cancelled){
+		if(timeout < 0)
+			wait->cv->wait(lock);
+		else if(wait->cv->wait_until(lock, deadline) == simgrid::s4u::cv_status::timeout)
+			break;
+	}
+	if(wait->satisfied)
+		return true;
+	if(wait->cancelled)
+		return false;
+
+	simgrid::simix::simcall([&wait]() {
+		master->removeWait(wait);
+	});
+	return false;
+}
+
+
+/**
+ * MasterFMI
+ */
+
+std::shared_ptr<fmu_wait> MasterFMI::addWait(std::function<bool()> condition){
+
+	catchUp();
+
+	if(collect_statistics)
+		statistics.event_conditions_evaluated++;
+	if(condition())
+		return nullptr;
+
+	std::shared_ptr<fmu_wait> wait = newWait();
+	wait->condition = std::move(condition);
+	condition_waits.push_back(wait);
+	return wait;
+}
+
+std::shared_ptr<fmu_wait> MasterFMI::addWait(const std::string& fmi_name, const std::string& output_name, port_comparison comparison, double value){
+
+	settle();
+	catchUp();
+	checkPortValidity(fmi_name, output_name, FMIVariableType::fmiTypeUnknown, false);
+	FMIVariableType type = fmus[fmi_name]->getType(output_name);
+	if(type == FMIVariableType::fmiTypeString || getArraySize(fmi_name, output_name) > 0)
+		xbt_die("can not wait for port %s of FMU %s: it is neither a real, an integer nor a boolean",output_name.c_str(),fmi_name.c_str());
+
+	auto group = std::find_if(output_waits.begin(), output_waits.end(), [&](const output_wait& w){
+		return w.out.p.fmu == fmi_name && w.out.p.name == output_name;
+	});
+	port_handle out = (group == output_waits.end()) ? getPortHandle(fmi_name, output_name, type) : group->out;
+
+	if(collect_statistics)
+		statistics.event_conditions_evaluated++;
+	if(compare(readNumericOutput(out), comparison, value))
+		return nullptr;
+
+	if(group == output_waits.end()){
+		output_waits.push_back(output_wait());
+		group = output_waits.end() - 1;
+		group->out = out;
+	}
+	for(std::shared_ptr<fmu_wait>& wait : group->waits){
+		if(wait->comparison == comparison && wait->value == value){
+			wait->waiters++;
+			return wait;
+		}
+	}
+	std::shared_ptr<fmu_wait> wait = newWait();
+	wait->comparison = comparison;
+	wait->value = value;
+	group->waits.push_back(wait);
+	return wait;
+}
+
+/**
+ * withdraw an actor whose wait timed out (the wait is dropped when no actor is left)
+ */
+void MasterFMI::removeWait(const std::shared_ptr<fmu_wait>& wait){
+
+	if(wait->satisfied || wait->cancelled || --wait->waiters > 0)
+		return;
+
+	condition_waits.erase(std::remove(condition_waits.begin(), condition_waits.end(), wait), condition_waits.end());
+	for(std::size_t i = 0; i < output_waits.size(); i++){
+		std::vector<std::shared_ptr<fmu_wait>>& waits = output_waits[i].waits;
+		waits.erase(std::remove(waits.begin(), waits.end(), wait), waits.end());
+		if(waits.empty()){
+			output_waits.erase(output_waits.begin() + i);
+			break;
+		}
+	}
+}
+
+/**
+ * wake the actors whose condition holds (after the events, at each update and input change)
+ */
+void MasterFMI::notifyWaits(){
+
+	for(std::size_t i = 0; i < output_waits.size(); i++){
+		std::vector<std::shared_ptr<fmu_wait>>& waits = output_waits[i].waits;
+		double output = readNumericOutput(output_waits[i].out);
+		if(collect_statistics)
+			statistics.event_conditions_evaluated++;
+		for(std::size_t j = 0; j < waits.size(); j++){
+			if(compare(output, waits[j]->comparison, waits[j]->value)){
+				if(collect_statistics)
+					statistics.events_fired++;
+				waits[j]->satisfied = true;
+				waits[j]->cv->notify_all();
+				waits.erase(waits.begin() + j);
+				j--;
+			}
+		}
+		if(waits.empty()){
+			output_waits.erase(output_waits.begin() + i);
+			i--;
+		}
+	}
+
+	for(std::size_t i = 0; i < condition_waits.size(); i++){
+		if(collect_statistics)
+			statistics.event_conditions_evaluated++;
+		if(condition_waits[i]->condition()){
+			if(collect_statistics)
+				statistics.events_fired++;
+			condition_waits[i]->satisfied = true;
+			condition_waits[i]->cv->notify_all();
+			condition_waits.erase(condition_waits.begin() + i);
+			i--;
+		}
+	}
+}
+
+/**
+ * wake the waiting actors with a failure (at the reset of the simulation, their conditions are about
+ * the previous replication)
+ */
+void MasterFMI::cancelWaits(){
+
+	for(output_wait& group : output_waits){
+		for(std::shared_ptr<fmu_wait>& wait : group.waits){
+			wait->cancelled = true;
+			wait->cv->notify_all();
+		}
+	}
+	for(std::shared_ptr<fmu_wait>& wait : condition_waits){
+		wait->cancelled = true;
+		wait->cv->notify_all();
+	}
+	output_waits.clear();
+	condition_waits.clear();
+}
+
+}
+}
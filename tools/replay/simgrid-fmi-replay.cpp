@@ -0,0 +1,25 @@
+#include "simgrid/s4u.hpp"
+#include "simgrid-fmi.hpp"
+#include <cstdio>
+
+/*
+ * Replay of the inputs recorded by FMIPlugin::recordInputs: the FMUs are loaded again from
+ * their URI and run with the recorded inputs, without platform nor actors, so that the physical
+ * models can be rerun (e.g. with a finer output log, or under a debugger) without SimGrid.
+ * Simulations using in-memory models have to call FMIPlugin::replayInputs themselves.
+ *
+ * usage: simgrid-fmi-replay trace [output.csv]
+ */
+int main(int argc, char *argv[]){
+
+	// for the --log options
+	simgrid::s4u::Engine e(&argc, argv);
+
+	if(argc < 2 || argc > 3){
+		std::fprintf(stderr, "usage: %s trace [output.csv]\n", argv[0]);
+		return 1;
+	}
+
+	simgrid::fmi::FMIPlugin::replayInputs(argv[1], argc == 3 ? argv[2] : "");
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include "simgrid-fmi-telemetry.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Live view of the telemetry published by FMIPlugin::enableTelemetry: the rows are printed as they
+ * are published, in the format of the output log (time;port1;port2...), from the last row written
+ * when the tool starts until the simulation ends. The tool waits for the file if it does not exist
+ * yet, and reports on stderr the rows overwritten before being read (if it is too slow).
+ *
+ * usage: simgrid-fmi-telemetry telemetry_file [interval_ms]
+ */
+int main(int argc, char *argv[]){
+
+	if(argc < 2 || argc > 3){
+		std::fprintf(stderr, "usage: %s telemetry_file [interval_ms]\n", argv[0]);
+		return 1;
+	}
+	const long interval = (argc == 3) ? std::atol(argv[2]) : 100;
+
+	simgrid::fmi::TelemetryReader reader;
+	while(!reader.open(argv[1]))
+		usleep(interval * 1000);
+
+	const std::vector<std::string>& names = reader.getPortNames();
+	std::printf("time");
+	for(const std::string& name : names)
+		std::printf(";%s", name.c_str());
+	std::printf("\n");
+
+	std::vector<double> values(names.size());
+	double time;
+	uint64_t next = reader.getRows();
+	next = (next > 0) ? next - 1 : 0;
+	for(;;){
+		// read before the rows, so that the rows published before the end are all printed
+		bool finished = reader.isFinished();
+		uint64_t rows = reader.getRows();
+		if(rows - next > reader.getCapacity()){
+			std::fprintf(stderr, "%llu rows lost\n", (unsigned long long) (rows - reader.getCapacity() - next));
+			next = rows - reader.getCapacity();
+		}
+		for(; next < rows; next++){
+			if(!reader.readRow(next, &time, values.data())){
+				std::fprintf(stderr, "row %llu lost\n", (unsigned long long) next);
+				continue;
+			}
+			std::printf("%g", time);
+			for(double value : values)
+				std::printf(";%g", value);
+			std::printf("\n");
+		}
+		std::fflush(stdout);
+		if(finished)
+			return 0;
+		usleep(interval * 1000);
+	}
+}